@@ -0,0 +1,60 @@
+#ifndef AUTOCROP_H
+#define AUTOCROP_H
+
+#include <cstdint>
+#include <filesystem>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+class VideoAnalysis;
+
+// Rectangle of a frame holding the active picture, without black borders
+struct CropRect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Detect the black borders shared by a sample of keyframes spread over [start_pts, end_pts)
+// (video stream time base; AV_NOPTS_VALUE leaves an end open)
+// `crop` is set to the whole frame if there are no borders worth cropping.
+int detect_crop(
+    const std::filesystem::path &in_fpath,
+    int64_t start_pts,
+    int64_t end_pts,
+    int num_samples,
+    CropRect &crop
+);
+
+// Determine the crop from the active areas of the analyzed frames in [start_pts, end_pts)
+int detect_crop_from_analysis(
+    const VideoAnalysis &analysis,
+    int64_t start_pts,
+    int64_t end_pts,
+    AVPixelFormat pix_fmt,
+    CropRect &crop
+);
+
+// Round a crop rectangle outwards to the chroma subsampling of the pixel format, within the frame
+// Cropping frames at odd offsets would shift the chroma planes against the luma plane.
+void align_crop(CropRect &crop, int width, int height, AVPixelFormat pix_fmt);
+
+// Find the bounding box of the rows and columns of a frame that are not black
+// Returns false for frames that are entirely black or not in a YUV or grayscale format.
+bool find_active_area(const AVFrame *frame, CropRect &area);
+
+// Scale the size of a crop rectangle from the input frame to the output frame
+void get_cropped_output_size(
+    const CropRect &crop,
+    int in_width,
+    int in_height,
+    int out_width,
+    int out_height,
+    int &cropped_width,
+    int &cropped_height
+);
+
+#endif  // AUTOCROP_H
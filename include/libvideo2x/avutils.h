@@ -1,14 +1,63 @@
 #ifndef AVUTILS_H
 #define AVUTILS_H
 
+#include <filesystem>
+#include <memory>
+
 extern "C" {
 #include <libavformat/avformat.h>
 }
 
 #define CALC_FFMPEG_VERSION(a, b, c) (a << 16 | b << 8 | c)
 
+// Deleters for owning FFmpeg objects with std::unique_ptr
+struct AVFrameDeleter {
+    void operator()(AVFrame *frame) const { av_frame_free(&frame); }
+};
+
+struct AVPacketDeleter {
+    void operator()(AVPacket *packet) const { av_packet_free(&packet); }
+};
+
+struct AVInputFormatContextDeleter {
+    void operator()(AVFormatContext *ctx) const { avformat_close_input(&ctx); }
+};
+
+struct AVOutputFormatContextDeleter {
+    void operator()(AVFormatContext *ctx) const {
+        if (!(ctx->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&ctx->pb);
+        }
+        avformat_free_context(ctx);
+    }
+};
+
+using AVFramePtr = std::unique_ptr<AVFrame, AVFrameDeleter>;
+using AVPacketPtr = std::unique_ptr<AVPacket, AVPacketDeleter>;
+using AVInputFormatContextPtr = std::unique_ptr<AVFormatContext, AVInputFormatContextDeleter>;
+using AVOutputFormatContextPtr = std::unique_ptr<AVFormatContext, AVOutputFormatContextDeleter>;
+
 int64_t get_video_frame_count(AVFormatContext *ifmt_ctx, int in_vstream_idx);
 
+// Open an input file and read its stream information
+int open_input_file(const std::filesystem::path &fpath, AVInputFormatContextPtr &fmt_ctx);
+
+// Convert a time in AV_TIME_BASE units, relative to the start of the file, into a timestamp in
+// the time base of the given stream
+int64_t time_to_stream_pts(AVFormatContext *fmt_ctx, int stream_idx, int64_t time);
+
+// Replace open ends (AV_NOPTS_VALUE) of a stream timestamp range with the stream's start and end
+int resolve_stream_range(
+    AVFormatContext *fmt_ctx,
+    int stream_idx,
+    int64_t &start_pts,
+    int64_t &end_pts
+);
+
+// Allocate a codec context describing the frames of `ctx` resized to the given dimensions
+// Filters wrapping another filter use it to describe the frames they pass on.
+AVCodecContext *alloc_resized_codec_context(const AVCodecContext *ctx, int width, int height);
+
 enum AVPixelFormat
 get_encoder_default_pix_fmt(const AVCodec *encoder, AVPixelFormat target_pix_fmt);
 
@@ -0,0 +1,84 @@
+#ifndef CONCURRENCY_CONTROLLER_H
+#define CONCURRENCY_CONTROLLER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Pipeline stages whose throughput is measured
+enum class PipelineStage { Decode, Filter, Encode };
+
+// Runtime controller for the number of active filter workers in the pipelined mode
+// The pipeline samples the occupancy of its queues periodically. Workers are added while the
+// decoded frame queue stays full and the encoder is waiting for frames, and kept only if they
+// raise the output throughput; workers are parked when the filters are starved by the decoder or
+// held back by the encoder.
+class ConcurrencyController {
+   public:
+    // Sampling period and number of samples per adjustment
+    static constexpr std::chrono::milliseconds SAMPLE_INTERVAL{50};
+    static constexpr int SAMPLES_PER_ADJUSTMENT = 10;
+
+    // An adaptive controller starts with one active worker; otherwise all workers stay active
+    ConcurrencyController(size_t max_workers, bool adaptive);
+
+    ConcurrencyController(const ConcurrencyController &) = delete;
+    ConcurrencyController &operator=(const ConcurrencyController &) = delete;
+
+    // Block a worker while it is parked; returns immediately once the controller is stopped
+    void wait_until_active(size_t worker_index);
+
+    // Count a frame leaving the given stage
+    void record_frame(PipelineStage stage);
+
+    // Record the fill ratios (0 to 1) of the decoded frame queue and the reorder buffer; the
+    // number of active workers is adjusted after every SAMPLES_PER_ADJUSTMENT samples
+    void sample(double decoded_fill, double filtered_fill);
+
+    // Wait for the next sampling period; returns false once the controller is stopped
+    bool wait_for_next_sample();
+
+    // Activate all workers and stop adjusting
+    void stop();
+
+    bool is_adaptive() const { return adaptive_; }
+
+    // Log the final number of workers, the stages' throughput, and the mean queue fill
+    void log_summary() const;
+
+   private:
+    void adjust();
+
+    const size_t max_workers_;
+    const bool adaptive_;
+    const std::chrono::steady_clock::time_point start_time_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    size_t active_workers_;
+    size_t worker_ceiling_;
+    bool stopped_ = false;
+
+    std::atomic<int64_t> stage_frames_[3] = {};
+
+    // Accumulated over the current adjustment period
+    int samples_ = 0;
+    double decoded_fill_sum_ = 0;
+    double filtered_fill_sum_ = 0;
+    int64_t period_start_frames_ = 0;
+    std::chrono::steady_clock::time_point period_start_time_;
+
+    // Throughput before the last worker was added, checked after the following period
+    bool evaluating_added_worker_ = false;
+    double last_throughput_ = 0;
+
+    // Accumulated over the whole run for the summary
+    int64_t total_samples_ = 0;
+    double total_decoded_fill_ = 0;
+    double total_filtered_fill_ = 0;
+};
+
+#endif  // CONCURRENCY_CONTROLLER_H
@@ -9,12 +9,42 @@ extern "C" {
 #include <mat.h>
 
 // Convert AVFrame to another pixel format
-AVFrame *convert_avframe_pix_fmt(AVFrame *src_frame, AVPixelFormat pix_fmt);
+AVFrame *convert_avframe_pix_fmt(
+    AVFrame *src_frame,
+    AVPixelFormat pix_fmt,
+    bool reuse_context = true
+);
+
+// Scale AVFrame to the given dimensions and pixel format
+// Scaling contexts are leased from the process-wide SwsContextCache; unless `reuse_context` is
+// set, a new context is created for this conversion.
+AVFrame *scale_avframe(
+    const AVFrame *src_frame,
+    int width,
+    int height,
+    AVPixelFormat pix_fmt,
+    int flags,
+    bool reuse_context = true
+);
+
+// Wrap a BGR24 AVFrame whose lines are not padded in an ncnn::Mat without copying
+// Returns an empty Mat for other frames. The Mat does not own the pixels, so the frame must
+// outlive it; writing to the Mat writes to the frame.
+ncnn::Mat avframe_to_ncnn_mat_view(AVFrame *frame);
 
 // Convert AVFrame to ncnn::Mat
-ncnn::Mat avframe_to_ncnn_mat(AVFrame *frame);
+ncnn::Mat avframe_to_ncnn_mat(AVFrame *frame, bool reuse_context = true);
 
 // Convert ncnn::Mat to AVFrame
-AVFrame *ncnn_mat_to_avframe(const ncnn::Mat &mat, AVPixelFormat pix_fmt);
+// Pass the color space and range of the source frame to convert back with the same matrix.
+// If `fused` is set, formats supported by convert_bgr24_to_yuv420 are converted without swscale.
+AVFrame *ncnn_mat_to_avframe(
+    const ncnn::Mat &mat,
+    AVPixelFormat pix_fmt,
+    AVColorSpace colorspace = AVCOL_SPC_UNSPECIFIED,
+    AVColorRange color_range = AVCOL_RANGE_UNSPECIFIED,
+    bool reuse_context = true,
+    bool fused = false
+);
 
 #endif  // CONVERSIONS_H
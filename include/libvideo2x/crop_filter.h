@@ -0,0 +1,44 @@
+#ifndef CROP_FILTER_H
+#define CROP_FILTER_H
+
+#include <memory>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "autocrop.h"
+#include "filter.h"
+
+// Filter stage that only feeds the active area of each frame to the wrapped filter
+// With padding, the filtered area is placed on a black frame of the encoder's size at the crop
+// offset scaled to the output, so the output keeps its borders; otherwise the encoder has to be
+// set up for the cropped size.
+class CropFilter : public Filter {
+   public:
+    CropFilter(std::unique_ptr<Filter> filter, const CropRect &crop, bool pad);
+    ~CropFilter() override;
+
+    int init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) override;
+    int process_frame(AVFrame *in_frame, AVFrame **out_frame) override;
+    int flush(std::vector<AVFrame *> &flushed_frames) override;
+    void set_processing_control(ProcessingControl *control) override;
+
+   private:
+    // Place a filtered frame on a black frame of the output size; takes ownership of the frame
+    int pad_frame(AVFrame *frame, AVFrame **out_frame);
+
+    std::unique_ptr<Filter> filter_;
+    CropRect crop_;
+    bool pad_;
+
+    // Decoder context describing the cropped frames passed to the wrapped filter
+    AVCodecContext *crop_ctx_ = nullptr;
+
+    int in_width_ = 0;
+    int in_height_ = 0;
+    int out_width_ = 0;
+    int out_height_ = 0;
+};
+
+#endif  // CROP_FILTER_H
@@ -13,7 +13,28 @@ class Decoder {
     Decoder();
     ~Decoder();
 
-    int init(AVHWDeviceType hw_type, AVBufferRef *hw_ctx, const std::filesystem::path &in_fpath);
+    // Analysis passes can decode at 1/2^lowres of the resolution, if the decoder supports it, and
+    // let the decoder use as many threads as it likes
+    int init(
+        AVHWDeviceType hw_type,
+        AVBufferRef *hw_ctx,
+        const std::filesystem::path &in_fpath,
+        int lowres = 0,
+        bool threaded = false
+    );
+
+    // Restrict decoding to frames with timestamps in [start_pts, end_pts) (video stream time base)
+    // AV_NOPTS_VALUE leaves the corresponding end of the range open.
+    int set_frame_range(int64_t start_pts, int64_t end_pts);
+    bool is_before_range(const AVFrame *frame) const;
+    bool is_past_range(const AVFrame *frame) const;
+
+    // Seek to the closest keyframe at or before the timestamp (video stream time base)
+    int seek_to_keyframe(int64_t pts);
+
+    // Demux and decode until the next video frame is available, ignoring other streams
+    // Returns AVERROR_EOF once the input has been read and the decoder has been drained.
+    int decode_next_frame(AVFrame *frame);
 
     AVFormatContext *get_format_context() const;
     AVCodecContext *get_codec_context() const;
@@ -27,6 +48,9 @@ class Decoder {
     AVFormatContext *fmt_ctx_;
     AVCodecContext *dec_ctx_;
     int in_vstream_idx_;
+    int64_t start_pts_;
+    int64_t end_pts_;
+    bool draining_;
 };
 
 #endif  // DECODER_H
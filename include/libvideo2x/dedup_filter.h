@@ -0,0 +1,55 @@
+#ifndef DEDUP_FILTER_H
+#define DEDUP_FILTER_H
+
+#include <cstdint>
+#include <memory>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "avutils.h"
+#include "filter.h"
+#include "video_analysis.h"
+
+// Filter stage that skips frames repeating the previous frame
+// Each decoded frame is compared with the previous one; a repeat reuses the wrapped filter's last
+// output with the new frame's timestamp instead of filtering it again.
+class DedupFilter : public Filter {
+   public:
+    // `threshold` is the largest mean absolute difference per sample (on an 8-bit scale) for
+    // frames to count as repeats; 0 only matches identical frames
+    // Frames found in `analysis` are only compared if their analyzed features allow a repeat.
+    DedupFilter(
+        std::unique_ptr<Filter> filter,
+        double threshold,
+        const VideoAnalysis *analysis = nullptr
+    );
+    ~DedupFilter() override;
+
+    int init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) override;
+    int process_frame(AVFrame *in_frame, AVFrame **out_frame) override;
+    int flush(std::vector<AVFrame *> &flushed_frames) override;
+    void set_processing_control(ProcessingControl *control) override;
+
+   private:
+    std::unique_ptr<Filter> filter_;
+    double threshold_;
+    const VideoAnalysis *analysis_;
+    AVRational in_time_base_;
+    AVRational out_time_base_;
+
+    // The previous input frame and the output it produced
+    AVFramePtr prev_in_frame_;
+    AVFramePtr prev_out_frame_;
+    uint64_t prev_hash_ = 0;
+
+    // Set once the wrapped filter buffers frames, since its outputs can then no longer be matched
+    // with their inputs
+    bool filter_buffers_ = false;
+
+    int64_t total_frames_ = 0;
+    int64_t reused_frames_ = 0;
+};
+
+#endif  // DEDUP_FILTER_H
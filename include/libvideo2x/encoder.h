@@ -3,6 +3,9 @@
 
 #include <cstdint>
 #include <filesystem>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -11,6 +14,8 @@ extern "C" {
 
 #include "libvideo2x/libvideo2x.h"
 
+class StreamCopier;
+
 class Encoder {
    public:
     Encoder();
@@ -26,6 +31,7 @@ class Encoder {
     );
 
     int write_frame(AVFrame *frame, int64_t frame_idx);
+    int copy_packet(AVPacket *packet, AVFormatContext *ifmt_ctx);
     int flush();
 
     AVCodecContext *get_encoder_context() const;
@@ -33,11 +39,40 @@ class Encoder {
     int *get_stream_map() const;
     int get_output_video_stream_index() const;
 
+    // Total size of the encoded video packets written so far
+    int64_t get_encoded_bytes() const;
+
+    // Record the timestamp, in the encoder's time base, and the size of each encoded video packet
+    void set_record_packet_sizes(bool record);
+    const std::vector<std::pair<int64_t, int64_t>> &get_packet_sizes() const;
+
+    // Report the progress of the video stream to a copier of the other streams
+    void set_stream_copier(StreamCopier *stream_copier);
+
+    // Create a new scaling context for every pixel format conversion unless `reuse` is set
+    void set_reuse_sws_contexts(bool reuse);
+
    private:
     AVFormatContext *ofmt_ctx_;
     AVCodecContext *enc_ctx_;
     int out_vstream_idx_;
     int *stream_map_;
+
+    // Time range being processed and the offset subtracted from output video timestamps
+    int64_t start_time_;
+    int64_t end_time_;
+    int64_t pts_offset_;
+    int64_t encoded_bytes_;
+    bool record_packet_sizes_;
+    std::vector<std::pair<int64_t, int64_t>> packet_sizes_;
+    StreamCopier *stream_copier_;
+    bool reuse_sws_contexts_;
+
+    // Serializes muxing when packets are written from multiple threads
+    std::mutex mux_mutex_;
+
+    int mux_packet(AVPacket *packet);
+    int mux_video_packet(AVPacket *packet);
 };
 
 #endif  // ENCODER_H
@@ -0,0 +1,26 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <cstdint>
+
+#include "decoder.h"
+#include "encoder.h"
+#include "filter.h"
+#include "libvideo2x.h"
+
+// Run a stratified sample of frames from [start_pts, end_pts) through the decoder, filter, and
+// encoder, and extrapolate the cost of processing `proc_ctx->total_frames` frames
+// The range is divided into `num_samples` strata; a short run of consecutive frames is processed
+// from a random keyframe within each stratum, after a few warm-up frames that are not measured.
+int estimate_processing(
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    Encoder &encoder,
+    Filter *filter,
+    int num_samples,
+    int64_t start_pts,
+    int64_t end_pts,
+    ProcessingEstimate *estimate
+);
+
+#endif  // ESTIMATOR_H
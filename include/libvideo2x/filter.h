@@ -9,6 +9,8 @@ extern "C" {
 #include <libavutil/buffer.h>
 }
 
+#include "processing_control.h"
+
 // Abstract base class for filters
 class Filter {
    public:
@@ -16,6 +18,12 @@ class Filter {
     virtual int init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) = 0;
     virtual int process_frame(AVFrame *in_frame, AVFrame **out_frame) = 0;
     virtual int flush(std::vector<AVFrame *> &_) { return 0; }
+
+    // Sets the control checked by filters that can pause or abort within a frame
+    virtual void set_processing_control(ProcessingControl *control) { control_ = control; }
+
+   protected:
+    ProcessingControl *control_ = nullptr;
 };
 
 #endif  // FILTER_H
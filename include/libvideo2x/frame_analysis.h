@@ -0,0 +1,44 @@
+#ifndef FRAME_ANALYSIS_H
+#define FRAME_ANALYSIS_H
+
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Check whether the frame's pixel data can be read directly (software frames only)
+bool is_frame_analyzable(const AVFrame *frame);
+
+// Hash the visible pixels of a software frame; padding at the end of rows is ignored
+uint64_t hash_frame(const AVFrame *frame);
+
+// Compare the pixels of two software frames with the same format and dimensions
+// Returns true if the mean absolute difference per sample is at most `max_mean_diff`, scaled to
+// 8-bit sample values; a threshold of 0 requires the frames to be identical.
+bool frames_match(const AVFrame *a, const AVFrame *b, double max_mean_diff);
+
+// Mean luma difference (8-bit scale) from the previous frame that starts a new scene
+constexpr double SCENE_CUT_MOTION = 30.0;
+
+// Measures of the luma detail of a frame, on an 8-bit scale
+struct FrameComplexity {
+    // Mean luma
+    double brightness;
+    // Mean absolute horizontal and vertical luma gradient
+    double edges;
+    // Standard deviation of the luma
+    double deviation;
+    // Mean absolute luma difference from the previous frame; 0 without a previous frame
+    double motion;
+};
+
+// Measure the complexity of a software YUV or grayscale frame from a subsample of its luma
+// `prev_frame` may be null or have different dimensions, in which case no motion is measured.
+bool measure_frame_complexity(
+    const AVFrame *frame,
+    const AVFrame *prev_frame,
+    FrameComplexity &complexity
+);
+
+#endif  // FRAME_ANALYSIS_H
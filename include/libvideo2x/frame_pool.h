@@ -0,0 +1,89 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+#include <mat.h>
+
+// Process-wide pools of frame buffers reused across frames
+// There is one AVBufferPool per buffer size, which is determined by the pixel format and
+// dimensions of the frames. Buffers return to their pool when the last reference to them is
+// released, so in steady state no large buffers are allocated. The pools are shared by concurrent
+// jobs, which register with begin_job and end_job so that idle buffers are only released once no
+// job is running.
+class FramePool {
+   public:
+    // Buffer requests and the buffers that had to be allocated; they only ever increase
+    struct Stats {
+        int64_t requests;
+        int64_t misses;
+    };
+
+    static FramePool &get_instance();
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    // Allocate a frame whose planes live in a single pooled buffer
+    AVFrame *alloc_frame(AVPixelFormat pix_fmt, int width, int height);
+
+    // Allocator for ncnn::Mat that draws from the same pools; safe to use from multiple threads
+    ncnn::Allocator *get_mat_allocator() { return &mat_allocator_; }
+
+    // Register a job using the pools; the idle buffers are released when the last job ends
+    void begin_job();
+    void end_job();
+
+    Stats get_stats() const { return {requests_.load(), misses_.load()}; }
+
+    // Log the buffers served since `since` was taken with get_stats
+    void log_stats(const Stats &since) const;
+
+   private:
+    class MatAllocator : public ncnn::Allocator {
+       public:
+        explicit MatAllocator(FramePool &pool) : pool_(pool) {}
+        ~MatAllocator() override;
+
+        void *fastMalloc(size_t size) override;
+        void fastFree(void *ptr) override;
+
+       private:
+        FramePool &pool_;
+        std::mutex mutex_;
+        std::unordered_map<void *, AVBufferRef *> buffers_;
+    };
+
+    FramePool() : mat_allocator_(*this) {}
+    ~FramePool();
+
+    // Get a buffer of the given size from its pool, creating the pool if needed
+    AVBufferRef *get_buffer(size_t size);
+
+    static AVBufferRef *alloc_buffer(void *opaque, size_t size);
+
+    // Release the idle buffers of all pools
+    void clear();
+
+    std::mutex mutex_;
+    // Pools ordered from the least to the most recently used
+    std::vector<std::pair<size_t, AVBufferPool *>> pools_;
+    MatAllocator mat_allocator_;
+    int active_jobs_ = 0;
+
+    std::atomic<int64_t> requests_{0};
+    std::atomic<int64_t> misses_{0};
+};
+
+#endif  // FRAME_POOL_H
@@ -0,0 +1,29 @@
+#ifndef FUSED_CONVERSION_H
+#define FUSED_CONVERSION_H
+
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Get the luma weights of red and blue for a YUV color space, defaulting to BT.601
+void get_luma_weights(AVColorSpace colorspace, double &kr, double &kb);
+
+// Check whether convert_bgr24_to_yuv420 can write frames in the given pixel format
+bool is_fused_conversion_supported(AVPixelFormat pix_fmt);
+
+// Convert packed BGR24 pixels into a YUV 4:2:0 frame in a single pass over memory
+// Each 2x2 block is read once and its luma and averaged chroma are written directly to the
+// planes of `dst_frame`, which must already be allocated with the source dimensions.
+// Supports yuv420p, nv12, yuv420p10, and p010; the color space and range select the
+// coefficients, defaulting to BT.601 limited range.
+int convert_bgr24_to_yuv420(
+    const uint8_t *src,
+    int src_linesize,
+    AVFrame *dst_frame,
+    AVColorSpace colorspace,
+    AVColorRange color_range
+);
+
+#endif  // FUSED_CONVERSION_H
@@ -0,0 +1,41 @@
+#ifndef IVTC_H
+#define IVTC_H
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+}
+
+// Inverse telecine stage run on decoded frames before they reach the filters
+// Fields are matched back into progressive frames, frames that remain combed are deinterlaced,
+// and the duplicate frame of each 3:2 pulldown cycle is dropped, turning 29.97 fps telecined
+// video back into 23.976 fps film. Output timestamps stay in the decoder's time base.
+class InverseTelecine {
+   public:
+    // Number of frames kept out of each cycle of decoded frames
+    static constexpr int CYCLE_LENGTH = 5;
+    static constexpr int CYCLE_KEPT = 4;
+
+    InverseTelecine() = default;
+    ~InverseTelecine();
+
+    InverseTelecine(const InverseTelecine &) = delete;
+    InverseTelecine &operator=(const InverseTelecine &) = delete;
+
+    int init(AVCodecContext *dec_ctx);
+
+    // Send a decoded frame, or nullptr once all frames have been sent
+    int send_frame(AVFrame *frame);
+
+    // Receive the next progressive frame; returns AVERROR(EAGAIN) if more input is needed and
+    // AVERROR_EOF once flushed
+    int receive_frame(AVFrame *frame);
+
+   private:
+    AVFilterGraph *filter_graph_ = nullptr;
+    AVFilterContext *buffersrc_ctx_ = nullptr;
+    AVFilterContext *buffersink_ctx_ = nullptr;
+    AVRational in_time_base_ = {0, 1};
+};
+
+#endif  // IVTC_H
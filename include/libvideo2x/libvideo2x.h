@@ -36,6 +36,13 @@ enum FilterType {
     FILTER_REALESRGAN
 };
 
+// Enum to specify what happens to black borders (letterboxing and pillarboxing)
+enum AutoCropMode {
+    AUTOCROP_NONE,
+    AUTOCROP_PAD,
+    AUTOCROP_KEEP
+};
+
 // Enum to specify log level
 enum Libvideo2xLogLevel {
     LIBVIDEO2X_LOG_LEVEL_TRACE,
@@ -70,6 +77,14 @@ struct FilterConfig {
     } config;
 };
 
+// Rectangle of a frame in input pixel coordinates
+struct RoiRect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
 // Encoder configuration
 struct EncoderConfig {
     int out_width;
@@ -80,18 +95,123 @@ struct EncoderConfig {
     const char *preset;
     int64_t bit_rate;
     float crf;
+    // Time range to process in AV_TIME_BASE units; AV_NOPTS_VALUE leaves an end of the range open
+    int64_t start_time;
+    int64_t end_time;
+    // Output frame rate; {0, 0} keeps the input's frame rate
+    AVRational frame_rate;
 };
 
+// Processing pipeline configuration
+struct ProcessingConfig {
+    bool pipelined;
+    int queue_size;
+    int filter_workers;
+    bool adaptive_workers;
+    int segments;
+    double segment_duration;
+    bool resume;
+    int preview_frames;
+    int64_t memory_budget;
+    int prefetch_packets;
+    bool decouple_copied_streams;
+    bool dedup_frames;
+    double dedup_threshold;
+    bool inverse_telecine;
+    // Only the active area is filtered; AUTOCROP_PAD restores the borders in black and
+    // AUTOCROP_KEEP outputs the active area only
+    // The area is detected from the input unless crop_width and crop_height are set.
+    enum AutoCropMode autocrop;
+    int crop_x;
+    int crop_y;
+    int crop_width;
+    int crop_height;
+    // Scenes whose detail score stays at or below route_threshold are upscaled with a bicubic
+    // resampler instead of the RealESRGAN filter
+    // Scenes are taken from analysis_sidecar, or from an analysis pass run before processing.
+    bool route_by_complexity;
+    double route_threshold;
+    // Frames are scaled down by prescale_factor (> 1) before the RealESRGAN filter and the result
+    // is scaled to the usual output size; prescale_auto detects the factor from the input
+    bool prescale_auto;
+    double prescale_factor;
+    // Only tiles overlapping the regions of interest are upscaled with RealESRGAN; the rest of
+    // the frame is upscaled with bicubic scaling
+    // The regions are the static rectangles plus the timed regions of the sidecar file, if any.
+    const struct RoiRect *roi_rects;
+    int roi_rect_count;
+    const CharType *roi_sidecar;
+    // Per-frame features written by analyze_video for the same input file
+    const CharType *analysis_sidecar;
+    // Create a new scaling context for every pixel format conversion of this job's filters and
+    // encoder instead of reusing cached contexts; used to measure the conversion throughput
+    // gained by the cache
+    bool disable_sws_cache;
+    // Convert RealESRGAN output to yuv420p, nv12, yuv420p10, and p010 with a single-pass scalar
+    // conversion instead of swscale
+    bool fused_output_conversion;
+};
+
+// Opaque control channel used to pause, resume, and abort processing
+struct ProcessingControl;
+
 // Video processing context
 struct VideoProcessingContext {
     int64_t processed_frames;
     int64_t total_frames;
     time_t start_time;
-    bool pause;
-    bool abort;
     bool completed;
+    struct ProcessingControl *control;
+    int64_t prefetch_depth;
+    int64_t peak_prefetch_depth;
+};
+
+// Estimated cost of processing a video, extrapolated from a sample of frames
+// Times are in seconds and sizes in bytes; lower and upper bounds form 95% confidence intervals.
+struct ProcessingEstimate {
+    int64_t total_frames;
+    int64_t sampled_frames;
+    double decode_time_per_frame;
+    double filter_time_per_frame;
+    double encode_time_per_frame;
+    double total_time;
+    double total_time_lower;
+    double total_time_upper;
+    double bytes_per_frame;
+    int64_t output_size;
+    int64_t output_size_lower;
+    int64_t output_size_upper;
 };
 
+/**
+ * @brief Create a control channel for pausing, resuming, and aborting processing.
+ *
+ * @return struct ProcessingControl* The new control, or NULL on allocation failure
+ */
+LIBVIDEO2X_API struct ProcessingControl *create_processing_control(void);
+
+/**
+ * @brief Free a control created with create_processing_control.
+ *
+ * @param[in] control Control to free
+ */
+LIBVIDEO2X_API void free_processing_control(struct ProcessingControl *control);
+
+/**
+ * @brief Pause or resume processing.
+ *
+ * @param[in] control Control of the processing to pause or resume
+ * @param[in] paused Whether processing should be paused
+ */
+LIBVIDEO2X_API void set_processing_paused(struct ProcessingControl *control, bool paused);
+
+/**
+ * @brief Request processing to stop as soon as possible.
+ *
+ * @param[in] control Control of the processing to abort
+ */
+LIBVIDEO2X_API void abort_processing(struct ProcessingControl *control);
+
 /**
  * @brief Process a video file using the selected filter and encoder settings.
  *
@@ -103,7 +223,8 @@ struct VideoProcessingContext {
  * @param[in] hw_type Hardware device type
  * @param[in] filter_config Filter configurations
  * @param[in] encoder_config Encoder configurations
- * @param[in,out] proc_ctx Video processing context
+ * @param[in] processing_config Processing pipeline configurations
+ * @param[in,out] proc_ctx Video processing context; `control` must be set
  * @return int 0 on success, non-zero value on error
  */
 LIBVIDEO2X_API int process_video(
@@ -115,6 +236,60 @@ LIBVIDEO2X_API int process_video(
     enum AVHWDeviceType hw_device_type,
     const struct FilterConfig *filter_config,
     struct EncoderConfig *encoder_config,
+    const struct ProcessingConfig *processing_config,
+    struct VideoProcessingContext *proc_ctx
+);
+
+/**
+ * @brief Estimate the time and output size of processing a video without processing all of it.
+ *
+ * A stratified sample of frames is run through the configured filter and encoder, and the
+ * measured per-frame costs are extrapolated to the whole video (or the encoder's time range).
+ * Time estimates assume serial processing.
+ *
+ * @param[in] in_fname Path to the input video file
+ * @param[in] out_fname Path to the output video file; only used to pick the container format
+ * @param[in] log_level Log level
+ * @param[in] vk_device_index Vulkan device index
+ * @param[in] hw_type Hardware device type
+ * @param[in] filter_config Filter configurations
+ * @param[in] encoder_config Encoder configurations
+ * @param[in] num_samples Number of strata to sample frames from
+ * @param[in,out] proc_ctx Video processing context; `control` must be set
+ * @param[out] estimate Estimated processing cost
+ * @return int 0 on success, non-zero value on error
+ */
+LIBVIDEO2X_API int estimate_video(
+    const CharType *in_fname,
+    const CharType *out_fname,
+    enum Libvideo2xLogLevel log_level,
+    uint32_t vk_device_index,
+    enum AVHWDeviceType hw_type,
+    const struct FilterConfig *filter_config,
+    struct EncoderConfig *encoder_config,
+    int num_samples,
+    struct VideoProcessingContext *proc_ctx,
+    struct ProcessingEstimate *estimate
+);
+
+/**
+ * @brief Analyze every frame of a video ahead of processing it.
+ *
+ * The video is decoded at reduced resolution with multiple threads, and the features of each
+ * frame (scene cuts, duplicates, black frames and borders, detail, fades) are written to a
+ * binary sidecar file. Passing the sidecar as `analysis_sidecar` in the processing configuration
+ * lets the processing pass use the features instead of analyzing frames itself.
+ *
+ * @param[in] in_fname Path to the input video file
+ * @param[in] out_fname Path to the sidecar file to write
+ * @param[in] log_level Log level
+ * @param[in,out] proc_ctx Video processing context; `control` must be set
+ * @return int 0 on success, non-zero value on error
+ */
+LIBVIDEO2X_API int analyze_video(
+    const CharType *in_fname,
+    const CharType *out_fname,
+    enum Libvideo2xLogLevel log_level,
     struct VideoProcessingContext *proc_ctx
 );
 
@@ -0,0 +1,67 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Limit on the memory held by frames in flight, shared by all processing threads
+// A thread that would exceed the limit blocks until others release memory. A request is always
+// granted when nothing else is held so that a single oversized frame cannot deadlock processing.
+class MemoryBudget {
+   public:
+    explicit MemoryBudget(int64_t limit) : limit_(limit) {}
+
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    // Block until `bytes` can be held without exceeding the limit, then hold them
+    void acquire(int64_t bytes);
+
+    // Return previously acquired bytes to the budget
+    void release(int64_t bytes);
+
+    int64_t limit() const { return limit_; }
+    int64_t peak_usage() const;
+
+   private:
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    const int64_t limit_;
+    int64_t usage_ = 0;
+    int64_t peak_usage_ = 0;
+};
+
+// The share of a MemoryBudget held by one processing loop
+// Everything still held is returned by release_all() (or on destruction), after which further
+// acquisitions fail; this unblocks producers when a loop stops with frames still queued.
+class MemoryReservation {
+   public:
+    // A null budget makes every operation a no-op
+    explicit MemoryReservation(MemoryBudget *budget) : budget_(budget) {}
+    ~MemoryReservation() { release_all(); }
+
+    MemoryReservation(const MemoryReservation &) = delete;
+    MemoryReservation &operator=(const MemoryReservation &) = delete;
+
+    // Returns false if the reservation has been released in full
+    bool acquire(int64_t bytes);
+    void release(int64_t bytes);
+    void release_all();
+
+   private:
+    MemoryBudget *budget_;
+    std::mutex mutex_;
+    int64_t held_ = 0;
+    bool closed_ = false;
+};
+
+// Estimate the memory needed to carry one decoded frame through filtering and encoding: the
+// decoded frame, the RGB buffers used by the filters, and the output frame
+int64_t estimate_frame_memory(const AVFrame *frame, const AVCodecContext *enc_ctx);
+
+#endif  // MEMORY_BUDGET_H
@@ -0,0 +1,19 @@
+#ifndef NATIVE_RESOLUTION_H
+#define NATIVE_RESOLUTION_H
+
+#include <cstdint>
+#include <filesystem>
+
+// Estimate by how much a video was upscaled before it was encoded from a sample of keyframes
+// spread over [start_pts, end_pts) (video stream time base; AV_NOPTS_VALUE leaves an end open)
+// `factor` is set to the largest downscaling factor that loses no visible detail, or 1 if the
+// video is at its native resolution.
+int detect_native_scale(
+    const std::filesystem::path &in_fpath,
+    int64_t start_pts,
+    int64_t end_pts,
+    int num_samples,
+    double &factor
+);
+
+#endif  // NATIVE_RESOLUTION_H
@@ -0,0 +1,78 @@
+#ifndef PACKET_READER_H
+#define PACKET_READER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "avutils.h"
+
+// Reads packets from an input file, optionally demuxing ahead on a separate thread
+// Prefetched packets are bounded separately for the video stream and the other streams, so a
+// burst of audio cannot use up the room reserved for video. Packets are always returned in demux
+// order. With a capacity of 0, packets are read inline by the caller.
+class PacketReader {
+   public:
+    // Room for the other streams per prefetched video packet; audio usually has several packets
+    // per video frame
+    static constexpr size_t OTHER_PACKETS_PER_VIDEO_PACKET = 4;
+
+    // `capacity` is the number of video packets to prefetch
+    PacketReader(AVFormatContext *ifmt_ctx, int video_stream_index, size_t capacity);
+    ~PacketReader();
+
+    PacketReader(const PacketReader &) = delete;
+    PacketReader &operator=(const PacketReader &) = delete;
+
+    // Start the reader thread if prefetching is enabled
+    int start();
+
+    // Move the next packet into `packet`; returns AVERROR_EOF at the end of the input or the
+    // error that stopped the reader
+    int read_packet(AVPacket *packet);
+
+    // Stop the reader thread and discard prefetched packets
+    void stop();
+
+    // Number of packets currently prefetched
+    size_t depth() const;
+
+    // Largest number of packets prefetched at once
+    size_t peak_depth() const;
+
+    // Log the prefetch depth and the time the caller spent waiting for packets
+    void log_stats() const;
+
+   private:
+    void run();
+    bool is_video(const AVPacket *packet) const;
+
+    AVFormatContext *ifmt_ctx_;
+    int video_stream_index_;
+    size_t video_capacity_;
+    size_t other_capacity_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<AVPacketPtr> packets_;
+    size_t video_packets_ = 0;
+    size_t other_packets_ = 0;
+    size_t peak_video_packets_ = 0;
+    size_t peak_other_packets_ = 0;
+    size_t peak_packets_ = 0;
+    int read_ret_ = 0;
+    bool finished_ = false;
+    bool stopped_ = false;
+    std::chrono::steady_clock::duration wait_time_{0};
+    std::thread thread_;
+};
+
+#endif  // PACKET_READER_H
@@ -0,0 +1,30 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <memory>
+#include <vector>
+
+#include "decoder.h"
+#include "encoder.h"
+#include "filter.h"
+#include "libvideo2x.h"
+#include "memory_budget.h"
+#include "progress_counters.h"
+
+// Process frames with decoding, filtering, and encoding running concurrently on separate threads
+// Each filter instance runs on its own worker thread; outputs are written in decoding order.
+// Frames in flight are limited by `memory_budget` if it is not null. Progress is also published to
+// `progress` if it is not null.
+int process_frames_pipelined(
+    EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    Encoder &encoder,
+    std::vector<std::unique_ptr<Filter>> &filters,
+    MemoryBudget *memory_budget,
+    bool benchmark = false,
+    ProgressCounters *progress = nullptr
+);
+
+#endif  // PIPELINE_H
@@ -0,0 +1,50 @@
+#ifndef PRESCALE_FILTER_H
+#define PRESCALE_FILTER_H
+
+#include <memory>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include "filter.h"
+
+// Filter stage that scales frames down to the source's native resolution before the wrapped
+// filter and scales the result to the size the filter would have produced from the full frames
+// Inference on an upscaled master costs the square of the factor more than on its native
+// resolution without recovering more detail.
+class PrescaleFilter : public Filter {
+   public:
+    // `scaling_factor` is the wrapped filter's scaling factor; `factor` is the downscaling factor
+    // Unless `reuse_sws_contexts` is set, every scaling creates a new scaling context.
+    PrescaleFilter(
+        std::unique_ptr<Filter> filter,
+        int scaling_factor,
+        double factor,
+        bool reuse_sws_contexts = true
+    );
+    ~PrescaleFilter() override;
+
+    int init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) override;
+    int process_frame(AVFrame *in_frame, AVFrame **out_frame) override;
+    int flush(std::vector<AVFrame *> &flushed_frames) override;
+    void set_processing_control(ProcessingControl *control) override;
+
+   private:
+    // Scale a filtered frame to the output size; takes ownership of the frame
+    int restore_frame(AVFrame *frame, AVFrame **out_frame);
+
+    std::unique_ptr<Filter> filter_;
+    int scaling_factor_;
+    double factor_;
+    bool reuse_sws_contexts_;
+
+    // Decoder context describing the downscaled frames passed to the wrapped filter
+    AVCodecContext *reduced_ctx_ = nullptr;
+
+    int out_width_ = 0;
+    int out_height_ = 0;
+};
+
+#endif  // PRESCALE_FILTER_H
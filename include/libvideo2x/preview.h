@@ -0,0 +1,25 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <cstdint>
+
+#include "decoder.h"
+#include "encoder.h"
+#include "filter.h"
+#include "libvideo2x.h"
+
+// Filter the keyframes closest to `num_frames` evenly spaced points in [start_pts, end_pts) and
+// write them as a short clip in which each sampled frame is shown for one second
+// Only the sampled frames are decoded; the decoder seeks between them.
+int process_frames_preview(
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    Encoder &encoder,
+    Filter *filter,
+    int num_frames,
+    int64_t start_pts,
+    int64_t end_pts,
+    bool benchmark = false
+);
+
+#endif  // PREVIEW_H
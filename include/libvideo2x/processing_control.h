@@ -0,0 +1,39 @@
+#ifndef PROCESSING_CONTROL_H
+#define PROCESSING_CONTROL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Control channel used to pause, resume, and abort video processing
+// Processing threads block on a condition variable while paused instead of polling, and long
+// operations within a frame (e.g., tile loops) check for an abort between steps.
+// Declared as a struct to match its forward declaration in the C API.
+struct ProcessingControl {
+   public:
+    ProcessingControl() = default;
+
+    ProcessingControl(const ProcessingControl &) = delete;
+    ProcessingControl &operator=(const ProcessingControl &) = delete;
+
+    // Pause or resume processing
+    void set_paused(bool paused);
+
+    // Request processing to stop; wakes up all paused threads
+    void abort();
+
+    bool is_paused() const { return paused_.load(); }
+    bool is_aborted() const { return aborted_.load(); }
+
+    // Block while processing is paused
+    // Returns false if processing has been aborted, true otherwise.
+    bool wait_if_paused();
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable state_changed_;
+    std::atomic<bool> paused_{false};
+    std::atomic<bool> aborted_{false};
+};
+
+#endif  // PROCESSING_CONTROL_H
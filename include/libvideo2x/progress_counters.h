@@ -0,0 +1,16 @@
+#ifndef PROGRESS_COUNTERS_H
+#define PROGRESS_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+
+// Progress of a processing context that other threads can read while it is being processed
+// The fields of VideoProcessingContext are plain integers, so the threads processing a job
+// mirror them here for a thread aggregating the progress of concurrent jobs.
+struct ProgressCounters {
+    std::atomic<int64_t> processed_frames{0};
+    std::atomic<int64_t> prefetch_depth{0};
+    std::atomic<int64_t> peak_prefetch_depth{0};
+};
+
+#endif  // PROGRESS_COUNTERS_H
@@ -1,13 +1,20 @@
 #ifndef REALSRGAN_FILTER_H
 #define REALSRGAN_FILTER_H
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 extern "C" {
 #include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
 }
 
 #include "char_defs.h"
 #include "filter.h"
 #include "realesrgan.h"
+#include "roi_map.h"
+#include "yuv_to_bgr.h"
 
 // RealesrganFilter class definition
 class RealesrganFilter : public Filter {
@@ -21,6 +28,43 @@ class RealesrganFilter : public Filter {
     AVRational out_time_base;
     AVPixelFormat out_pix_fmt;
 
+    // Whether pixel format conversions reuse cached scaling contexts
+    bool reuse_sws_contexts;
+
+    // Whether output frames are converted without swscale when the format allows it
+    bool fused_output_conversion;
+
+    // Frames and tiles that were filled with a solid color instead of being upscaled
+    int64_t total_frames;
+    int64_t flat_frames;
+    int64_t total_tiles;
+    int64_t flat_tiles;
+
+    // Regions of interest; tiles outside them keep a bicubic upscale of the frame
+    std::shared_ptr<const RoiMap> roi_map;
+    int64_t roi_start_pts;
+    std::vector<RoiRect> regions;
+    int64_t bicubic_tiles;
+
+    // Kernel converting YUV 4:2:0 frames straight into the network input, checked against
+    // swscale on the first such frame
+    YuvToBgrKernel yuv_kernel;
+    bool direct_input;
+    bool direct_input_checked;
+
+    // Checks whether a frame can be converted with the YUV to BGR kernel instead of swscale
+    bool use_direct_input(const AVFrame *frame);
+
+    // Upscales the image, tile by tile if tiles are skipped, returning AVERROR_EXIT if processing
+    // is aborted
+    // If `tile_regions` is not null, only tiles overlapping a region are upscaled; `out_mat` must
+    // already hold an upscaled frame for the other tiles.
+    int process_tiles(
+        const ncnn::Mat &in_mat,
+        ncnn::Mat &out_mat,
+        const std::vector<RoiRect> *tile_regions
+    );
+
    public:
     // Constructor
     RealesrganFilter(
@@ -36,8 +80,21 @@ class RealesrganFilter : public Filter {
     // Initializes the filter with decoder and encoder contexts
     int init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) override;
 
+    // Restricts inference to the regions of interest of each frame
+    // `start_pts` is the start time of the input stream, from which the times of the map count.
+    void set_roi_map(std::shared_ptr<const RoiMap> map, int64_t start_pts);
+
+    // Creates a new scaling context for every pixel format conversion unless `reuse` is set
+    void set_reuse_sws_contexts(bool reuse);
+
+    // Converts output frames with convert_bgr24_to_yuv420 instead of swscale if `fused` is set
+    void set_fused_output_conversion(bool fused);
+
     // Processes an input frame and returns the processed frame
     int process_frame(AVFrame *in_frame, AVFrame **out_frame) override;
+
+    // Reports how many frames and tiles took the solid color fast path
+    int flush(std::vector<AVFrame *> &flushed_frames) override;
 };
 
 #endif
@@ -0,0 +1,114 @@
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+// Thread-safe buffer that accepts items tagged with sequence numbers in any order and releases
+// them strictly in sequence order
+// Producers block while their sequence number is more than `capacity` ahead of the next item to
+// be released, which bounds the number of out-of-order items held at any time. An item that
+// evaluates to false (e.g., an empty std::unique_ptr) marks its sequence number as skipped.
+template <typename T>
+class ReorderBuffer {
+   public:
+    explicit ReorderBuffer(size_t capacity) : capacity_(capacity > 0 ? capacity : 1) {}
+
+    ReorderBuffer(const ReorderBuffer &) = delete;
+    ReorderBuffer &operator=(const ReorderBuffer &) = delete;
+
+    // Insert the item with the given sequence number
+    // Returns false if the buffer has been cancelled, in which case the item is discarded
+    bool put(int64_t seq, T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this, seq] {
+            return cancelled_ || seq < next_seq_ + static_cast<int64_t>(capacity_);
+        });
+        if (cancelled_) {
+            return false;
+        }
+        items_.emplace(seq, std::move(item));
+        lock.unlock();
+        ready_.notify_all();
+        return true;
+    }
+
+    // Retrieve the next item in sequence order, blocking until it is available
+    // Returns false once the buffer has been closed and drained, or has been cancelled
+    bool get(T &item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            ready_.wait(lock, [this] {
+                return cancelled_ || closed_ || items_.count(next_seq_) > 0;
+            });
+            if (cancelled_) {
+                return false;
+            }
+
+            auto it = items_.find(next_seq_);
+            if (it == items_.end()) {
+                // Closed and the next item will never arrive
+                return false;
+            }
+
+            T next_item = std::move(it->second);
+            items_.erase(it);
+            next_seq_++;
+            not_full_.notify_all();
+
+            // Skip sequence numbers that produced no output
+            if (next_item) {
+                item = std::move(next_item);
+                return true;
+            }
+        }
+    }
+
+    // Signal that all sequence numbers have been put; consumers may still drain the buffer
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        ready_.notify_all();
+    }
+
+    // Stop the buffer and discard all held items
+    void cancel() {
+        std::map<int64_t, T> discarded;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cancelled_ = true;
+            discarded.swap(items_);
+        }
+        not_full_.notify_all();
+        ready_.notify_all();
+    }
+
+    bool is_cancelled() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cancelled_;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+    size_t capacity() const { return capacity_; }
+
+   private:
+    mutable std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable ready_;
+    std::map<int64_t, T> items_;
+    size_t capacity_;
+    int64_t next_seq_ = 0;
+    bool closed_ = false;
+    bool cancelled_ = false;
+};
+
+#endif  // REORDER_BUFFER_H
@@ -0,0 +1,39 @@
+#ifndef ROI_MAP_H
+#define ROI_MAP_H
+
+#include <filesystem>
+#include <vector>
+
+#include "libvideo2x.h"
+
+// Regions of interest of the frames of a video, in input pixel coordinates
+// Static regions apply to every frame. A sidecar file adds timed regions, one per line:
+//   <time in seconds> <x> <y> <width> <height>
+// Lines with the same time are combined, and a line with only a time clears the timed regions.
+// Each set of timed regions applies from its time until the next time in the file. Times are
+// measured from the start of the video stream, so the first frame is at 0 even if the stream's
+// timestamps start later.
+class RoiMap {
+   public:
+    RoiMap() = default;
+
+    void add_static_region(const RoiRect &rect);
+
+    // Load timed regions from a sidecar file
+    int load_sidecar(const std::filesystem::path &fpath);
+
+    // Get the regions of the frame at the given time in seconds
+    void get_regions(double time, std::vector<RoiRect> &regions) const;
+
+   private:
+    struct TimedRegions {
+        double time;
+        std::vector<RoiRect> rects;
+    };
+
+    std::vector<RoiRect> static_regions_;
+    // Sorted by time
+    std::vector<TimedRegions> timed_regions_;
+};
+
+#endif  // ROI_MAP_H
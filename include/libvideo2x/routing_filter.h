@@ -0,0 +1,68 @@
+#ifndef ROUTING_FILTER_H
+#define ROUTING_FILTER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include "filter.h"
+#include "video_analysis.h"
+
+// Filter stage that sends scenes with little detail to a bicubic resampler instead of the
+// wrapped filter
+// Scenes are found from the cuts of an analysis pass and routed as a whole: a scene goes to the
+// filter if any of its frames scores above the threshold, so the output does not switch between
+// the paths within a scene. The route only depends on the frame's timestamp, so any number of
+// workers can share the frames.
+class RoutingFilter : public Filter {
+   public:
+    // `scaling_factor` is the wrapped filter's scaling factor, which the resampler matches
+    // Unless `reuse_sws_contexts` is set, every resampling creates a new scaling context.
+    RoutingFilter(
+        std::unique_ptr<Filter> filter,
+        int scaling_factor,
+        double threshold,
+        const VideoAnalysis &analysis,
+        bool reuse_sws_contexts = true
+    );
+
+    int init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) override;
+    int process_frame(AVFrame *in_frame, AVFrame **out_frame) override;
+    int flush(std::vector<AVFrame *> &flushed_frames) override;
+    void set_processing_control(ProcessingControl *control) override;
+
+   private:
+    // A scene and whether its frames go to the wrapped filter
+    struct RoutedScene {
+        int64_t start_pts;
+        bool filter;
+    };
+
+    // Decide whether a frame needs the wrapped filter; frames outside the analysis always do
+    bool needs_filter(const AVFrame *in_frame) const;
+
+    int resample_frame(AVFrame *in_frame, AVFrame **out_frame);
+
+    std::unique_ptr<Filter> filter_;
+    int scaling_factor_;
+    double threshold_;
+    bool reuse_sws_contexts_;
+    AVRational in_time_base_;
+    AVRational out_time_base_;
+    AVPixelFormat out_pix_fmt_;
+
+    // Sorted by timestamp
+    std::vector<RoutedScene> scenes_;
+
+    int64_t filtered_frames_ = 0;
+    int64_t resampled_frames_ = 0;
+    double filter_time_ = 0;
+    double resample_time_ = 0;
+};
+
+#endif  // ROUTING_FILTER_H
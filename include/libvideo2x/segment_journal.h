@@ -0,0 +1,60 @@
+#ifndef SEGMENT_JOURNAL_H
+#define SEGMENT_JOURNAL_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "segments.h"
+
+// Get the path of the checkpoint journal kept next to the output file
+std::filesystem::path get_segment_journal_path(const std::filesystem::path &out_fpath);
+
+// Checkpoint journal recording how the input was split into segments and which segments have
+// been fully written to their intermediate files
+// An interrupted job can be resumed by loading the journal and reprocessing only the segments
+// that were not completed. The journal records the input file and a description of the
+// processing settings, and is only resumed when both match.
+class SegmentJournal {
+   public:
+    SegmentJournal() = default;
+
+    SegmentJournal(const SegmentJournal &) = delete;
+    SegmentJournal &operator=(const SegmentJournal &) = delete;
+
+    // Create a new journal for the given segments, replacing any existing journal
+    // `settings` is a single line describing the settings that determine the segment files.
+    int create(
+        const std::filesystem::path &fpath,
+        const std::filesystem::path &in_fpath,
+        const std::string &settings,
+        const std::vector<Segment> &segments
+    );
+
+    // Load an existing journal created for the same input file and settings
+    // `completed_frames` receives the number of frames of each completed segment, or -1 for
+    // segments that still have to be processed.
+    int load(
+        const std::filesystem::path &fpath,
+        const std::filesystem::path &in_fpath,
+        const std::string &settings,
+        std::vector<Segment> &segments,
+        std::vector<int64_t> &completed_frames
+    );
+
+    // Record that a segment has been completed; safe to call from multiple threads
+    int mark_completed(size_t index, int64_t processed_frames);
+
+    // Close and delete the journal file
+    void remove();
+
+   private:
+    std::mutex mutex_;
+    std::ofstream file_;
+    std::filesystem::path fpath_;
+};
+
+#endif  // SEGMENT_JOURNAL_H
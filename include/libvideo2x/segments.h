@@ -0,0 +1,51 @@
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "libvideo2x.h"
+
+// A keyframe-aligned range [start_pts, end_pts) of the input video stream and the file its
+// encoded frames are written to
+// AV_NOPTS_VALUE leaves the corresponding end of the range open.
+struct Segment {
+    int64_t start_pts;
+    int64_t end_pts;
+    std::filesystem::path fpath;
+};
+
+// Scan the input video stream for keyframes and split the range [start_pts, end_pts) into up to
+// `num_segments` segments of roughly equal duration, each starting on a keyframe
+// If `segment_duration` (in seconds) is positive, the number of segments is instead chosen so
+// that each segment lasts about that long.
+int split_segments(
+    const std::filesystem::path &in_fpath,
+    int in_vstream_idx,
+    int64_t start_pts,
+    int64_t end_pts,
+    int num_segments,
+    double segment_duration,
+    const std::filesystem::path &out_fpath,
+    std::vector<Segment> &segments
+);
+
+// Concatenate the encoded segments into the output file without re-encoding and mux the input's
+// audio and subtitle streams within the encoder's time range alongside them if `copy_streams` is
+// set
+int stitch_segments(
+    const std::vector<Segment> &segments,
+    const std::filesystem::path &in_fpath,
+    const std::filesystem::path &out_fpath,
+    const EncoderConfig *encoder_config
+);
+
+// Delete the intermediate segment files
+void remove_segment_files(const std::vector<Segment> &segments);
+
+#endif  // SEGMENTS_H
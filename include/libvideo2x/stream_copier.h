@@ -0,0 +1,73 @@
+#ifndef STREAM_COPIER_H
+#define STREAM_COPIER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "avutils.h"
+
+class Encoder;
+
+// Copies the audio and subtitle streams into the output from a second demuxer on its own thread
+// Each copied packet is written once the video written so far has reached its timestamp, so the
+// muxer's interleaving queues only ever hold a small lag of packets. The copier never blocks the
+// video path; it only holds the one packet it is waiting to write.
+class StreamCopier {
+   public:
+    explicit StreamCopier(Encoder &encoder);
+    ~StreamCopier();
+
+    StreamCopier(const StreamCopier &) = delete;
+    StreamCopier &operator=(const StreamCopier &) = delete;
+
+    // Open the input and seek to the start of the time range (AV_TIME_BASE units)
+    int init(
+        const std::filesystem::path &in_fpath,
+        int in_vstream_idx,
+        int64_t start_time,
+        int64_t end_time
+    );
+
+    // Start copying packets; the output header must have been written
+    int start();
+
+    // Report the time (AV_TIME_BASE units from the start of the output) of the last video packet
+    // written
+    void advance(int64_t video_time);
+
+    // Copy the remaining packets once all video has been written and wait for the copier
+    int finish();
+
+    // Stop copying and discard the remaining packets
+    void stop();
+
+   private:
+    void run();
+    int copy_packets();
+
+    // Time of a packet relative to the start of the output
+    int64_t get_output_time(const AVPacket *packet) const;
+
+    Encoder &encoder_;
+    AVInputFormatContextPtr ifmt_ctx_;
+    int in_vstream_idx_ = -1;
+    int64_t start_time_ = AV_NOPTS_VALUE;
+    int64_t end_time_ = AV_NOPTS_VALUE;
+
+    std::mutex mutex_;
+    std::condition_variable advanced_;
+    int64_t video_time_ = AV_NOPTS_VALUE;
+    bool video_finished_ = false;
+    bool stopped_ = false;
+    int ret_ = 0;
+    std::thread thread_;
+};
+
+#endif  // STREAM_COPIER_H
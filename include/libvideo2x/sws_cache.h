@@ -0,0 +1,120 @@
+#ifndef SWS_CACHE_H
+#define SWS_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+// Parameters that identify a scaling context
+// The color space and range select the YUV<->RGB coefficients and are applied to both the
+// source and the destination, so contexts converting different matrices are never shared.
+struct SwsContextKey {
+    int src_width;
+    int src_height;
+    AVPixelFormat src_pix_fmt;
+    int dst_width;
+    int dst_height;
+    AVPixelFormat dst_pix_fmt;
+    int flags;
+    AVColorSpace colorspace;
+    AVColorRange color_range;
+
+    bool operator==(const SwsContextKey &other) const;
+};
+
+// Process-wide cache of scaling contexts reused across frames
+// A context can only be used by one thread at a time, so each conversion leases an idle context
+// with matching parameters and returns it when done; concurrent workers converting the same
+// formats each get their own context. The cache is shared by concurrent jobs, which register
+// with begin_job and end_job so that idle contexts are only freed once no job is running.
+class SwsContextCache {
+   public:
+    // Counters used to measure conversion throughput; they only ever increase
+    struct Stats {
+        int64_t hits;
+        int64_t misses;
+        int64_t conversions;
+        int64_t conversion_ns;
+    };
+
+    // Exclusive use of a scaling context, returned to the cache on destruction
+    class Lease {
+       public:
+        Lease() = default;
+        Lease(Lease &&other) noexcept;
+        Lease &operator=(Lease &&other) noexcept;
+        ~Lease();
+
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        SwsContext *get() const { return sws_ctx_; }
+        explicit operator bool() const { return sws_ctx_ != nullptr; }
+
+       private:
+        friend class SwsContextCache;
+
+        void release();
+
+        SwsContextCache *cache_ = nullptr;
+        SwsContextKey key_{};
+        SwsContext *sws_ctx_ = nullptr;
+        bool reuse_ = true;
+        std::chrono::steady_clock::time_point start_time_;
+    };
+
+    static SwsContextCache &get_instance();
+
+    SwsContextCache(const SwsContextCache &) = delete;
+    SwsContextCache &operator=(const SwsContextCache &) = delete;
+
+    // Lease a context for the given parameters; the lease is empty if creating it failed
+    // Unless `reuse` is set, a new context is created and freed when the lease is released.
+    Lease acquire(const SwsContextKey &key, bool reuse = true);
+
+    // Lease a context converting `src_frame` to the given dimensions and pixel format
+    Lease acquire(
+        const AVFrame *src_frame,
+        int dst_width,
+        int dst_height,
+        AVPixelFormat dst_pix_fmt,
+        int flags,
+        bool reuse = true
+    );
+
+    // Register a job using the cache; the idle contexts are freed when the last job ends
+    void begin_job();
+    void end_job();
+
+    Stats get_stats();
+
+    // Log the conversions since `since` was taken with get_stats
+    void log_stats(const Stats &since);
+
+   private:
+    SwsContextCache() = default;
+    ~SwsContextCache();
+
+    void release(const SwsContextKey &key, SwsContext *sws_ctx, bool reuse, int64_t elapsed_ns);
+
+    // Free all idle contexts
+    void clear();
+
+    std::mutex mutex_;
+    std::vector<std::pair<SwsContextKey, SwsContext *>> idle_contexts_;
+    int active_jobs_ = 0;
+
+    int64_t hits_ = 0;
+    int64_t misses_ = 0;
+    int64_t conversions_ = 0;
+    int64_t conversion_ns_ = 0;
+};
+
+#endif  // SWS_CACHE_H
@@ -0,0 +1,70 @@
+#ifndef VIDEO_ANALYSIS_H
+#define VIDEO_ANALYSIS_H
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "libvideo2x.h"
+
+// Frame flags determined by the analysis pass
+enum FrameFeatureFlags : uint8_t {
+    FRAME_SCENE_CUT = 1 << 0,
+    // The frame's downscaled luma is identical to the previous frame's
+    FRAME_DUPLICATE = 1 << 1,
+    FRAME_BLACK = 1 << 2,
+    // The brightness changes uniformly, without motion
+    FRAME_FADE = 1 << 3,
+};
+
+// Features of a decoded frame, measured on its downscaled luma
+// Luma measures are on an 8-bit scale; the active area is in input pixel coordinates and empty
+// for black frames.
+struct FrameFeatures {
+    int64_t pts;
+    uint64_t hash;
+    float brightness;
+    float edges;
+    float deviation;
+    float motion;
+    uint16_t active_x;
+    uint16_t active_y;
+    uint16_t active_width;
+    uint16_t active_height;
+    uint8_t flags;
+};
+
+// Decode the video at reduced resolution and write the features of every frame to a sidecar
+int analyze_video_frames(
+    const std::filesystem::path &in_fpath,
+    const std::filesystem::path &sidecar_fpath,
+    VideoProcessingContext *proc_ctx
+);
+
+// Features of all frames of a video, loaded from an analysis sidecar
+class VideoAnalysis {
+   public:
+    VideoAnalysis() = default;
+
+    // Decode the video at reduced resolution and measure the features of every frame
+    // The features are incomplete if processing is aborted.
+    int analyze(const std::filesystem::path &in_fpath, VideoProcessingContext *proc_ctx);
+
+    // Load a sidecar written for the given input file
+    int load(const std::filesystem::path &fpath, const std::filesystem::path &in_fpath);
+
+    // Get the features of the frame with the given timestamp, or null if it was not analyzed
+    const FrameFeatures *find(int64_t pts) const;
+
+    const std::vector<FrameFeatures> &frames() const { return frames_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+   private:
+    int width_ = 0;
+    int height_ = 0;
+    // Sorted by timestamp
+    std::vector<FrameFeatures> frames_;
+};
+
+#endif  // VIDEO_ANALYSIS_H
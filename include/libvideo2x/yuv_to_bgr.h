@@ -0,0 +1,45 @@
+#ifndef YUV_TO_BGR_H
+#define YUV_TO_BGR_H
+
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Implementations of convert_yuv420_to_bgr24; all of them produce identical output
+enum YuvToBgrKernel {
+    YUV_TO_BGR_SCALAR,
+    YUV_TO_BGR_SSE41,
+    YUV_TO_BGR_AVX2,
+};
+
+// Get the fastest kernel supported by the CPU, honoring the FFmpeg CPU flags
+YuvToBgrKernel get_yuv_to_bgr_kernel();
+
+const char *get_yuv_to_bgr_kernel_name(YuvToBgrKernel kernel);
+
+// Check whether convert_yuv420_to_bgr24 can read frames in the given pixel format
+bool is_yuv_to_bgr_supported(AVPixelFormat pix_fmt);
+
+// Convert a yuv420p, nv12, or p010 frame into packed BGR24 pixels in a single pass
+// Chroma is replicated over each 2x2 block like the unscaled swscale converter, and the color
+// space and range of the frame select the coefficients.
+int convert_yuv420_to_bgr24(
+    const AVFrame *src_frame,
+    uint8_t *dst,
+    int dst_linesize,
+    YuvToBgrKernel kernel
+);
+
+// Check a kernel on a frame before relying on it
+// The output must match the scalar kernel bit for bit; `mean_diff` and `max_diff` receive the
+// difference from converting the frame with swscale.
+int check_yuv_to_bgr_kernel(
+    const AVFrame *frame,
+    YuvToBgrKernel kernel,
+    double &mean_diff,
+    int &max_diff
+);
+
+#endif  // YUV_TO_BGR_H
@@ -0,0 +1,251 @@
+#include "autocrop.h"
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/mathematics.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "avutils.h"
+#include "decoder.h"
+#include "video_analysis.h"
+
+// Highest mean luma of a row or column that counts as black (8-bit scale)
+static constexpr int BLACK_LEVEL = 24;
+
+// Cropping less than this share of the frame is not worth it
+static constexpr double MIN_CROPPED_AREA = 0.05;
+
+// Mean of `count` luma samples spaced `stride` samples apart
+template <typename T>
+static int mean_luma(const uint8_t *data, ptrdiff_t stride_bytes, int count) {
+    int64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += *reinterpret_cast<const T *>(data + i * stride_bytes);
+    }
+    return count > 0 ? static_cast<int>(sum / count) : 0;
+}
+
+bool find_active_area(const AVFrame *frame, CropRect &area) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    if (desc == nullptr || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_RGB))) {
+        return false;
+    }
+
+    int depth = desc->comp[0].depth;
+    int black_level = BLACK_LEVEL << std::max(depth - 8, 0);
+    ptrdiff_t sample_size = depth > 8 ? 2 : 1;
+    const uint8_t *luma = frame->data[0];
+    ptrdiff_t linesize = frame->linesize[0];
+
+    auto row_mean = [&](int y) {
+        const uint8_t *row = luma + y * linesize;
+        return sample_size == 2 ? mean_luma<uint16_t>(row, 2, frame->width)
+                                : mean_luma<uint8_t>(row, 1, frame->width);
+    };
+    auto column_mean = [&](int x, int top, int bottom) {
+        const uint8_t *column = luma + top * linesize + x * sample_size;
+        return sample_size == 2 ? mean_luma<uint16_t>(column, linesize, bottom - top)
+                                : mean_luma<uint8_t>(column, linesize, bottom - top);
+    };
+
+    int top = 0;
+    while (top < frame->height && row_mean(top) <= black_level) {
+        top++;
+    }
+    if (top == frame->height) {
+        return false;
+    }
+    int bottom = frame->height;
+    while (bottom > top && row_mean(bottom - 1) <= black_level) {
+        bottom--;
+    }
+
+    int left = 0;
+    while (left < frame->width && column_mean(left, top, bottom) <= black_level) {
+        left++;
+    }
+    int right = frame->width;
+    while (right > left && column_mean(right - 1, top, bottom) <= black_level) {
+        right--;
+    }
+
+    area = {left, top, right - left, bottom - top};
+    return true;
+}
+
+void align_crop(CropRect &crop, int width, int height, AVPixelFormat pix_fmt) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    int align_x = 1 << std::max<int>(desc ? desc->log2_chroma_w : 1, 1);
+    int align_y = 1 << std::max<int>(desc ? desc->log2_chroma_h : 1, 1);
+    int left = crop.x - crop.x % align_x;
+    int top = crop.y - crop.y % align_y;
+    int right = std::min((crop.x + crop.width + align_x - 1) / align_x * align_x, width);
+    int bottom = std::min((crop.y + crop.height + align_y - 1) / align_y * align_y, height);
+    crop = {left, top, right - left, bottom - top};
+}
+
+// Align the union of the active areas and decide whether it is worth cropping
+static int finish_crop(
+    int left,
+    int top,
+    int right,
+    int bottom,
+    int width,
+    int height,
+    AVPixelFormat pix_fmt,
+    CropRect &crop
+) {
+    CropRect active = {left, top, right - left, bottom - top};
+    align_crop(active, width, height, pix_fmt);
+
+    int64_t frame_area = static_cast<int64_t>(width) * height;
+    int64_t active_area = static_cast<int64_t>(active.width) * active.height;
+    if (static_cast<double>(frame_area - active_area) <
+        MIN_CROPPED_AREA * static_cast<double>(frame_area)) {
+        spdlog::info("No black borders worth cropping were found");
+        return 0;
+    }
+
+    crop = active;
+    spdlog::info(
+        "Detected black borders; active area {}x{} at ({}, {}) of {}x{}",
+        crop.width,
+        crop.height,
+        crop.x,
+        crop.y,
+        width,
+        height
+    );
+    return 0;
+}
+
+int detect_crop(
+    const std::filesystem::path &in_fpath,
+    int64_t start_pts,
+    int64_t end_pts,
+    int num_samples,
+    CropRect &crop
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+
+    // Decode in software so that the pixels can be inspected
+    Decoder decoder;
+    int ret = decoder.init(AV_HWDEVICE_TYPE_NONE, nullptr, in_fpath);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::error("Failed to initialize decoder: {}", errbuf);
+        return ret;
+    }
+
+    AVCodecContext *dec_ctx = decoder.get_codec_context();
+    crop = {0, 0, dec_ctx->width, dec_ctx->height};
+
+    ret = resolve_stream_range(
+        decoder.get_format_context(), decoder.get_video_stream_index(), start_pts, end_pts
+    );
+    if (ret < 0) {
+        spdlog::error("Unable to determine the range to sample from");
+        return ret;
+    }
+
+    AVFramePtr frame(av_frame_alloc());
+    if (!frame) {
+        spdlog::error("Could not allocate AVFrame");
+        return AVERROR(ENOMEM);
+    }
+
+    // The active area is the union of the samples' active areas, so that borders that are
+    // only black in some scenes are kept
+    int left = dec_ctx->width, top = dec_ctx->height, right = 0, bottom = 0;
+    int measured_samples = 0;
+    for (int i = 0; i < num_samples; i++) {
+        int64_t target_pts =
+            start_pts + av_rescale(end_pts - start_pts, 2 * i + 1, 2 * num_samples);
+        ret = decoder.seek_to_keyframe(target_pts);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Error seeking to crop sample {}: {}", i + 1, errbuf);
+            return ret;
+        }
+
+        ret = decoder.decode_next_frame(frame.get());
+        if (ret == AVERROR_EOF) {
+            continue;
+        } else if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Error decoding video frame: {}", errbuf);
+            return ret;
+        }
+
+        // Fades to black say nothing about the borders
+        CropRect area;
+        if (find_active_area(frame.get(), area)) {
+            left = std::min(left, area.x);
+            top = std::min(top, area.y);
+            right = std::max(right, area.x + area.width);
+            bottom = std::max(bottom, area.y + area.height);
+            measured_samples++;
+        }
+        av_frame_unref(frame.get());
+    }
+
+    if (measured_samples == 0) {
+        spdlog::warn("No frames suitable for border detection; not cropping");
+        return 0;
+    }
+
+    return finish_crop(
+        left, top, right, bottom, dec_ctx->width, dec_ctx->height, dec_ctx->pix_fmt, crop
+    );
+}
+
+int detect_crop_from_analysis(
+    const VideoAnalysis &analysis,
+    int64_t start_pts,
+    int64_t end_pts,
+    AVPixelFormat pix_fmt,
+    CropRect &crop
+) {
+    int width = analysis.width();
+    int height = analysis.height();
+    crop = {0, 0, width, height};
+
+    int left = width, top = height, right = 0, bottom = 0;
+    int64_t measured_frames = 0;
+    for (const FrameFeatures &features : analysis.frames()) {
+        if ((start_pts != AV_NOPTS_VALUE && features.pts < start_pts) ||
+            (end_pts != AV_NOPTS_VALUE && features.pts >= end_pts) ||
+            (features.flags & FRAME_BLACK)) {
+            continue;
+        }
+        left = std::min<int>(left, features.active_x);
+        top = std::min<int>(top, features.active_y);
+        right = std::max<int>(right, features.active_x + features.active_width);
+        bottom = std::max<int>(bottom, features.active_y + features.active_height);
+        measured_frames++;
+    }
+
+    if (measured_frames == 0) {
+        spdlog::warn("No frames suitable for border detection; not cropping");
+        return 0;
+    }
+    return finish_crop(left, top, right, bottom, width, height, pix_fmt, crop);
+}
+
+void get_cropped_output_size(
+    const CropRect &crop,
+    int in_width,
+    int in_height,
+    int out_width,
+    int out_height,
+    int &cropped_width,
+    int &cropped_height
+) {
+    // Round to even dimensions for the encoder
+    cropped_width = static_cast<int>(av_rescale(crop.width, out_width, in_width)) & ~1;
+    cropped_height = static_cast<int>(av_rescale(crop.height, out_height, in_height)) & ~1;
+}
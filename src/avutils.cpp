@@ -54,6 +54,79 @@ int64_t get_video_frame_count(AVFormatContext *ifmt_ctx, int in_vstream_idx) {
     return static_cast<int64_t>(duration_secs * fps);
 }
 
+int open_input_file(const std::filesystem::path &fpath, AVInputFormatContextPtr &fmt_ctx) {
+    AVFormatContext *raw_fmt_ctx = nullptr;
+    int ret = avformat_open_input(&raw_fmt_ctx, fpath.u8string().c_str(), nullptr, nullptr);
+    if (ret < 0) {
+        spdlog::error("Could not open input file '{}'", fpath.u8string());
+        return ret;
+    }
+    fmt_ctx.reset(raw_fmt_ctx);
+
+    ret = avformat_find_stream_info(fmt_ctx.get(), nullptr);
+    if (ret < 0) {
+        spdlog::error("Failed to retrieve stream information of '{}'", fpath.u8string());
+        return ret;
+    }
+    return 0;
+}
+
+int64_t time_to_stream_pts(AVFormatContext *fmt_ctx, int stream_idx, int64_t time) {
+    int64_t file_start_time = fmt_ctx->start_time != AV_NOPTS_VALUE ? fmt_ctx->start_time : 0;
+    return av_rescale_q(
+        file_start_time + time,
+        AVRational{1, AV_TIME_BASE},
+        fmt_ctx->streams[stream_idx]->time_base
+    );
+}
+
+int resolve_stream_range(
+    AVFormatContext *fmt_ctx,
+    int stream_idx,
+    int64_t &start_pts,
+    int64_t &end_pts
+) {
+    AVStream *stream = fmt_ctx->streams[stream_idx];
+    int64_t stream_start_pts = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+    if (start_pts == AV_NOPTS_VALUE) {
+        start_pts = stream_start_pts;
+    }
+    // The end of the stream does not depend on the requested start
+    if (end_pts == AV_NOPTS_VALUE) {
+        if (stream->duration != AV_NOPTS_VALUE && stream->duration > 0) {
+            end_pts = stream_start_pts + stream->duration;
+        } else if (fmt_ctx->duration != AV_NOPTS_VALUE && fmt_ctx->duration > 0) {
+            end_pts = time_to_stream_pts(fmt_ctx, stream_idx, fmt_ctx->duration);
+        } else {
+            spdlog::error("Unable to determine the duration of stream #{}", stream_idx);
+            return AVERROR(EINVAL);
+        }
+    }
+    return 0;
+}
+
+AVCodecContext *alloc_resized_codec_context(const AVCodecContext *ctx, int width, int height) {
+    AVCodecContext *resized_ctx = avcodec_alloc_context3(nullptr);
+    if (resized_ctx == nullptr) {
+        spdlog::error("Failed to allocate codec context");
+        return nullptr;
+    }
+    resized_ctx->width = width;
+    resized_ctx->height = height;
+    resized_ctx->pix_fmt = ctx->pix_fmt;
+    resized_ctx->time_base = ctx->time_base;
+    resized_ctx->pkt_timebase = ctx->pkt_timebase;
+    resized_ctx->framerate = ctx->framerate;
+    resized_ctx->sample_aspect_ratio = ctx->sample_aspect_ratio;
+    resized_ctx->colorspace = ctx->colorspace;
+    resized_ctx->color_range = ctx->color_range;
+    resized_ctx->color_primaries = ctx->color_primaries;
+    resized_ctx->color_trc = ctx->color_trc;
+    resized_ctx->chroma_sample_location = ctx->chroma_sample_location;
+    return resized_ctx;
+}
+
 enum AVPixelFormat
 get_encoder_default_pix_fmt(const AVCodec *encoder, AVPixelFormat target_pix_fmt) {
     int ret;
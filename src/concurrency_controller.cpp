@@ -0,0 +1,140 @@
+#include "concurrency_controller.h"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+// Queue fill ratios that mark a stage as the bottleneck
+static constexpr double HIGH_FILL = 0.75;
+static constexpr double LOW_FILL = 0.25;
+
+// Relative throughput gain required to keep an added worker
+static constexpr double MIN_THROUGHPUT_GAIN = 1.05;
+
+static size_t stage_index(PipelineStage stage) {
+    return static_cast<size_t>(stage);
+}
+
+ConcurrencyController::ConcurrencyController(size_t max_workers, bool adaptive)
+    : max_workers_(std::max<size_t>(max_workers, 1)),
+      adaptive_(adaptive),
+      start_time_(std::chrono::steady_clock::now()),
+      active_workers_(adaptive ? 1 : std::max<size_t>(max_workers, 1)),
+      worker_ceiling_(std::max<size_t>(max_workers, 1)),
+      period_start_time_(start_time_) {}
+
+void ConcurrencyController::wait_until_active(size_t worker_index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this, worker_index] {
+        return stopped_ || worker_index < active_workers_;
+    });
+}
+
+void ConcurrencyController::record_frame(PipelineStage stage) {
+    stage_frames_[stage_index(stage)]++;
+}
+
+void ConcurrencyController::sample(double decoded_fill, double filtered_fill) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+        return;
+    }
+
+    samples_++;
+    decoded_fill_sum_ += decoded_fill;
+    filtered_fill_sum_ += filtered_fill;
+    total_samples_++;
+    total_decoded_fill_ += decoded_fill;
+    total_filtered_fill_ += filtered_fill;
+
+    if (samples_ >= SAMPLES_PER_ADJUSTMENT) {
+        adjust();
+    }
+}
+
+void ConcurrencyController::adjust() {
+    double decoded_fill = decoded_fill_sum_ / samples_;
+    double filtered_fill = filtered_fill_sum_ / samples_;
+
+    // Output throughput over the period
+    auto now = std::chrono::steady_clock::now();
+    int64_t encoded_frames = stage_frames_[stage_index(PipelineStage::Encode)];
+    double elapsed = std::chrono::duration<double>(now - period_start_time_).count();
+    double throughput =
+        elapsed > 0 ? static_cast<double>(encoded_frames - period_start_frames_) / elapsed : 0;
+
+    samples_ = 0;
+    decoded_fill_sum_ = 0;
+    filtered_fill_sum_ = 0;
+    period_start_frames_ = encoded_frames;
+    period_start_time_ = now;
+
+    size_t previous_workers = active_workers_;
+    if (evaluating_added_worker_) {
+        // Keep the added worker only if it paid off; otherwise stop growing at this count
+        evaluating_added_worker_ = false;
+        if (throughput < last_throughput_ * MIN_THROUGHPUT_GAIN) {
+            active_workers_--;
+            worker_ceiling_ = active_workers_;
+        }
+    } else if (decoded_fill > HIGH_FILL && filtered_fill < HIGH_FILL &&
+               active_workers_ < worker_ceiling_) {
+        // Frames are waiting for the filters while the encoder keeps up
+        active_workers_++;
+        evaluating_added_worker_ = true;
+    } else if ((decoded_fill < LOW_FILL || filtered_fill > HIGH_FILL) && active_workers_ > 1) {
+        // The filters are starved by the decoder or blocked by the encoder
+        active_workers_--;
+    }
+    last_throughput_ = throughput;
+
+    if (active_workers_ != previous_workers) {
+        spdlog::debug(
+            "Concurrency controller: {} -> {} filter worker(s) (decoded queue {:.0f}% full, "
+            "reorder buffer {:.0f}% full, {:.1f} fps)",
+            previous_workers,
+            active_workers_,
+            decoded_fill * 100,
+            filtered_fill * 100,
+            throughput
+        );
+        changed_.notify_all();
+    }
+}
+
+bool ConcurrencyController::wait_for_next_sample() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return !changed_.wait_for(lock, SAMPLE_INTERVAL, [this] { return stopped_; });
+}
+
+void ConcurrencyController::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    changed_.notify_all();
+}
+
+void ConcurrencyController::log_summary() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count();
+    auto fps = [&](PipelineStage stage) {
+        return elapsed > 0 ? static_cast<double>(stage_frames_[stage_index(stage)]) / elapsed : 0.0;
+    };
+    double samples = static_cast<double>(total_samples_);
+    double mean_decoded_fill = samples > 0 ? total_decoded_fill_ / samples : 0;
+    double mean_filtered_fill = samples > 0 ? total_filtered_fill_ / samples : 0;
+
+    spdlog::info(
+        "Concurrency: {}/{} filter worker(s) active; decode {:.1f} fps, filter {:.1f} fps, "
+        "encode {:.1f} fps; decoded queue {:.0f}% full, reorder buffer {:.0f}% full on average",
+        active_workers_,
+        max_workers_,
+        fps(PipelineStage::Decode),
+        fps(PipelineStage::Filter),
+        fps(PipelineStage::Encode),
+        mean_decoded_fill * 100,
+        mean_filtered_fill * 100
+    );
+}
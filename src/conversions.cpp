@@ -5,48 +5,40 @@
 
 #include <spdlog/spdlog.h>
 
-// Convert AVFrame format
-AVFrame *convert_avframe_pix_fmt(AVFrame *src_frame, AVPixelFormat pix_fmt) {
-    AVFrame *dst_frame = av_frame_alloc();
-    if (dst_frame == nullptr) {
-        spdlog::error("Failed to allocate destination AVFrame.");
-        return nullptr;
-    }
+#include "frame_pool.h"
+#include "fused_conversion.h"
+#include "sws_cache.h"
 
-    dst_frame->format = pix_fmt;
-    dst_frame->width = src_frame->width;
-    dst_frame->height = src_frame->height;
+// Convert AVFrame format
+AVFrame *convert_avframe_pix_fmt(AVFrame *src_frame, AVPixelFormat pix_fmt, bool reuse_context) {
+    return scale_avframe(
+        src_frame, src_frame->width, src_frame->height, pix_fmt, SWS_BILINEAR, reuse_context
+    );
+}
 
-    // Allocate memory for the converted frame
-    if (av_frame_get_buffer(dst_frame, 32) < 0) {
-        spdlog::error("Failed to allocate memory for AVFrame.");
-        av_frame_free(&dst_frame);
+AVFrame *scale_avframe(
+    const AVFrame *src_frame,
+    int width,
+    int height,
+    AVPixelFormat pix_fmt,
+    int flags,
+    bool reuse_context
+) {
+    SwsContextCache::Lease sws_ctx = SwsContextCache::get_instance().acquire(
+        src_frame, width, height, pix_fmt, flags, reuse_context
+    );
+    if (!sws_ctx) {
         return nullptr;
     }
 
-    // Create a SwsContext for pixel format conversion
-    SwsContext *sws_ctx = sws_getContext(
-        src_frame->width,
-        src_frame->height,
-        static_cast<AVPixelFormat>(src_frame->format),
-        dst_frame->width,
-        dst_frame->height,
-        pix_fmt,
-        SWS_BILINEAR,
-        nullptr,
-        nullptr,
-        nullptr
-    );
-
-    if (sws_ctx == nullptr) {
-        spdlog::error("Failed to initialize swscale context.");
-        av_frame_free(&dst_frame);
+    AVFrame *dst_frame = FramePool::get_instance().alloc_frame(pix_fmt, width, height);
+    if (dst_frame == nullptr) {
+        spdlog::error("Failed to allocate destination AVFrame.");
         return nullptr;
     }
 
-    // Perform the conversion
     sws_scale(
-        sws_ctx,
+        sws_ctx.get(),
         src_frame->data,
         src_frame->linesize,
         0,
@@ -54,20 +46,25 @@ AVFrame *convert_avframe_pix_fmt(AVFrame *src_frame, AVPixelFormat pix_fmt) {
         dst_frame->data,
         dst_frame->linesize
     );
-
-    // Clean up
-    sws_freeContext(sws_ctx);
-
     return dst_frame;
 }
 
+// Wrap the pixels of a BGR24 AVFrame in an ncnn::Mat without copying
+ncnn::Mat avframe_to_ncnn_mat_view(AVFrame *frame) {
+    // ncnn::Mat rows are tightly packed
+    if (frame->format != AV_PIX_FMT_BGR24 || frame->linesize[0] != frame->width * 3) {
+        return ncnn::Mat();
+    }
+    return ncnn::Mat(frame->width, frame->height, frame->data[0], static_cast<size_t>(3), 3);
+}
+
 // Convert AVFrame to ncnn::Mat by copying the data
-ncnn::Mat avframe_to_ncnn_mat(AVFrame *frame) {
+ncnn::Mat avframe_to_ncnn_mat(AVFrame *frame, bool reuse_context) {
     AVFrame *converted_frame = nullptr;
 
     // Convert to BGR24 format if necessary
     if (frame->format != AV_PIX_FMT_BGR24) {
-        converted_frame = convert_avframe_pix_fmt(frame, AV_PIX_FMT_BGR24);
+        converted_frame = convert_avframe_pix_fmt(frame, AV_PIX_FMT_BGR24, reuse_context);
         if (!converted_frame) {
             spdlog::error("Failed to convert AVFrame to BGR24.");
             return ncnn::Mat();
@@ -80,7 +77,9 @@ ncnn::Mat avframe_to_ncnn_mat(AVFrame *frame) {
     // Allocate a new ncnn::Mat and copy the data
     int width = converted_frame->width;
     int height = converted_frame->height;
-    ncnn::Mat ncnn_image = ncnn::Mat(width, height, static_cast<size_t>(3), 3);
+    ncnn::Mat ncnn_image = ncnn::Mat(
+        width, height, static_cast<size_t>(3), 3, FramePool::get_instance().get_mat_allocator()
+    );
 
     // Manually copy the pixel data from AVFrame to the new ncnn::Mat
     const uint8_t *src_data = converted_frame->data[0];
@@ -100,93 +99,56 @@ ncnn::Mat avframe_to_ncnn_mat(AVFrame *frame) {
     return ncnn_image;
 }
 
-// Convert ncnn::Mat to AVFrame with a specified pixel format (this part is unchanged)
-AVFrame *ncnn_mat_to_avframe(const ncnn::Mat &mat, AVPixelFormat pix_fmt) {
-    int ret;
-
-    // Step 1: Allocate a destination AVFrame for the specified pixel format
-    AVFrame *dst_frame = av_frame_alloc();
+// Convert ncnn::Mat to AVFrame with a specified pixel format
+AVFrame *ncnn_mat_to_avframe(
+    const ncnn::Mat &mat,
+    AVPixelFormat pix_fmt,
+    AVColorSpace colorspace,
+    AVColorRange color_range,
+    bool reuse_context,
+    bool fused
+) {
+    AVFrame *dst_frame = FramePool::get_instance().alloc_frame(pix_fmt, mat.w, mat.h);
     if (!dst_frame) {
         spdlog::error("Failed to allocate destination AVFrame.");
         return nullptr;
     }
 
-    dst_frame->format = pix_fmt;
-    dst_frame->width = mat.w;
-    dst_frame->height = mat.h;
-
-    // Allocate memory for the frame buffer
-    if (av_frame_get_buffer(dst_frame, 32) < 0) {
-        spdlog::error("Failed to allocate memory for destination AVFrame.");
-        av_frame_free(&dst_frame);
-        return nullptr;
-    }
-
-    // Step 2: Convert ncnn::Mat to BGR AVFrame
-    AVFrame *bgr_frame = av_frame_alloc();
-    if (!bgr_frame) {
-        spdlog::error("Failed to allocate intermediate BGR AVFrame.");
-        av_frame_free(&dst_frame);
-        return nullptr;
-    }
-
-    bgr_frame->format = AV_PIX_FMT_BGR24;
-    bgr_frame->width = mat.w;
-    bgr_frame->height = mat.h;
-
-    // Allocate memory for the intermediate BGR frame
-    if (av_frame_get_buffer(bgr_frame, 32) < 0) {
-        spdlog::error("Failed to allocate memory for BGR AVFrame.");
-        av_frame_free(&dst_frame);
-        av_frame_free(&bgr_frame);
-        return nullptr;
-    }
-
-    // Copy the pixel data from ncnn::Mat to the BGR AVFrame
-    for (int y = 0; y < mat.h; y++) {
-        uint8_t *dst_row = bgr_frame->data[0] + y * bgr_frame->linesize[0];
-        const uint8_t *src_row = mat.row<const uint8_t>(y);
-
-        // Copy 3 channels (BGR) per pixel
-        memcpy(dst_row, src_row, static_cast<size_t>(mat.w) * 3);
+    // Convert to common encoder formats in a single pass without going through swscale
+    if (fused && is_fused_conversion_supported(pix_fmt) && mat.elemsize == 3) {
+        int ret = convert_bgr24_to_yuv420(
+            static_cast<const uint8_t *>(mat.data), mat.w * 3, dst_frame, colorspace, color_range
+        );
+        if (ret < 0) {
+            av_frame_free(&dst_frame);
+            return nullptr;
+        }
+        return dst_frame;
     }
 
-    // Step 3: Convert the BGR frame to the desired pixel format
-    SwsContext *sws_ctx = sws_getContext(
-        bgr_frame->width,
-        bgr_frame->height,
+    SwsContextKey key{
+        mat.w,
+        mat.h,
         AV_PIX_FMT_BGR24,
-        dst_frame->width,
-        dst_frame->height,
+        mat.w,
+        mat.h,
         pix_fmt,
         SWS_BILINEAR,
-        nullptr,
-        nullptr,
-        nullptr
-    );
-
-    if (sws_ctx == nullptr) {
-        spdlog::error("Failed to initialize swscale context.");
-        av_frame_free(&bgr_frame);
+        colorspace,
+        color_range
+    };
+    SwsContextCache::Lease sws_ctx = SwsContextCache::get_instance().acquire(key, reuse_context);
+    if (!sws_ctx) {
         av_frame_free(&dst_frame);
         return nullptr;
     }
 
-    // Perform the conversion
-    ret = sws_scale(
-        sws_ctx,
-        bgr_frame->data,
-        bgr_frame->linesize,
-        0,
-        bgr_frame->height,
-        dst_frame->data,
-        dst_frame->linesize
+    // Convert straight from the pixels of the ncnn::Mat, whose lines are not padded
+    const uint8_t *src_data[4] = {static_cast<const uint8_t *>(mat.data)};
+    const int src_linesize[4] = {static_cast<int>(static_cast<size_t>(mat.w) * mat.elemsize)};
+    int ret = sws_scale(
+        sws_ctx.get(), src_data, src_linesize, 0, mat.h, dst_frame->data, dst_frame->linesize
     );
-
-    // Clean up
-    sws_freeContext(sws_ctx);
-    av_frame_free(&bgr_frame);
-
     if (ret != dst_frame->height) {
         spdlog::error("Failed to convert BGR AVFrame to destination pixel format.");
         av_frame_free(&dst_frame);
@@ -0,0 +1,169 @@
+#include "crop_filter.h"
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "avutils.h"
+#include "frame_pool.h"
+
+CropFilter::CropFilter(std::unique_ptr<Filter> filter, const CropRect &crop, bool pad)
+    : filter_(std::move(filter)), crop_(crop), pad_(pad) {}
+
+CropFilter::~CropFilter() {
+    if (crop_ctx_) {
+        avcodec_free_context(&crop_ctx_);
+    }
+}
+
+int CropFilter::init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) {
+    in_width_ = dec_ctx->width;
+    in_height_ = dec_ctx->height;
+    out_width_ = enc_ctx->width;
+    out_height_ = enc_ctx->height;
+
+    // The wrapped filter only needs the properties of the decoded frames
+    crop_ctx_ = alloc_resized_codec_context(dec_ctx, crop_.width, crop_.height);
+    if (crop_ctx_ == nullptr) {
+        return AVERROR(ENOMEM);
+    }
+
+    return filter_->init(crop_ctx_, enc_ctx, hw_ctx);
+}
+
+void CropFilter::set_processing_control(ProcessingControl *control) {
+    Filter::set_processing_control(control);
+    filter_->set_processing_control(control);
+}
+
+int CropFilter::process_frame(AVFrame *in_frame, AVFrame **out_frame) {
+    if (in_frame->hw_frames_ctx != nullptr) {
+        spdlog::error("Cropping hardware frames is not supported");
+        return AVERROR(ENOSYS);
+    }
+
+    // Crop a new reference to the frame so the decoded frame is left as it is
+    AVFramePtr cropped_frame(av_frame_clone(in_frame));
+    if (!cropped_frame) {
+        spdlog::error("Failed to reference the input frame");
+        return AVERROR(ENOMEM);
+    }
+    cropped_frame->crop_left = static_cast<size_t>(crop_.x);
+    cropped_frame->crop_top = static_cast<size_t>(crop_.y);
+    cropped_frame->crop_right = static_cast<size_t>(in_frame->width - crop_.x - crop_.width);
+    cropped_frame->crop_bottom = static_cast<size_t>(in_frame->height - crop_.y - crop_.height);
+    int ret = av_frame_apply_cropping(cropped_frame.get(), AV_FRAME_CROP_UNALIGNED);
+    if (ret < 0) {
+        spdlog::error("Failed to crop the input frame");
+        return ret;
+    }
+
+    AVFrame *filtered_frame = nullptr;
+    ret = filter_->process_frame(cropped_frame.get(), &filtered_frame);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (!pad_) {
+        *out_frame = filtered_frame;
+        return 0;
+    }
+    return pad_frame(filtered_frame, out_frame);
+}
+
+int CropFilter::flush(std::vector<AVFrame *> &flushed_frames) {
+    std::vector<AVFrame *> filtered_frames;
+    int ret = filter_->flush(filtered_frames);
+    if (!pad_ || ret < 0) {
+        flushed_frames.insert(flushed_frames.end(), filtered_frames.begin(), filtered_frames.end());
+        return ret;
+    }
+
+    for (size_t i = 0; i < filtered_frames.size(); i++) {
+        AVFrame *padded_frame = nullptr;
+        ret = pad_frame(filtered_frames[i], &padded_frame);
+        if (ret < 0) {
+            for (size_t j = i + 1; j < filtered_frames.size(); j++) {
+                av_frame_free(&filtered_frames[j]);
+            }
+            return ret;
+        }
+        flushed_frames.push_back(padded_frame);
+    }
+    return 0;
+}
+
+int CropFilter::pad_frame(AVFrame *frame, AVFrame **out_frame) {
+    AVFramePtr filtered_frame(frame);
+    AVPixelFormat pix_fmt = static_cast<AVPixelFormat>(frame->format);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        spdlog::error("Cannot pad frames in pixel format {}", static_cast<int>(pix_fmt));
+        return AVERROR(ENOSYS);
+    }
+
+    AVFramePtr padded_frame(
+        FramePool::get_instance().alloc_frame(pix_fmt, out_width_, out_height_)
+    );
+    if (!padded_frame) {
+        spdlog::error("Failed to allocate the padded frame");
+        return AVERROR(ENOMEM);
+    }
+    int ret = av_frame_copy_props(padded_frame.get(), frame);
+    if (ret < 0) {
+        spdlog::error("Failed to copy frame properties");
+        return ret;
+    }
+
+    ptrdiff_t linesizes[4];
+    for (int i = 0; i < 4; i++) {
+        linesizes[i] = padded_frame->linesize[i];
+    }
+    ret = av_image_fill_black(
+        padded_frame->data, linesizes, pix_fmt, frame->color_range, out_width_, out_height_
+    );
+    if (ret < 0) {
+        spdlog::error("Failed to fill the padded frame");
+        return ret;
+    }
+
+    // Put the filtered area where the active area was in the input, on chroma sample boundaries
+    int width = std::min(frame->width, out_width_);
+    int height = std::min(frame->height, out_height_);
+    int offset_x = static_cast<int>(av_rescale(crop_.x, out_width_, in_width_));
+    int offset_y = static_cast<int>(av_rescale(crop_.y, out_height_, in_height_));
+    offset_x = std::min(offset_x, out_width_ - width) & ~((1 << desc->log2_chroma_w) - 1);
+    offset_y = std::min(offset_y, out_height_ - height) & ~((1 << desc->log2_chroma_h) - 1);
+
+    int num_planes = av_pix_fmt_count_planes(pix_fmt);
+    for (int plane = 0; plane < num_planes; plane++) {
+        bool chroma = (plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int shift_y = chroma ? desc->log2_chroma_h : 0;
+        int plane_offset_x = av_image_get_linesize(pix_fmt, offset_x, plane);
+        int bytewidth = av_image_get_linesize(pix_fmt, width, plane);
+        if (plane_offset_x < 0 || bytewidth < 0) {
+            spdlog::error("Failed to compute the padded frame layout");
+            return AVERROR(EINVAL);
+        }
+
+        uint8_t *dst = padded_frame->data[plane] +
+                       (offset_y >> shift_y) * padded_frame->linesize[plane] + plane_offset_x;
+        av_image_copy_plane(
+            dst,
+            padded_frame->linesize[plane],
+            frame->data[plane],
+            frame->linesize[plane],
+            bytewidth,
+            AV_CEIL_RSHIFT(height, shift_y)
+        );
+    }
+
+    *out_frame = padded_frame.release();
+    return 0;
+}
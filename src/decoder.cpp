@@ -1,10 +1,18 @@
 #include "decoder.h"
 
+#include <algorithm>
+
 #include <spdlog/spdlog.h>
 
 enum AVPixelFormat Decoder::hw_pix_fmt_ = AV_PIX_FMT_NONE;
 
-Decoder::Decoder() : fmt_ctx_(nullptr), dec_ctx_(nullptr), in_vstream_idx_(-1) {}
+Decoder::Decoder()
+    : fmt_ctx_(nullptr),
+      dec_ctx_(nullptr),
+      in_vstream_idx_(-1),
+      start_pts_(AV_NOPTS_VALUE),
+      end_pts_(AV_NOPTS_VALUE),
+      draining_(false) {}
 
 Decoder::~Decoder() {
     if (dec_ctx_) {
@@ -30,7 +38,9 @@ enum AVPixelFormat Decoder::get_hw_format(AVCodecContext *_, const enum AVPixelF
 int Decoder::init(
     AVHWDeviceType hw_type,
     AVBufferRef *hw_ctx,
-    const std::filesystem::path &in_fpath
+    const std::filesystem::path &in_fpath,
+    int lowres,
+    bool threaded
 ) {
     int ret;
 
@@ -108,6 +118,14 @@ int Decoder::init(
         }
     }
 
+    if (lowres > 0) {
+        dec_ctx_->lowres = std::min<int>(lowres, decoder->max_lowres);
+    }
+    if (threaded) {
+        dec_ctx_->thread_count = 0;
+        dec_ctx_->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    }
+
     // Open the decoder
     if ((ret = avcodec_open2(dec_ctx_, decoder, nullptr)) < 0) {
         spdlog::error("Failed to open decoder for stream #{}", stream_index);
@@ -119,6 +137,74 @@ int Decoder::init(
     return 0;
 }
 
+int Decoder::set_frame_range(int64_t start_pts, int64_t end_pts) {
+    start_pts_ = start_pts;
+    end_pts_ = end_pts;
+
+    if (start_pts == AV_NOPTS_VALUE) {
+        return 0;
+    }
+
+    // Decoding starts at the closest keyframe at or before the start of the range
+    return seek_to_keyframe(start_pts);
+}
+
+int Decoder::seek_to_keyframe(int64_t pts) {
+    int ret = avformat_seek_file(fmt_ctx_, in_vstream_idx_, INT64_MIN, pts, pts, 0);
+    if (ret < 0) {
+        spdlog::error("Failed to seek to timestamp {} of stream #{}", pts, in_vstream_idx_);
+        return ret;
+    }
+
+    // Discard any frames buffered from before the seek
+    avcodec_flush_buffers(dec_ctx_);
+    draining_ = false;
+    return 0;
+}
+
+int Decoder::decode_next_frame(AVFrame *frame) {
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        spdlog::error("Could not allocate AVPacket");
+        return AVERROR(ENOMEM);
+    }
+
+    int ret;
+    while (true) {
+        ret = avcodec_receive_frame(dec_ctx_, frame);
+        if (ret != AVERROR(EAGAIN) || draining_) {
+            break;
+        }
+
+        // Feed the decoder the next video packet, or enter draining mode at EOF
+        ret = av_read_frame(fmt_ctx_, packet);
+        if (ret == AVERROR_EOF) {
+            draining_ = true;
+            ret = avcodec_send_packet(dec_ctx_, nullptr);
+        } else if (ret >= 0) {
+            if (packet->stream_index == in_vstream_idx_) {
+                ret = avcodec_send_packet(dec_ctx_, packet);
+            }
+            av_packet_unref(packet);
+        }
+        if (ret < 0) {
+            spdlog::error("Error reading or decoding video packet");
+            break;
+        }
+    }
+
+    av_packet_free(&packet);
+    return ret;
+}
+
+bool Decoder::is_before_range(const AVFrame *frame) const {
+    return start_pts_ != AV_NOPTS_VALUE && frame->pts != AV_NOPTS_VALUE && frame->pts < start_pts_;
+}
+
+bool Decoder::is_past_range(const AVFrame *frame) const {
+    return end_pts_ != AV_NOPTS_VALUE && frame->pts != AV_NOPTS_VALUE && frame->pts >= end_pts_;
+}
+
 AVFormatContext *Decoder::get_format_context() const {
     return fmt_ctx_;
 }
@@ -0,0 +1,94 @@
+#include "dedup_filter.h"
+
+#include <spdlog/spdlog.h>
+
+#include "frame_analysis.h"
+
+DedupFilter::DedupFilter(
+    std::unique_ptr<Filter> filter,
+    double threshold,
+    const VideoAnalysis *analysis
+)
+    : filter_(std::move(filter)),
+      threshold_(threshold),
+      analysis_(analysis),
+      in_time_base_({0, 1}),
+      out_time_base_({0, 1}) {}
+
+DedupFilter::~DedupFilter() = default;
+
+int DedupFilter::init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) {
+    in_time_base_ = dec_ctx->time_base;
+    out_time_base_ = enc_ctx->time_base;
+    return filter_->init(dec_ctx, enc_ctx, hw_ctx);
+}
+
+void DedupFilter::set_processing_control(ProcessingControl *control) {
+    Filter::set_processing_control(control);
+    filter_->set_processing_control(control);
+}
+
+int DedupFilter::process_frame(AVFrame *in_frame, AVFrame **out_frame) {
+    total_frames_++;
+
+    // Hardware frames would have to be downloaded to be compared
+    if (filter_buffers_ || !is_frame_analyzable(in_frame)) {
+        return filter_->process_frame(in_frame, out_frame);
+    }
+
+    // The hash rules out most differing frames before the full comparison; near-duplicates have
+    // different hashes, so they are always compared in full and the hash is not computed
+    // Frames whose downscaled luma already differed in the analysis pass cannot be repeats.
+    uint64_t hash = 0;
+    bool candidate = true;
+    const FrameFeatures *features = analysis_ ? analysis_->find(in_frame->pts) : nullptr;
+    if (features != nullptr) {
+        candidate = threshold_ > 0 ? features->motion <= threshold_
+                                   : (features->flags & FRAME_DUPLICATE) != 0;
+    } else if (threshold_ == 0) {
+        hash = hash_frame(in_frame);
+        candidate = hash == prev_hash_;
+    }
+    if (prev_out_frame_ && candidate && frames_match(in_frame, prev_in_frame_.get(), threshold_)) {
+        AVFrame *reused_frame = av_frame_clone(prev_out_frame_.get());
+        if (reused_frame == nullptr) {
+            spdlog::error("Failed to reference the previous output frame");
+            return AVERROR(ENOMEM);
+        }
+        reused_frame->pts = av_rescale_q(in_frame->pts, in_time_base_, out_time_base_);
+        *out_frame = reused_frame;
+        reused_frames_++;
+        return 0;
+    }
+
+    int ret = filter_->process_frame(in_frame, out_frame);
+    if (ret == AVERROR(EAGAIN)) {
+        filter_buffers_ = true;
+        prev_in_frame_.reset();
+        prev_out_frame_.reset();
+        return ret;
+    } else if (ret < 0) {
+        return ret;
+    }
+
+    // Keep references to the frames for comparison with the next frame
+    prev_in_frame_.reset(av_frame_clone(in_frame));
+    prev_out_frame_.reset(av_frame_clone(*out_frame));
+    if (!prev_in_frame_ || !prev_out_frame_) {
+        prev_in_frame_.reset();
+        prev_out_frame_.reset();
+    }
+    prev_hash_ = hash;
+    return 0;
+}
+
+int DedupFilter::flush(std::vector<AVFrame *> &flushed_frames) {
+    prev_in_frame_.reset();
+    prev_out_frame_.reset();
+    if (total_frames_ > 0) {
+        spdlog::info(
+            "Reused the previous output for {}/{} repeated frames", reused_frames_, total_frames_
+        );
+    }
+    return filter_->flush(flushed_frames);
+}
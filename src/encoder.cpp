@@ -8,9 +8,20 @@ extern "C" {
 
 #include "avutils.h"
 #include "conversions.h"
+#include "stream_copier.h"
 
 Encoder::Encoder()
-    : ofmt_ctx_(nullptr), enc_ctx_(nullptr), out_vstream_idx_(-1), stream_map_(nullptr) {}
+    : ofmt_ctx_(nullptr),
+      enc_ctx_(nullptr),
+      out_vstream_idx_(-1),
+      stream_map_(nullptr),
+      start_time_(AV_NOPTS_VALUE),
+      end_time_(AV_NOPTS_VALUE),
+      pts_offset_(0),
+      encoded_bytes_(0),
+      record_packet_sizes_(false),
+      stream_copier_(nullptr),
+      reuse_sws_contexts_(true) {}
 
 Encoder::~Encoder() {
     if (enc_ctx_) {
@@ -108,7 +119,9 @@ int Encoder::init(
     }
 
     // Set the output video's frame rate
-    if (dec_ctx->framerate.num > 0 && dec_ctx->framerate.den > 0) {
+    if (encoder_config->frame_rate.num > 0 && encoder_config->frame_rate.den > 0) {
+        enc_ctx_->framerate = encoder_config->frame_rate;
+    } else if (dec_ctx->framerate.num > 0 && dec_ctx->framerate.den > 0) {
         enc_ctx_->framerate = dec_ctx->framerate;
     } else {
         enc_ctx_->framerate = av_guess_frame_rate(ifmt_ctx, out_vstream, nullptr);
@@ -141,6 +154,17 @@ int Encoder::init(
     out_vstream->avg_frame_rate = enc_ctx_->framerate;
     out_vstream->r_frame_rate = enc_ctx_->framerate;
 
+    // Shift the output so that the processed time range starts at zero
+    start_time_ = encoder_config->start_time;
+    end_time_ = encoder_config->end_time;
+    if (start_time_ != AV_NOPTS_VALUE) {
+        pts_offset_ = av_rescale_q(
+            time_to_stream_pts(ifmt_ctx, in_vstream_idx, start_time_),
+            ifmt_ctx->streams[in_vstream_idx]->time_base,
+            enc_ctx_->time_base
+        );
+    }
+
     // Copy other streams if necessary
     if (encoder_config->copy_streams) {
         // Allocate the stream mape frame o
@@ -210,6 +234,11 @@ int Encoder::write_frame(AVFrame *frame, int64_t frame_idx) {
     AVFrame *converted_frame = nullptr;
     int ret;
 
+    // Make timestamps relative to the start of the processed time range
+    if (frame->pts != AV_NOPTS_VALUE) {
+        frame->pts -= pts_offset_;
+    }
+
     // Set the frame's presentation timestamp if not set
     if (frame->pts <= 0) {
         frame->pts = frame_idx;
@@ -217,7 +246,7 @@ int Encoder::write_frame(AVFrame *frame, int64_t frame_idx) {
 
     // Convert the frame to the encoder's pixel format if needed
     if (frame->format != enc_ctx_->pix_fmt) {
-        converted_frame = convert_avframe_pix_fmt(frame, enc_ctx_->pix_fmt);
+        converted_frame = convert_avframe_pix_fmt(frame, enc_ctx_->pix_fmt, reuse_sws_contexts_);
         if (!converted_frame) {
             spdlog::error("Error converting frame to encoder's pixel format");
             return AVERROR_EXTERNAL;
@@ -256,14 +285,19 @@ int Encoder::write_frame(AVFrame *frame, int64_t frame_idx) {
             return ret;
         }
 
+        if (record_packet_sizes_) {
+            packet_sizes_.emplace_back(enc_pkt->pts, enc_pkt->size);
+        }
+
         // Rescale packet timestamps
         av_packet_rescale_ts(
             enc_pkt, enc_ctx_->time_base, ofmt_ctx_->streams[out_vstream_idx_]->time_base
         );
         enc_pkt->stream_index = out_vstream_idx_;
+        encoded_bytes_ += enc_pkt->size;
 
         // Write the packet
-        ret = av_interleaved_write_frame(ofmt_ctx_, enc_pkt);
+        ret = mux_video_packet(enc_pkt);
         av_packet_unref(enc_pkt);
         if (ret < 0) {
             spdlog::error("Error muxing packet");
@@ -304,14 +338,19 @@ int Encoder::flush() {
             return ret;
         }
 
+        if (record_packet_sizes_) {
+            packet_sizes_.emplace_back(enc_pkt->pts, enc_pkt->size);
+        }
+
         // Rescale packet timestamps
         av_packet_rescale_ts(
             enc_pkt, enc_ctx_->time_base, ofmt_ctx_->streams[out_vstream_idx_]->time_base
         );
         enc_pkt->stream_index = out_vstream_idx_;
+        encoded_bytes_ += enc_pkt->size;
 
         // Write the packet
-        ret = av_interleaved_write_frame(ofmt_ctx_, enc_pkt);
+        ret = mux_video_packet(enc_pkt);
         av_packet_unref(enc_pkt);
         if (ret < 0) {
             spdlog::error("Error muxing packet during flush");
@@ -324,6 +363,60 @@ int Encoder::flush() {
     return 0;
 }
 
+int Encoder::copy_packet(AVPacket *packet, AVFormatContext *ifmt_ctx) {
+    AVStream *in_stream = ifmt_ctx->streams[packet->stream_index];
+    int out_stream_index = stream_map_[packet->stream_index];
+    AVStream *out_stream = ofmt_ctx_->streams[out_stream_index];
+
+    // Drop packets outside of the processed time range and shift the rest to start at zero
+    int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (end_time_ != AV_NOPTS_VALUE && ts != AV_NOPTS_VALUE &&
+        ts >= time_to_stream_pts(ifmt_ctx, packet->stream_index, end_time_)) {
+        return 0;
+    }
+    if (start_time_ != AV_NOPTS_VALUE) {
+        int64_t start_ts = time_to_stream_pts(ifmt_ctx, packet->stream_index, start_time_);
+        if (ts != AV_NOPTS_VALUE && ts < start_ts) {
+            return 0;
+        }
+        if (packet->pts != AV_NOPTS_VALUE) {
+            packet->pts -= start_ts;
+        }
+        if (packet->dts != AV_NOPTS_VALUE) {
+            packet->dts -= start_ts;
+        }
+    }
+
+    // Rescale packet timestamps to the output stream's time base
+    av_packet_rescale_ts(packet, in_stream->time_base, out_stream->time_base);
+    packet->stream_index = out_stream_index;
+
+    // Write the packet
+    int ret = mux_packet(packet);
+    if (ret < 0) {
+        spdlog::error("Error muxing audio/subtitle packet");
+        return ret;
+    }
+    return 0;
+}
+
+int Encoder::mux_packet(AVPacket *packet) {
+    std::lock_guard<std::mutex> lock(mux_mutex_);
+    return av_interleaved_write_frame(ofmt_ctx_, packet);
+}
+
+int Encoder::mux_video_packet(AVPacket *packet) {
+    // The muxer takes ownership of the packet's data, so read its timestamp first
+    int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    AVRational time_base = ofmt_ctx_->streams[out_vstream_idx_]->time_base;
+
+    int ret = mux_packet(packet);
+    if (ret >= 0 && stream_copier_ != nullptr && ts != AV_NOPTS_VALUE) {
+        stream_copier_->advance(av_rescale_q(ts, time_base, AVRational{1, AV_TIME_BASE}));
+    }
+    return ret;
+}
+
 AVCodecContext *Encoder::get_encoder_context() const {
     return enc_ctx_;
 }
@@ -332,6 +425,26 @@ AVFormatContext *Encoder::get_format_context() const {
     return ofmt_ctx_;
 }
 
+int64_t Encoder::get_encoded_bytes() const {
+    return encoded_bytes_;
+}
+
+void Encoder::set_record_packet_sizes(bool record) {
+    record_packet_sizes_ = record;
+}
+
+const std::vector<std::pair<int64_t, int64_t>> &Encoder::get_packet_sizes() const {
+    return packet_sizes_;
+}
+
+void Encoder::set_stream_copier(StreamCopier *stream_copier) {
+    stream_copier_ = stream_copier;
+}
+
+void Encoder::set_reuse_sws_contexts(bool reuse) {
+    reuse_sws_contexts_ = reuse;
+}
+
 int Encoder::get_output_video_stream_index() const {
     return out_vstream_idx_;
 }
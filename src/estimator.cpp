@@ -0,0 +1,303 @@
+#include "estimator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "avutils.h"
+
+// Number of consecutive frames processed per sample so inter-frame coding is represented
+static constexpr int FRAMES_PER_SAMPLE = 8;
+
+// Frames processed before each sample and left out of it; they take the keyframe the encoder
+// places after each seek, which would otherwise inflate the size of every sample
+static constexpr int WARMUP_FRAMES = 4;
+
+// Two-sided 95% quantile of the normal distribution
+static constexpr double CONFIDENCE_Z = 1.96;
+
+using Clock = std::chrono::steady_clock;
+
+// Time spent in each stage and the encoded size of one sample
+struct SampleStats {
+    int64_t frames = 0;
+    double decode_time = 0.0;
+    double filter_time = 0.0;
+    double encode_time = 0.0;
+    int64_t encoded_bytes = 0;
+};
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Compute the mean of the values and the half-width of its 95% confidence interval
+static void summarize(const std::vector<double> &values, double &mean, double &margin) {
+    mean = 0.0;
+    margin = 0.0;
+    if (values.empty()) {
+        return;
+    }
+
+    for (double value : values) {
+        mean += value;
+    }
+    mean /= static_cast<double>(values.size());
+
+    if (values.size() < 2) {
+        return;
+    }
+    double variance = 0.0;
+    for (double value : values) {
+        variance += (value - mean) * (value - mean);
+    }
+    variance /= static_cast<double>(values.size() - 1);
+    margin = CONFIDENCE_Z * std::sqrt(variance / static_cast<double>(values.size()));
+}
+
+// Filter and encode one decoded frame, adding the time spent to the sample's statistics.
+// `encoded_pts` is set to the encoder timestamp of the filtered frame, if there was one.
+static int process_sample_frame(
+    VideoProcessingContext *proc_ctx,
+    Encoder &encoder,
+    Filter *filter,
+    AVFrame *frame,
+    SampleStats &stats,
+    int64_t &encoded_pts
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    encoded_pts = AV_NOPTS_VALUE;
+
+    Clock::time_point filter_start = Clock::now();
+    AVFrame *raw_processed_frame = nullptr;
+    int ret = filter->process_frame(frame, &raw_processed_frame);
+    stats.filter_time += seconds_since(filter_start);
+
+    if (ret == AVERROR(EAGAIN) || (ret == 0 && raw_processed_frame == nullptr)) {
+        return 0;
+    } else if (ret < 0) {
+        if (ret != AVERROR_EXIT) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error filtering frame: {}", errbuf);
+        }
+        return ret;
+    }
+    AVFramePtr processed_frame(raw_processed_frame);
+
+    Clock::time_point encode_start = Clock::now();
+    ret = encoder.write_frame(processed_frame.get(), proc_ctx->processed_frames);
+    stats.encode_time += seconds_since(encode_start);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error encoding/writing frame: {}", errbuf);
+        return ret;
+    }
+    encoded_pts = processed_frame->pts;
+    proc_ctx->processed_frames++;
+    return 0;
+}
+
+int estimate_processing(
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    Encoder &encoder,
+    Filter *filter,
+    int num_samples,
+    int64_t start_pts,
+    int64_t end_pts,
+    ProcessingEstimate *estimate
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret = 0;
+
+    int64_t total_frames = proc_ctx->total_frames;
+    if (total_frames <= 0) {
+        spdlog::critical("The total number of frames is needed to extrapolate an estimate");
+        return AVERROR(EINVAL);
+    }
+
+    ret = resolve_stream_range(
+        decoder.get_format_context(), decoder.get_video_stream_index(), start_pts, end_pts
+    );
+    if (ret < 0) {
+        spdlog::critical("Unable to determine the range to sample from");
+        return ret;
+    }
+
+    AVFramePtr frame(av_frame_alloc());
+    if (!frame) {
+        spdlog::critical("Could not allocate AVFrame");
+        return AVERROR(ENOMEM);
+    }
+
+    // A fixed seed keeps estimates for the same input reproducible
+    std::mt19937_64 rng(0);
+    std::vector<SampleStats> samples;
+    proc_ctx->total_frames =
+        static_cast<int64_t>(num_samples) * (WARMUP_FRAMES + FRAMES_PER_SAMPLE);
+
+    // Encoders with lookahead emit packets late, so packets are matched to the samples by timestamp
+    std::unordered_map<int64_t, size_t> pts_samples;
+    encoder.set_record_packet_sizes(true);
+
+    for (int i = 0; i < num_samples; i++) {
+        if (!proc_ctx->control->wait_if_paused()) {
+            return 0;
+        }
+
+        // Pick a random point within the stratum and start at the keyframe preceding it
+        int64_t stratum_start = start_pts + av_rescale(end_pts - start_pts, i, num_samples);
+        int64_t stratum_end = start_pts + av_rescale(end_pts - start_pts, i + 1, num_samples);
+        int64_t stratum_length = std::max<int64_t>(stratum_end - stratum_start, 1);
+        std::uniform_int_distribution<int64_t> offset(0, stratum_length - 1);
+        int64_t target_pts = stratum_start + offset(rng);
+
+        ret = decoder.seek_to_keyframe(target_pts);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error seeking to sample {}: {}", i + 1, errbuf);
+            return ret;
+        }
+
+        SampleStats stats;
+        SampleStats warmup_stats;
+        int warmup_frames = 0;
+        while (stats.frames < FRAMES_PER_SAMPLE) {
+            bool warmup = warmup_frames < WARMUP_FRAMES;
+            SampleStats &frame_stats = warmup ? warmup_stats : stats;
+
+            Clock::time_point decode_start = Clock::now();
+            ret = decoder.decode_next_frame(frame.get());
+            frame_stats.decode_time += seconds_since(decode_start);
+            if (ret == AVERROR_EOF) {
+                break;
+            } else if (ret < 0) {
+                av_strerror(ret, errbuf, sizeof(errbuf));
+                spdlog::critical("Error decoding video frame: {}", errbuf);
+                return ret;
+            }
+
+            int64_t encoded_pts;
+            ret = process_sample_frame(
+                proc_ctx, encoder, filter, frame.get(), frame_stats, encoded_pts
+            );
+            av_frame_unref(frame.get());
+            if (ret == AVERROR_EXIT && proc_ctx->control->is_aborted()) {
+                return 0;
+            } else if (ret < 0) {
+                return ret;
+            }
+
+            if (warmup) {
+                warmup_frames++;
+                continue;
+            }
+            if (encoded_pts != AV_NOPTS_VALUE) {
+                pts_samples[encoded_pts] = samples.size();
+            }
+            stats.frames++;
+        }
+
+        if (stats.frames > 0) {
+            samples.push_back(stats);
+        }
+    }
+
+    if (samples.empty()) {
+        spdlog::critical("No frames could be sampled");
+        return AVERROR(EINVAL);
+    }
+
+    // Drain the filter and encoder; their time is added to the last sample
+    SampleStats &last_sample = samples.back();
+
+    std::vector<AVFrame *> raw_flushed_frames;
+    Clock::time_point flush_start = Clock::now();
+    ret = filter->flush(raw_flushed_frames);
+    last_sample.filter_time += seconds_since(flush_start);
+
+    std::vector<AVFramePtr> flushed_frames;
+    for (AVFrame *raw_frame : raw_flushed_frames) {
+        flushed_frames.emplace_back(raw_frame);
+    }
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error flushing filter: {}", errbuf);
+        return ret;
+    }
+
+    Clock::time_point encode_start = Clock::now();
+    for (auto &flushed_frame : flushed_frames) {
+        ret = encoder.write_frame(flushed_frame.get(), proc_ctx->processed_frames);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error encoding/writing flushed frame: {}", errbuf);
+            return ret;
+        }
+        pts_samples[flushed_frame->pts] = samples.size() - 1;
+        proc_ctx->processed_frames++;
+    }
+    ret = encoder.flush();
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error flushing encoder: {}", errbuf);
+        return ret;
+    }
+    last_sample.encode_time += seconds_since(encode_start);
+
+    // Packets of the warm-up frames are not counted
+    for (const auto &packet : encoder.get_packet_sizes()) {
+        auto it = pts_samples.find(packet.first);
+        if (it != pts_samples.end()) {
+            samples[it->second].encoded_bytes += packet.second;
+        }
+    }
+
+    // Aggregate the per-frame cost of each sample
+    int64_t sampled_frames = 0;
+    double decode_time = 0.0, filter_time = 0.0, encode_time = 0.0;
+    std::vector<double> times_per_frame, bytes_per_frame;
+    for (const SampleStats &sample : samples) {
+        double frames = static_cast<double>(sample.frames);
+        sampled_frames += sample.frames;
+        decode_time += sample.decode_time;
+        filter_time += sample.filter_time;
+        encode_time += sample.encode_time;
+        times_per_frame.push_back(
+            (sample.decode_time + sample.filter_time + sample.encode_time) / frames
+        );
+        bytes_per_frame.push_back(static_cast<double>(sample.encoded_bytes) / frames);
+    }
+
+    double time_mean, time_margin, bytes_mean, bytes_margin;
+    summarize(times_per_frame, time_mean, time_margin);
+    summarize(bytes_per_frame, bytes_mean, bytes_margin);
+
+    double frames = static_cast<double>(total_frames);
+    estimate->total_frames = total_frames;
+    estimate->sampled_frames = sampled_frames;
+    estimate->decode_time_per_frame = decode_time / static_cast<double>(sampled_frames);
+    estimate->filter_time_per_frame = filter_time / static_cast<double>(sampled_frames);
+    estimate->encode_time_per_frame = encode_time / static_cast<double>(sampled_frames);
+    estimate->total_time = time_mean * frames;
+    estimate->total_time_lower = std::max(time_mean - time_margin, 0.0) * frames;
+    estimate->total_time_upper = (time_mean + time_margin) * frames;
+    estimate->bytes_per_frame = bytes_mean;
+    estimate->output_size = static_cast<int64_t>(bytes_mean * frames);
+    estimate->output_size_lower =
+        static_cast<int64_t>(std::max(bytes_mean - bytes_margin, 0.0) * frames);
+    estimate->output_size_upper = static_cast<int64_t>((bytes_mean + bytes_margin) * frames);
+
+    proc_ctx->total_frames = total_frames;
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include "frame_analysis.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+// Layout of the planes of a frame
+struct PlaneLayout {
+    int count;
+    int row_bytes[4];
+    int rows[4];
+    bool high_depth;
+};
+
+static bool get_plane_layout(const AVFrame *frame, PlaneLayout &layout) {
+    AVPixelFormat pix_fmt = static_cast<AVPixelFormat>(frame->format);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        return false;
+    }
+
+    layout.count = av_pix_fmt_count_planes(pix_fmt);
+    if (layout.count <= 0 || av_image_fill_linesizes(layout.row_bytes, pix_fmt, frame->width) < 0) {
+        return false;
+    }
+    for (int i = 0; i < layout.count; i++) {
+        // The chroma planes of YUV formats are subsampled vertically
+        bool chroma = (i == 1 || i == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        layout.rows[i] = chroma ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h)
+                                : frame->height;
+    }
+    layout.high_depth = desc->comp[0].depth > 8;
+    return true;
+}
+
+bool is_frame_analyzable(const AVFrame *frame) {
+    PlaneLayout layout;
+    return frame->hw_frames_ctx == nullptr && get_plane_layout(frame, layout);
+}
+
+uint64_t hash_frame(const AVFrame *frame) {
+    PlaneLayout layout;
+    if (!get_plane_layout(frame, layout)) {
+        return 0;
+    }
+
+    // Hash four interleaved words at a time in independent lanes so that the loop can be
+    // vectorized, then fold the lanes together
+    constexpr uint64_t PRIME = 0x100000001b3ULL;
+    uint64_t lanes[4] = {
+        0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL, 0x9e3779b97f4a7c15ULL, 0x7f4a7c159e3779b9ULL
+    };
+
+    for (int plane = 0; plane < layout.count; plane++) {
+        size_t row_bytes = static_cast<size_t>(layout.row_bytes[plane]);
+        for (int y = 0; y < layout.rows[plane]; y++) {
+            const uint8_t *row = frame->data[plane] + static_cast<ptrdiff_t>(y) *
+                                                          frame->linesize[plane];
+            size_t i = 0;
+            for (; i + 32 <= row_bytes; i += 32) {
+                uint64_t words[4];
+                memcpy(words, row + i, sizeof(words));
+                for (int lane = 0; lane < 4; lane++) {
+                    lanes[lane] = (lanes[lane] ^ words[lane]) * PRIME;
+                }
+            }
+            for (; i < row_bytes; i++) {
+                lanes[0] = (lanes[0] ^ row[i]) * PRIME;
+            }
+        }
+    }
+
+    uint64_t hash = lanes[0];
+    for (int lane = 1; lane < 4; lane++) {
+        hash = (hash ^ lanes[lane]) * PRIME;
+    }
+    return hash;
+}
+
+// Sum the absolute differences of a row of samples
+template <typename T>
+static uint64_t row_abs_diff(const uint8_t *a, const uint8_t *b, size_t row_bytes) {
+    const T *sa = reinterpret_cast<const T *>(a);
+    const T *sb = reinterpret_cast<const T *>(b);
+    size_t samples = row_bytes / sizeof(T);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < samples; i++) {
+        sum += static_cast<uint64_t>(std::abs(static_cast<int>(sa[i]) - static_cast<int>(sb[i])));
+    }
+    return sum;
+}
+
+bool frames_match(const AVFrame *a, const AVFrame *b, double max_mean_diff) {
+    if (a->format != b->format || a->width != b->width || a->height != b->height) {
+        return false;
+    }
+    PlaneLayout layout;
+    if (!get_plane_layout(a, layout)) {
+        return false;
+    }
+
+    // Identical frames can be compared row by row with memcmp
+    if (max_mean_diff <= 0) {
+        for (int plane = 0; plane < layout.count; plane++) {
+            for (int y = 0; y < layout.rows[plane]; y++) {
+                if (memcmp(
+                        a->data[plane] + static_cast<ptrdiff_t>(y) * a->linesize[plane],
+                        b->data[plane] + static_cast<ptrdiff_t>(y) * b->linesize[plane],
+                        static_cast<size_t>(layout.row_bytes[plane])
+                    ) != 0) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Samples deeper than 8 bits are compared on their own scale
+    size_t sample_size = layout.high_depth ? 2 : 1;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(a->format));
+    double scale = layout.high_depth ? static_cast<double>(1 << (desc->comp[0].depth - 8)) : 1.0;
+
+    uint64_t total_samples = 0;
+    for (int plane = 0; plane < layout.count; plane++) {
+        total_samples += static_cast<uint64_t>(layout.row_bytes[plane] / sample_size) *
+                         static_cast<uint64_t>(layout.rows[plane]);
+    }
+    double max_sum = max_mean_diff * scale * static_cast<double>(total_samples);
+
+    // Stop as soon as the frames are known to differ
+    uint64_t sum = 0;
+    for (int plane = 0; plane < layout.count; plane++) {
+        size_t row_bytes = static_cast<size_t>(layout.row_bytes[plane]);
+        for (int y = 0; y < layout.rows[plane]; y++) {
+            const uint8_t *row_a = a->data[plane] + static_cast<ptrdiff_t>(y) * a->linesize[plane];
+            const uint8_t *row_b = b->data[plane] + static_cast<ptrdiff_t>(y) * b->linesize[plane];
+            sum += layout.high_depth ? row_abs_diff<uint16_t>(row_a, row_b, row_bytes)
+                                     : row_abs_diff<uint8_t>(row_a, row_b, row_bytes);
+            if (static_cast<double>(sum) > max_sum) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Sampling step of the complexity measures in each direction
+static constexpr int COMPLEXITY_STEP = 2;
+
+template <typename T>
+static void measure_luma_complexity(
+    const AVFrame *frame,
+    const AVFrame *prev_frame,
+    double scale,
+    FrameComplexity &complexity
+) {
+    uint64_t gradient_sum = 0;
+    uint64_t diff_sum = 0;
+    double luma_sum = 0;
+    double luma_square_sum = 0;
+    uint64_t samples = 0;
+
+    for (int y = 0; y + 1 < frame->height; y += COMPLEXITY_STEP) {
+        const T *row = reinterpret_cast<const T *>(
+            frame->data[0] + static_cast<ptrdiff_t>(y) * frame->linesize[0]
+        );
+        const T *next_row = reinterpret_cast<const T *>(
+            frame->data[0] + static_cast<ptrdiff_t>(y + 1) * frame->linesize[0]
+        );
+        const T *prev_row = nullptr;
+        if (prev_frame != nullptr) {
+            prev_row = reinterpret_cast<const T *>(
+                prev_frame->data[0] + static_cast<ptrdiff_t>(y) * prev_frame->linesize[0]
+            );
+        }
+
+        for (int x = 0; x + 1 < frame->width; x += COMPLEXITY_STEP) {
+            int luma = row[x];
+            gradient_sum += static_cast<uint64_t>(std::abs(luma - static_cast<int>(row[x + 1]))) +
+                            static_cast<uint64_t>(std::abs(luma - static_cast<int>(next_row[x])));
+            if (prev_row != nullptr) {
+                diff_sum += static_cast<uint64_t>(std::abs(luma - static_cast<int>(prev_row[x])));
+            }
+            luma_sum += luma;
+            luma_square_sum += static_cast<double>(luma) * luma;
+            samples++;
+        }
+    }
+
+    if (samples == 0) {
+        complexity = {0, 0, 0, 0};
+        return;
+    }
+    double count = static_cast<double>(samples);
+    double mean = luma_sum / count;
+    complexity.brightness = mean / scale;
+    complexity.edges = static_cast<double>(gradient_sum) / (2 * count) / scale;
+    complexity.deviation = std::sqrt(std::max(luma_square_sum / count - mean * mean, 0.0)) / scale;
+    complexity.motion = static_cast<double>(diff_sum) / count / scale;
+}
+
+bool measure_frame_complexity(
+    const AVFrame *frame,
+    const AVFrame *prev_frame,
+    FrameComplexity &complexity
+) {
+    if (!is_frame_analyzable(frame)) {
+        return false;
+    }
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    if (desc->flags & AV_PIX_FMT_FLAG_RGB) {
+        return false;
+    }
+
+    if (prev_frame != nullptr &&
+        (prev_frame->format != frame->format || prev_frame->width != frame->width ||
+         prev_frame->height != frame->height)) {
+        prev_frame = nullptr;
+    }
+
+    int depth = desc->comp[0].depth;
+    if (depth > 8) {
+        double scale = static_cast<double>(1 << (depth - 8));
+        measure_luma_complexity<uint16_t>(frame, prev_frame, scale, complexity);
+    } else {
+        measure_luma_complexity<uint8_t>(frame, prev_frame, 1.0, complexity);
+    }
+    return true;
+}
@@ -0,0 +1,169 @@
+#include "frame_pool.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+#include <spdlog/spdlog.h>
+
+// Alignment of the frame planes and lines
+static constexpr int FRAME_ALIGN = 32;
+
+// Extra bytes after each frame buffer for optimized routines that read past the last line
+static constexpr size_t FRAME_PADDING = 64;
+
+// Upper bound on the number of buffer sizes kept; the least recently used pool is released
+static constexpr size_t MAX_POOLS = 32;
+
+FramePool::MatAllocator::~MatAllocator() {
+    for (auto &entry : buffers_) {
+        av_buffer_unref(&entry.second);
+    }
+}
+
+void *FramePool::MatAllocator::fastMalloc(size_t size) {
+    // ncnn's optimized routines may read past the end of a Mat, so its allocators pad each buffer
+    AVBufferRef *buf = pool_.get_buffer(size + NCNN_MALLOC_OVERREAD);
+    if (buf == nullptr) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_[buf->data] = buf;
+    return buf->data;
+}
+
+void FramePool::MatAllocator::fastFree(void *ptr) {
+    AVBufferRef *buf = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = buffers_.find(ptr);
+        if (it == buffers_.end()) {
+            spdlog::error("Freeing a buffer that was not allocated from the frame pool");
+            return;
+        }
+        buf = it->second;
+        buffers_.erase(it);
+    }
+    av_buffer_unref(&buf);
+}
+
+FramePool &FramePool::get_instance() {
+    static FramePool instance;
+    return instance;
+}
+
+FramePool::~FramePool() {
+    clear();
+}
+
+AVBufferRef *FramePool::alloc_buffer(void *opaque, size_t size) {
+    static_cast<FramePool *>(opaque)->misses_++;
+    return av_buffer_alloc(size);
+}
+
+AVBufferRef *FramePool::get_buffer(size_t size) {
+    requests_++;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pools_.begin();
+    while (it != pools_.end() && it->first != size) {
+        ++it;
+    }
+
+    AVBufferPool *pool = nullptr;
+    if (it != pools_.end()) {
+        // Move the pool to the back to keep the list ordered by recent use
+        pool = it->second;
+        pools_.erase(it);
+    } else {
+        pool = av_buffer_pool_init2(size, this, alloc_buffer, nullptr);
+        if (pool == nullptr) {
+            spdlog::error("Failed to create a buffer pool of {} bytes", size);
+            return nullptr;
+        }
+        if (pools_.size() >= MAX_POOLS) {
+            // Buffers still in use remain valid; the pool is freed once they are returned
+            av_buffer_pool_uninit(&pools_.front().second);
+            pools_.erase(pools_.begin());
+        }
+    }
+    pools_.emplace_back(size, pool);
+
+    AVBufferRef *buf = av_buffer_pool_get(pool);
+    if (buf == nullptr) {
+        spdlog::error("Failed to allocate a buffer of {} bytes", size);
+    }
+    return buf;
+}
+
+AVFrame *FramePool::alloc_frame(AVPixelFormat pix_fmt, int width, int height) {
+    int size = av_image_get_buffer_size(pix_fmt, width, height, FRAME_ALIGN);
+    if (size < 0) {
+        spdlog::error(
+            "Cannot allocate {}x{} frames in pixel format {}",
+            width,
+            height,
+            static_cast<int>(pix_fmt)
+        );
+        return nullptr;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    if (frame == nullptr) {
+        spdlog::error("Failed to allocate AVFrame.");
+        return nullptr;
+    }
+    frame->format = pix_fmt;
+    frame->width = width;
+    frame->height = height;
+
+    frame->buf[0] = get_buffer(static_cast<size_t>(size) + FRAME_PADDING);
+    if (frame->buf[0] == nullptr) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    int ret = av_image_fill_arrays(
+        frame->data, frame->linesize, frame->buf[0]->data, pix_fmt, width, height, FRAME_ALIGN
+    );
+    if (ret < 0) {
+        spdlog::error("Failed to set up the planes of a pooled frame");
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    return frame;
+}
+
+void FramePool::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : pools_) {
+        av_buffer_pool_uninit(&entry.second);
+    }
+    pools_.clear();
+}
+
+void FramePool::begin_job() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_jobs_++;
+}
+
+void FramePool::end_job() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_jobs_ > 0) {
+            return;
+        }
+    }
+    clear();
+}
+
+void FramePool::log_stats(const Stats &since) const {
+    Stats stats = get_stats();
+    int64_t requests = stats.requests - since.requests;
+    if (requests == 0) {
+        return;
+    }
+    int64_t misses = stats.misses - since.misses;
+    spdlog::debug("Frame buffer pool: {} hits, {} misses", requests - misses, misses);
+}
@@ -0,0 +1,213 @@
+#include "fused_conversion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#include <spdlog/spdlog.h>
+
+// Fractional bits of the fixed-point coefficients
+static constexpr int COEFF_BITS = 16;
+
+// Chroma samples are a weighted sum of 8 source pixels (see convert_rows)
+static constexpr int CHROMA_WEIGHT_BITS = 3;
+
+// Fixed-point BGR to YUV coefficients for one color space, range, and bit depth
+struct YuvCoefficients {
+    int y_r, y_g, y_b;
+    int u_r, u_g, u_b;
+    int v_r, v_g, v_b;
+    int y_offset;
+    int c_offset;
+    int max_value;
+};
+
+// Memory layout of a supported output format
+struct Yuv420Layout {
+    int depth;
+    // Left shift of the samples within their 16-bit words (MSB-aligned formats)
+    int shift;
+    // Chroma is stored as interleaved UV pairs in a single plane
+    bool semi_planar;
+};
+
+static bool get_layout(AVPixelFormat pix_fmt, Yuv420Layout &layout) {
+    switch (pix_fmt) {
+        case AV_PIX_FMT_YUV420P:
+            layout = {8, 0, false};
+            return true;
+        case AV_PIX_FMT_NV12:
+            layout = {8, 0, true};
+            return true;
+        case AV_PIX_FMT_YUV420P10:
+            layout = {10, 0, false};
+            return true;
+        case AV_PIX_FMT_P010:
+            layout = {10, 6, true};
+            return true;
+        default:
+            return false;
+    }
+}
+
+void get_luma_weights(AVColorSpace colorspace, double &kr, double &kb) {
+    switch (colorspace) {
+        case AVCOL_SPC_BT709:
+            kr = 0.2126;
+            kb = 0.0722;
+            break;
+        case AVCOL_SPC_BT2020_NCL:
+        case AVCOL_SPC_BT2020_CL:
+            kr = 0.2627;
+            kb = 0.0593;
+            break;
+        case AVCOL_SPC_FCC:
+            kr = 0.30;
+            kb = 0.11;
+            break;
+        case AVCOL_SPC_SMPTE240M:
+            kr = 0.212;
+            kb = 0.087;
+            break;
+        default:
+            kr = 0.299;
+            kb = 0.114;
+            break;
+    }
+}
+
+static YuvCoefficients
+get_coefficients(AVColorSpace colorspace, AVColorRange color_range, int depth) {
+    double kr, kb;
+    get_luma_weights(colorspace, kr, kb);
+    double kg = 1.0 - kr - kb;
+
+    int max_value = (1 << depth) - 1;
+    bool full_range = color_range == AVCOL_RANGE_JPEG;
+    double y_scale = (full_range ? max_value : 219 << (depth - 8)) / 255.0 * (1 << COEFF_BITS);
+    double c_scale = (full_range ? max_value : 224 << (depth - 8)) / 255.0 * (1 << COEFF_BITS);
+    auto fixed = [](double value) { return static_cast<int>(std::lround(value)); };
+
+    YuvCoefficients coeffs;
+    coeffs.y_r = fixed(kr * y_scale);
+    coeffs.y_g = fixed(kg * y_scale);
+    coeffs.y_b = fixed(kb * y_scale);
+    coeffs.u_r = fixed(-kr / (2.0 * (1.0 - kb)) * c_scale);
+    coeffs.u_g = fixed(-kg / (2.0 * (1.0 - kb)) * c_scale);
+    coeffs.u_b = fixed(0.5 * c_scale);
+    coeffs.v_r = fixed(0.5 * c_scale);
+    coeffs.v_g = fixed(-kg / (2.0 * (1.0 - kr)) * c_scale);
+    coeffs.v_b = fixed(-kb / (2.0 * (1.0 - kr)) * c_scale);
+    coeffs.y_offset = full_range ? 0 : 16 << (depth - 8);
+    coeffs.c_offset = 1 << (depth - 1);
+    coeffs.max_value = max_value;
+    return coeffs;
+}
+
+// Convert pairs of rows; T is the sample type of the output planes
+// Chroma is sited to the left like MPEG-2 and H.264: each sample weighs the even column by 1/2
+// and its horizontal neighbors by 1/4, averaged over both rows.
+template <typename T>
+static void convert_rows(
+    const uint8_t *src,
+    int src_linesize,
+    AVFrame *dst_frame,
+    const YuvCoefficients &coeffs,
+    const Yuv420Layout &layout
+) {
+    const int width = dst_frame->width;
+    const int height = dst_frame->height;
+    const int y_bias = (coeffs.y_offset << COEFF_BITS) + (1 << (COEFF_BITS - 1));
+    const int c_bits = COEFF_BITS + CHROMA_WEIGHT_BITS;
+    const int c_bias = (coeffs.c_offset << c_bits) + (1 << (c_bits - 1));
+    const int c_step = layout.semi_planar ? 2 : 1;
+
+    auto store = [&](int value) {
+        return static_cast<T>(std::clamp(value, 0, coeffs.max_value) << layout.shift);
+    };
+    auto luma = [&](const uint8_t *pixel) {
+        return store(
+            (coeffs.y_b * pixel[0] + coeffs.y_g * pixel[1] + coeffs.y_r * pixel[2] + y_bias) >>
+            COEFF_BITS
+        );
+    };
+
+    for (int y = 0; y < height; y += 2) {
+        // The last row of an odd height is paired with itself
+        int y1 = std::min(y + 1, height - 1);
+        const uint8_t *src_row0 = src + static_cast<ptrdiff_t>(y) * src_linesize;
+        const uint8_t *src_row1 = src + static_cast<ptrdiff_t>(y1) * src_linesize;
+        T *dst_y0 = reinterpret_cast<T *>(
+            dst_frame->data[0] + static_cast<ptrdiff_t>(y) * dst_frame->linesize[0]
+        );
+        T *dst_y1 = reinterpret_cast<T *>(
+            dst_frame->data[0] + static_cast<ptrdiff_t>(y1) * dst_frame->linesize[0]
+        );
+        T *dst_u = reinterpret_cast<T *>(
+            dst_frame->data[1] + static_cast<ptrdiff_t>(y / 2) * dst_frame->linesize[1]
+        );
+        T *dst_v = dst_u + 1;
+        if (!layout.semi_planar) {
+            dst_v = reinterpret_cast<T *>(
+                dst_frame->data[2] + static_cast<ptrdiff_t>(y / 2) * dst_frame->linesize[2]
+            );
+        }
+
+        for (int x = 0; x < width; x += 2) {
+            int x_prev = std::max(x - 1, 0) * 3;
+            int x0 = x * 3;
+            int x1 = std::min(x + 1, width - 1) * 3;
+
+            dst_y0[x] = luma(src_row0 + x0);
+            dst_y1[x] = luma(src_row1 + x0);
+            if (x + 1 < width) {
+                dst_y0[x + 1] = luma(src_row0 + x1);
+                dst_y1[x + 1] = luma(src_row1 + x1);
+            }
+
+            int sum[3];
+            for (int c = 0; c < 3; c++) {
+                sum[c] = src_row0[x_prev + c] + 2 * src_row0[x0 + c] + src_row0[x1 + c] +
+                         src_row1[x_prev + c] + 2 * src_row1[x0 + c] + src_row1[x1 + c];
+            }
+            int c_index = x / 2 * c_step;
+            dst_u[c_index] = store(
+                (coeffs.u_b * sum[0] + coeffs.u_g * sum[1] + coeffs.u_r * sum[2] + c_bias) >> c_bits
+            );
+            dst_v[c_index] = store(
+                (coeffs.v_b * sum[0] + coeffs.v_g * sum[1] + coeffs.v_r * sum[2] + c_bias) >> c_bits
+            );
+        }
+    }
+}
+
+bool is_fused_conversion_supported(AVPixelFormat pix_fmt) {
+    Yuv420Layout layout;
+    return get_layout(pix_fmt, layout);
+}
+
+int convert_bgr24_to_yuv420(
+    const uint8_t *src,
+    int src_linesize,
+    AVFrame *dst_frame,
+    AVColorSpace colorspace,
+    AVColorRange color_range
+) {
+    Yuv420Layout layout;
+    if (!get_layout(static_cast<AVPixelFormat>(dst_frame->format), layout)) {
+        spdlog::error("Fused conversion to pixel format {} is not supported", dst_frame->format);
+        return AVERROR(ENOSYS);
+    }
+
+    YuvCoefficients coeffs = get_coefficients(colorspace, color_range, layout.depth);
+    if (layout.depth > 8) {
+        convert_rows<uint16_t>(src, src_linesize, dst_frame, coeffs, layout);
+    } else {
+        convert_rows<uint8_t>(src, src_linesize, dst_frame, coeffs, layout);
+    }
+    return 0;
+}
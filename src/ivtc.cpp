@@ -0,0 +1,125 @@
+#include "ivtc.h"
+
+#include <string>
+
+extern "C" {
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <spdlog/spdlog.h>
+
+InverseTelecine::~InverseTelecine() {
+    if (filter_graph_) {
+        avfilter_graph_free(&filter_graph_);
+    }
+}
+
+int InverseTelecine::init(AVCodecContext *dec_ctx) {
+    int ret;
+
+    // Field matching needs access to the pixels
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(dec_ctx->pix_fmt);
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        spdlog::error("Inverse telecine requires software-decoded frames");
+        return AVERROR(ENOSYS);
+    }
+
+    filter_graph_ = avfilter_graph_alloc();
+    if (!filter_graph_) {
+        spdlog::error("Unable to create filter graph.");
+        return AVERROR(ENOMEM);
+    }
+
+    std::string args = "video_size=" + std::to_string(dec_ctx->width) + "x" +
+                       std::to_string(dec_ctx->height) +
+                       ":pix_fmt=" + std::to_string(dec_ctx->pix_fmt) +
+                       ":time_base=" + std::to_string(dec_ctx->time_base.num) + "/" +
+                       std::to_string(dec_ctx->time_base.den) +
+                       ":frame_rate=" + std::to_string(dec_ctx->framerate.num) + "/" +
+                       std::to_string(dec_ctx->framerate.den) +
+                       ":pixel_aspect=" + std::to_string(dec_ctx->sample_aspect_ratio.num) + "/" +
+                       std::to_string(dec_ctx->sample_aspect_ratio.den);
+    ret = avfilter_graph_create_filter(
+        &buffersrc_ctx_, avfilter_get_by_name("buffer"), "in", args.c_str(), NULL, filter_graph_
+    );
+    if (ret < 0) {
+        spdlog::error("Cannot create buffer source.");
+        return ret;
+    }
+
+    ret = avfilter_graph_create_filter(
+        &buffersink_ctx_, avfilter_get_by_name("buffersink"), "out", NULL, NULL, filter_graph_
+    );
+    if (ret < 0) {
+        spdlog::error("Cannot create buffer sink.");
+        return ret;
+    }
+
+    // Match fields, deinterlace what is still combed, drop one frame in every cycle, and keep
+    // the decoder's pixel format for the filters
+    std::string filters = "fieldmatch=order=auto:combmatch=full,yadif=deint=interlaced,"
+                          "decimate=cycle=" +
+                          std::to_string(CYCLE_LENGTH) + ",format=" +
+                          av_get_pix_fmt_name(dec_ctx->pix_fmt);
+
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+    if (!outputs || !inputs) {
+        avfilter_inout_free(&outputs);
+        avfilter_inout_free(&inputs);
+        return AVERROR(ENOMEM);
+    }
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = buffersrc_ctx_;
+    outputs->pad_idx = 0;
+    outputs->next = nullptr;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = buffersink_ctx_;
+    inputs->pad_idx = 0;
+    inputs->next = nullptr;
+
+    ret = avfilter_graph_parse_ptr(filter_graph_, filters.c_str(), &inputs, &outputs, NULL);
+    avfilter_inout_free(&outputs);
+    avfilter_inout_free(&inputs);
+    if (ret < 0) {
+        spdlog::error("Error creating the inverse telecine filters.");
+        return ret;
+    }
+
+    ret = avfilter_graph_config(filter_graph_, NULL);
+    if (ret < 0) {
+        spdlog::error("Error configuring the filter graph.");
+        return ret;
+    }
+
+    in_time_base_ = dec_ctx->time_base;
+    return 0;
+}
+
+int InverseTelecine::send_frame(AVFrame *frame) {
+    int ret = av_buffersrc_add_frame_flags(buffersrc_ctx_, frame, AV_BUFFERSRC_FLAG_KEEP_REF);
+    if (ret < 0) {
+        spdlog::error("Error sending frame to the inverse telecine filters");
+    }
+    return ret;
+}
+
+int InverseTelecine::receive_frame(AVFrame *frame) {
+    int ret = av_buffersink_get_frame(buffersink_ctx_, frame);
+    if (ret < 0) {
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            spdlog::error("Error receiving frame from the inverse telecine filters");
+        }
+        return ret;
+    }
+
+    // Decimation changes the time base; the filters expect the decoder's
+    if (frame->pts != AV_NOPTS_VALUE) {
+        frame->pts =
+            av_rescale_q(frame->pts, av_buffersink_get_time_base(buffersink_ctx_), in_time_base_);
+    }
+    return 0;
+}
@@ -3,7 +3,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <sstream>
 #include <thread>
+#include <vector>
 
 extern "C" {
 #include <libavutil/avutil.h>
@@ -11,21 +19,53 @@ extern "C" {
 
 #include <spdlog/spdlog.h>
 
+#include "autocrop.h"
 #include "avutils.h"
+#include "crop_filter.h"
 #include "decoder.h"
+#include "dedup_filter.h"
 #include "encoder.h"
+#include "estimator.h"
 #include "filter.h"
+#include "frame_pool.h"
+#include "fsutils.h"
+#include "ivtc.h"
 #include "libplacebo_filter.h"
+#include "memory_budget.h"
+#include "native_resolution.h"
+#include "packet_reader.h"
+#include "pipeline.h"
+#include "prescale_filter.h"
+#include "preview.h"
+#include "processing_control.h"
+#include "progress_counters.h"
 #include "realesrgan_filter.h"
+#include "roi_map.h"
+#include "routing_filter.h"
+#include "segment_journal.h"
+#include "segments.h"
+#include "stream_copier.h"
+#include "sws_cache.h"
+#include "video_analysis.h"
+
+// Number of frames sampled to detect black borders
+static constexpr int AUTOCROP_SAMPLES = 16;
+
+// Number of frames sampled to detect the native resolution
+static constexpr int PRESCALE_SAMPLES = 8;
 
 // Process frames using the selected filter.
+// Progress is also published to `progress` if it is not null.
 static int process_frames(
     EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
     VideoProcessingContext *proc_ctx,
     Decoder &decoder,
     Encoder &encoder,
     Filter *filter,
-    bool benchmark = false
+    MemoryBudget *memory_budget,
+    bool benchmark = false,
+    ProgressCounters *progress = nullptr
 ) {
     char errbuf[AV_ERROR_MAX_STRING_SIZE];
     int ret = 0;
@@ -34,19 +74,8 @@ static int process_frames(
     AVFormatContext *ifmt_ctx = decoder.get_format_context();
     AVCodecContext *dec_ctx = decoder.get_codec_context();
     int in_vstream_idx = decoder.get_video_stream_index();
-    AVFormatContext *ofmt_ctx = encoder.get_format_context();
     int *stream_map = encoder.get_stream_map();
 
-    // Get total number of frames
-    spdlog::debug("Reading total number of frames");
-    proc_ctx->total_frames = get_video_frame_count(ifmt_ctx, in_vstream_idx);
-
-    if (proc_ctx->total_frames <= 0) {
-        spdlog::warn("Unable to determine the total number of frames");
-    } else {
-        spdlog::debug("{} frames to process", proc_ctx->total_frames);
-    }
-
     // Allocate frame and packet
     auto av_frame_deleter = [](AVFrame *frame) { av_frame_free(&frame); };
     std::unique_ptr<AVFrame, decltype(av_frame_deleter)> frame(av_frame_alloc(), av_frame_deleter);
@@ -64,9 +93,100 @@ static int process_frames(
         return AVERROR(ENOMEM);
     }
 
+    // Demux ahead on a separate thread if enabled
+    PacketReader reader(
+        ifmt_ctx, in_vstream_idx, static_cast<size_t>(processing_config->prefetch_packets)
+    );
+    ret = reader.start();
+    if (ret < 0) {
+        return ret;
+    }
+
+    // Set once a frame past the end of the decoder's frame range has been decoded
+    bool end_of_range = false;
+
+    // Only one frame is in flight at a time; the budget is shared with concurrent segments
+    MemoryReservation memory(memory_budget);
+
+    // Restore progressive frames before filtering if enabled
+    std::unique_ptr<InverseTelecine> ivtc;
+    AVFramePtr ivtc_frame;
+    if (processing_config->inverse_telecine) {
+        ivtc = std::make_unique<InverseTelecine>();
+        ret = ivtc->init(dec_ctx);
+        if (ret < 0) {
+            spdlog::critical("Failed to initialize inverse telecine");
+            return ret;
+        }
+        ivtc_frame.reset(av_frame_alloc());
+        if (!ivtc_frame) {
+            spdlog::critical("Could not allocate AVFrame");
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    // Filter, encode, and write a single frame
+    // Returns AVERROR_EXIT if processing was aborted partway through the frame.
+    auto filter_frame = [&](AVFrame *in_frame) -> int {
+        int64_t frame_memory = estimate_frame_memory(in_frame, encoder.get_encoder_context());
+        memory.acquire(frame_memory);
+
+        AVFrame *raw_processed_frame = nullptr;
+        int filter_ret = filter->process_frame(in_frame, &raw_processed_frame);
+
+        if (filter_ret == AVERROR_EXIT && proc_ctx->control->is_aborted()) {
+            return AVERROR_EXIT;
+        } else if (filter_ret < 0 && filter_ret != AVERROR(EAGAIN)) {
+            return filter_ret;
+        } else if (filter_ret == 0 && raw_processed_frame != nullptr) {
+            AVFramePtr processed_frame(raw_processed_frame);
+            if (!benchmark) {
+                filter_ret = encoder.write_frame(processed_frame.get(), proc_ctx->processed_frames);
+                if (filter_ret < 0) {
+                    av_strerror(filter_ret, errbuf, sizeof(errbuf));
+                    spdlog::critical("Error encoding/writing frame: {}", errbuf);
+                    return filter_ret;
+                }
+            }
+            proc_ctx->processed_frames++;
+            if (progress != nullptr) {
+                progress->processed_frames = proc_ctx->processed_frames;
+            }
+        }
+
+        memory.release(frame_memory);
+        spdlog::debug("Processed frame {}/{}", proc_ctx->processed_frames, proc_ctx->total_frames);
+        return 0;
+    };
+
+    // Filter a decoded frame, or the frames the inverse telecine stage returns for it
+    // A null frame flushes the inverse telecine stage.
+    auto process_decoded_frame = [&](AVFrame *in_frame) -> int {
+        if (!ivtc) {
+            return filter_frame(in_frame);
+        }
+
+        int ivtc_ret = ivtc->send_frame(in_frame);
+        while (ivtc_ret >= 0) {
+            ivtc_ret = ivtc->receive_frame(ivtc_frame.get());
+            if (ivtc_ret == AVERROR(EAGAIN) || ivtc_ret == AVERROR_EOF) {
+                return 0;
+            } else if (ivtc_ret < 0) {
+                break;
+            }
+            ivtc_ret = filter_frame(ivtc_frame.get());
+            av_frame_unref(ivtc_frame.get());
+        }
+        return ivtc_ret;
+    };
+
     // Read frames from the input file
-    while (!proc_ctx->abort) {
-        ret = av_read_frame(ifmt_ctx, packet.get());
+    while (!proc_ctx->control->is_aborted() && !end_of_range) {
+        ret = reader.read_packet(packet.get());
+        proc_ctx->prefetch_depth = static_cast<int64_t>(reader.depth());
+        if (progress != nullptr) {
+            progress->prefetch_depth = proc_ctx->prefetch_depth;
+        }
         if (ret < 0) {
             if (ret == AVERROR_EOF) {
                 spdlog::debug("Reached end of file");
@@ -86,12 +206,8 @@ static int process_frames(
                 return ret;
             }
 
-            while (!proc_ctx->abort) {
-                if (proc_ctx->pause) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    continue;
-                }
-
+            // Block while paused and stop receiving frames once aborted
+            while (proc_ctx->control->wait_if_paused()) {
                 ret = avcodec_receive_frame(dec_ctx, frame.get());
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                     spdlog::debug("Frame not ready");
@@ -103,45 +219,29 @@ static int process_frames(
                     return ret;
                 }
 
-                AVFrame *raw_processed_frame = nullptr;
-                ret = filter->process_frame(frame.get(), &raw_processed_frame);
+                // Skip frames outside of the range being processed
+                if (decoder.is_before_range(frame.get())) {
+                    av_frame_unref(frame.get());
+                    continue;
+                }
+                if (decoder.is_past_range(frame.get())) {
+                    av_frame_unref(frame.get());
+                    end_of_range = true;
+                    break;
+                }
 
-                if (ret < 0 && ret != AVERROR(EAGAIN)) {
-                    av_strerror(ret, errbuf, sizeof(errbuf));
+                ret = process_decoded_frame(frame.get());
+                av_frame_unref(frame.get());
+                if (ret == AVERROR_EXIT) {
+                    // The filter stopped partway through the frame
+                    break;
+                } else if (ret < 0) {
                     av_packet_unref(packet.get());
                     return ret;
-                } else if (ret == 0 && raw_processed_frame != nullptr) {
-                    auto processed_frame = std::unique_ptr<AVFrame, decltype(av_frame_deleter)>(
-                        raw_processed_frame, av_frame_deleter
-                    );
-
-                    if (!benchmark) {
-                        ret =
-                            encoder.write_frame(processed_frame.get(), proc_ctx->processed_frames);
-                        if (ret < 0) {
-                            av_strerror(ret, errbuf, sizeof(errbuf));
-                            spdlog::critical("Error encoding/writing frame: {}", errbuf);
-                            av_packet_unref(packet.get());
-                            return ret;
-                        }
-                    }
-                    proc_ctx->processed_frames++;
                 }
-
-                av_frame_unref(frame.get());
-                spdlog::debug(
-                    "Processed frame {}/{}", proc_ctx->processed_frames, proc_ctx->total_frames
-                );
             }
         } else if (encoder_config->copy_streams && stream_map[packet->stream_index] >= 0) {
-            AVStream *in_stream = ifmt_ctx->streams[packet->stream_index];
-            int out_stream_index = stream_map[packet->stream_index];
-            AVStream *out_stream = ofmt_ctx->streams[out_stream_index];
-
-            av_packet_rescale_ts(packet.get(), in_stream->time_base, out_stream->time_base);
-            packet->stream_index = out_stream_index;
-
-            ret = av_interleaved_write_frame(ofmt_ctx, packet.get());
+            ret = encoder.copy_packet(packet.get(), ifmt_ctx);
             if (ret < 0) {
                 av_strerror(ret, errbuf, sizeof(errbuf));
                 spdlog::critical("Error muxing audio/subtitle packet: {}", errbuf);
@@ -152,6 +252,25 @@ static int process_frames(
         av_packet_unref(packet.get());
     }
 
+    reader.stop();
+    reader.log_stats();
+    proc_ctx->prefetch_depth = 0;
+    proc_ctx->peak_prefetch_depth = static_cast<int64_t>(reader.peak_depth());
+    if (progress != nullptr) {
+        progress->prefetch_depth = 0;
+        progress->peak_prefetch_depth = proc_ctx->peak_prefetch_depth;
+    }
+
+    // Filter the frames still held by the inverse telecine stage
+    if (ivtc && !proc_ctx->control->is_aborted()) {
+        ret = process_decoded_frame(nullptr);
+        if (ret < 0 && ret != AVERROR_EXIT) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error flushing inverse telecine: {}", errbuf);
+            return ret;
+        }
+    }
+
     // Flush the filter
     std::vector<AVFrame *> raw_flushed_frames;
     ret = filter->flush(raw_flushed_frames);
@@ -176,6 +295,9 @@ static int process_frames(
             return ret;
         }
         proc_ctx->processed_frames++;
+        if (progress != nullptr) {
+            progress->processed_frames = proc_ctx->processed_frames;
+        }
     }
 
     // Flush the encoder
@@ -189,182 +311,1287 @@ static int process_frames(
     return ret;
 }
 
-extern "C" int process_video(
-    const CharType *in_fname,
-    const CharType *out_fname,
-    Libvideo2xLogLevel log_level,
-    bool benchmark,
-    uint32_t vk_device_index,
-    AVHWDeviceType hw_type,
+// Create a filter instance based on the filter configuration.
+static std::unique_ptr<Filter>
+create_filter(const FilterConfig *filter_config, uint32_t vk_device_index) {
+    if (filter_config->filter_type == FILTER_LIBPLACEBO) {
+        const auto &config = filter_config->config.libplacebo;
+        if (!config.shader_path) {
+            spdlog::critical("Shader path must be provided for the libplacebo filter");
+            return nullptr;
+        }
+        return std::make_unique<LibplaceboFilter>(
+            vk_device_index,
+            std::filesystem::path(config.shader_path),
+            config.out_width,
+            config.out_height
+        );
+    } else if (filter_config->filter_type == FILTER_REALESRGAN) {
+        const auto &config = filter_config->config.realesrgan;
+        if (!config.model_name) {
+            spdlog::critical("Model name must be provided for the RealESRGAN filter");
+            return nullptr;
+        }
+        return std::make_unique<RealesrganFilter>(
+            static_cast<int>(vk_device_index),
+            config.tta_mode,
+            config.scaling_factor,
+            config.model_name
+        );
+    }
+
+    spdlog::critical("Unknown filter type");
+    return nullptr;
+}
+
+// Create and initialize one filter instance per filter worker.
+// `in_start_pts` is the start time of the input video stream in the decoder's time base.
+static int init_filters(
     const FilterConfig *filter_config,
-    EncoderConfig *encoder_config,
-    VideoProcessingContext *proc_ctx
+    const ProcessingConfig *processing_config,
+    const VideoAnalysis *analysis,
+    uint32_t vk_device_index,
+    AVCodecContext *dec_ctx,
+    int64_t in_start_pts,
+    AVCodecContext *enc_ctx,
+    AVBufferRef *hw_ctx,
+    ProcessingControl *control,
+    std::vector<std::unique_ptr<Filter>> &filters
 ) {
-    char errbuf[AV_ERROR_MAX_STRING_SIZE];
-    int ret = 0;
+    // Determine the number of filter workers
+    int filter_workers = std::max(processing_config->filter_workers, 1);
+    if (filter_workers > 1 && filter_config->filter_type == FILTER_LIBPLACEBO) {
+        spdlog::warn("The libplacebo filter does not support multiple workers; using 1 worker");
+        filter_workers = 1;
+    }
 
-    // Set the log level for FFmpeg and spdlog
-    switch (log_level) {
-        case LIBVIDEO2X_LOG_LEVEL_TRACE:
-            av_log_set_level(AV_LOG_TRACE);
-            spdlog::set_level(spdlog::level::trace);
-            break;
-        case LIBVIDEO2X_LOG_LEVEL_DEBUG:
-            av_log_set_level(AV_LOG_DEBUG);
-            spdlog::set_level(spdlog::level::debug);
-            break;
-        case LIBVIDEO2X_LOG_LEVEL_INFO:
-            av_log_set_level(AV_LOG_INFO);
-            spdlog::set_level(spdlog::level::info);
-            break;
-        case LIBVIDEO2X_LOG_LEVEL_WARNING:
-            av_log_set_level(AV_LOG_WARNING);
-            spdlog::set_level(spdlog::level::warn);
-            break;
-        case LIBVIDEO2X_LOG_LEVEL_ERROR:
-            av_log_set_level(AV_LOG_ERROR);
-            spdlog::set_level(spdlog::level::err);
-            break;
-        case LIBVIDEO2X_LOG_LEVEL_CRITICAL:
-            av_log_set_level(AV_LOG_FATAL);
-            spdlog::set_level(spdlog::level::critical);
-            break;
-        case LIBVIDEO2X_LOG_LEVEL_OFF:
-            av_log_set_level(AV_LOG_QUIET);
-            spdlog::set_level(spdlog::level::off);
-            break;
-        default:
-            av_log_set_level(AV_LOG_INFO);
-            spdlog::set_level(spdlog::level::info);
-            break;
+    // Workers take frames from a shared queue, so only a single worker sees consecutive frames
+    if (filter_workers > 1 && processing_config->dedup_frames) {
+        spdlog::warn("Deduplication compares consecutive frames; using 1 worker");
+        filter_workers = 1;
     }
 
-    // Convert the file names to std::filesystem::path
-    std::filesystem::path in_fpath(in_fname);
-    std::filesystem::path out_fpath(out_fname);
+    bool prescale = processing_config->prescale_factor > 1.0;
+    if (prescale && filter_config->filter_type != FILTER_REALESRGAN) {
+        spdlog::warn("Downscaling before filtering is only supported with the RealESRGAN filter");
+        prescale = false;
+    }
 
-    auto hw_ctx_deleter = [](AVBufferRef *ref) {
-        if (ref) {
-            av_buffer_unref(&ref);
+    // Scenes are routed by the cuts found in the analysis pass
+    bool route = processing_config->route_by_complexity && analysis != nullptr;
+    if (route && filter_config->filter_type != FILTER_REALESRGAN) {
+        spdlog::warn("Complexity routing is only supported with the RealESRGAN filter");
+        route = false;
+    }
+
+    // Regions of interest are given in input coordinates, so the frames must reach the filter
+    // unchanged
+    std::shared_ptr<RoiMap> roi_map;
+    if (processing_config->roi_rect_count > 0 || processing_config->roi_sidecar != nullptr) {
+        if (filter_config->filter_type != FILTER_REALESRGAN) {
+            spdlog::warn("Regions of interest are only supported with the RealESRGAN filter");
+        } else if (prescale || processing_config->autocrop != AUTOCROP_NONE) {
+            spdlog::warn("Regions of interest cannot be combined with cropping or downscaling");
+        } else {
+            roi_map = std::make_shared<RoiMap>();
+            for (int i = 0; i < processing_config->roi_rect_count; i++) {
+                roi_map->add_static_region(processing_config->roi_rects[i]);
+            }
+            if (processing_config->roi_sidecar != nullptr) {
+                int ret = roi_map->load_sidecar(processing_config->roi_sidecar);
+                if (ret < 0) {
+                    spdlog::critical("Failed to load the regions of interest");
+                    return ret;
+                }
+            }
         }
+    }
+
+    // Cropped frames are scaled to the matching part of the configured output size
+    bool crop = processing_config->autocrop != AUTOCROP_NONE && processing_config->crop_width > 0;
+    CropRect crop_rect = {
+        processing_config->crop_x,
+        processing_config->crop_y,
+        processing_config->crop_width,
+        processing_config->crop_height
     };
-    std::unique_ptr<AVBufferRef, decltype(hw_ctx_deleter)> hw_ctx(nullptr, hw_ctx_deleter);
+    FilterConfig cropped_filter_config = *filter_config;
+    if (crop && filter_config->filter_type == FILTER_LIBPLACEBO) {
+        LibplaceboConfig &libplacebo_config = cropped_filter_config.config.libplacebo;
+        get_cropped_output_size(
+            crop_rect,
+            dec_ctx->width,
+            dec_ctx->height,
+            libplacebo_config.out_width,
+            libplacebo_config.out_height,
+            libplacebo_config.out_width,
+            libplacebo_config.out_height
+        );
+    }
 
-    // Initialize hardware device context
-    if (hw_type != AV_HWDEVICE_TYPE_NONE) {
-        AVBufferRef *tmp_hw_ctx = nullptr;
-        ret = av_hwdevice_ctx_create(&tmp_hw_ctx, hw_type, NULL, NULL, 0);
+    for (int i = 0; i < filter_workers; i++) {
+        std::unique_ptr<Filter> filter = create_filter(&cropped_filter_config, vk_device_index);
+        if (filter == nullptr) {
+            spdlog::critical("Failed to create filter instance");
+            return -1;
+        }
+
+        if (roi_map) {
+            static_cast<RealesrganFilter *>(filter.get())->set_roi_map(roi_map, in_start_pts);
+        }
+        if (filter_config->filter_type == FILTER_REALESRGAN) {
+            RealesrganFilter *realesrgan_filter = static_cast<RealesrganFilter *>(filter.get());
+            realesrgan_filter->set_reuse_sws_contexts(!processing_config->disable_sws_cache);
+            realesrgan_filter->set_fused_output_conversion(
+                processing_config->fused_output_conversion
+            );
+        }
+
+        // Upscaled masters are filtered at their native resolution
+        if (prescale) {
+            filter = std::make_unique<PrescaleFilter>(
+                std::move(filter),
+                filter_config->config.realesrgan.scaling_factor,
+                processing_config->prescale_factor,
+                !processing_config->disable_sws_cache
+            );
+        }
+
+        // Scenes with little detail bypass the filter
+        if (route) {
+            filter = std::make_unique<RoutingFilter>(
+                std::move(filter),
+                filter_config->config.realesrgan.scaling_factor,
+                processing_config->route_threshold,
+                *analysis,
+                !processing_config->disable_sws_cache
+            );
+        }
+
+        if (crop) {
+            filter = std::make_unique<CropFilter>(
+                std::move(filter), crop_rect, processing_config->autocrop == AUTOCROP_PAD
+            );
+        }
+
+        // Repeated frames reuse the previous output instead of reaching the filter
+        if (processing_config->dedup_frames) {
+            filter = std::make_unique<DedupFilter>(
+                std::move(filter), processing_config->dedup_threshold, analysis
+            );
+        }
+
+        int ret = filter->init(dec_ctx, enc_ctx, hw_ctx);
         if (ret < 0) {
-            av_strerror(ret, errbuf, sizeof(errbuf));
-            spdlog::critical("Error initializing hardware device context: {}", errbuf);
+            spdlog::critical("Failed to initialize filter");
             return ret;
         }
-        hw_ctx.reset(tmp_hw_ctx);
+        filter->set_processing_control(control);
+        filters.push_back(std::move(filter));
+    }
+    return 0;
+}
+
+// Process frames with the serial or pipelined loop depending on the processing configuration.
+static int run_frame_processing(
+    EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    Encoder &encoder,
+    std::vector<std::unique_ptr<Filter>> &filters,
+    MemoryBudget *memory_budget,
+    bool benchmark,
+    ProgressCounters *progress = nullptr
+) {
+    // Multiple and adaptively scheduled filter workers always run in the pipelined mode
+    if (processing_config->pipelined || processing_config->adaptive_workers ||
+        filters.size() > 1) {
+        return process_frames_pipelined(
+            encoder_config,
+            processing_config,
+            proc_ctx,
+            decoder,
+            encoder,
+            filters,
+            memory_budget,
+            benchmark,
+            progress
+        );
     }
+    return process_frames(
+        encoder_config,
+        processing_config,
+        proc_ctx,
+        decoder,
+        encoder,
+        filters.front().get(),
+        memory_budget,
+        benchmark,
+        progress
+    );
+}
 
-    // Initialize input decoder
+// Process the frames of a single segment into the segment's intermediate file.
+// The segment's progress is published to `progress` for the thread aggregating all segments.
+static int process_segment(
+    const std::filesystem::path &in_fpath,
+    const Segment &segment,
+    bool benchmark,
+    uint32_t vk_device_index,
+    AVHWDeviceType hw_type,
+    AVBufferRef *hw_ctx,
+    const FilterConfig *filter_config,
+    const EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
+    VideoProcessingContext *proc_ctx,
+    ProgressCounters *progress,
+    MemoryBudget *memory_budget,
+    const VideoAnalysis *analysis
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret = 0;
+
+    // Each segment has its own decoder positioned at the segment's first keyframe
     Decoder decoder;
-    ret = decoder.init(hw_type, hw_ctx.get(), in_fpath);
+    ret = decoder.init(hw_type, hw_ctx, in_fpath);
     if (ret < 0) {
         av_strerror(ret, errbuf, sizeof(errbuf));
         spdlog::critical("Failed to initialize decoder: {}", errbuf);
         return ret;
     }
 
-    AVFormatContext *ifmt_ctx = decoder.get_format_context();
-    AVCodecContext *dec_ctx = decoder.get_codec_context();
-    int in_vstream_idx = decoder.get_video_stream_index();
-
-    // Initialize output dimensions based on filter configuration
-    int output_width = 0, output_height = 0;
-    switch (filter_config->filter_type) {
-        case FILTER_LIBPLACEBO:
-            output_width = filter_config->config.libplacebo.out_width;
-            output_height = filter_config->config.libplacebo.out_height;
-            break;
-        case FILTER_REALESRGAN:
-            output_width = dec_ctx->width * filter_config->config.realesrgan.scaling_factor;
-            output_height = dec_ctx->height * filter_config->config.realesrgan.scaling_factor;
-            break;
-        default:
-            spdlog::critical("Unknown filter type");
-            return -1;
+    ret = decoder.set_frame_range(segment.start_pts, segment.end_pts);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Failed to seek to the start of the segment: {}", errbuf);
+        return ret;
     }
-    spdlog::debug("Output video dimensions: {}x{}", output_width, output_height);
 
-    // Update encoder configuration with output dimensions
-    encoder_config->out_width = output_width;
-    encoder_config->out_height = output_height;
+    // Audio and subtitle streams are muxed once when the segments are stitched together
+    EncoderConfig segment_encoder_config = *encoder_config;
+    segment_encoder_config.copy_streams = false;
 
-    // Initialize the encoder
     Encoder encoder;
-    ret = encoder.init(hw_ctx.get(), out_fpath, ifmt_ctx, dec_ctx, encoder_config, in_vstream_idx);
+    ret = encoder.init(
+        hw_ctx,
+        segment.fpath,
+        decoder.get_format_context(),
+        decoder.get_codec_context(),
+        &segment_encoder_config,
+        decoder.get_video_stream_index()
+    );
     if (ret < 0) {
         av_strerror(ret, errbuf, sizeof(errbuf));
         spdlog::critical("Failed to initialize encoder: {}", errbuf);
         return ret;
     }
+    encoder.set_reuse_sws_contexts(!processing_config->disable_sws_cache);
 
-    // Write the output file header
     ret = avformat_write_header(encoder.get_format_context(), NULL);
     if (ret < 0) {
         av_strerror(ret, errbuf, sizeof(errbuf));
-        spdlog::critical("Error occurred when opening output file: {}", errbuf);
+        spdlog::critical("Error occurred when opening segment file: {}", errbuf);
         return ret;
     }
 
-    // Create and initialize the appropriate filter
-    std::unique_ptr<Filter> filter;
-    if (filter_config->filter_type == FILTER_LIBPLACEBO) {
-        const auto &config = filter_config->config.libplacebo;
-        if (!config.shader_path) {
-            spdlog::critical("Shader path must be provided for the libplacebo filter");
-            return -1;
-        }
-        filter = std::make_unique<LibplaceboFilter>(
-            vk_device_index,
-            std::filesystem::path(config.shader_path),
-            config.out_width,
-            config.out_height
-        );
-    } else if (filter_config->filter_type == FILTER_REALESRGAN) {
-        const auto &config = filter_config->config.realesrgan;
-        if (!config.model_name) {
-            spdlog::critical("Model name must be provided for the RealESRGAN filter");
-            return -1;
-        }
-        filter = std::make_unique<RealesrganFilter>(
-            static_cast<int>(vk_device_index),
-            config.tta_mode,
-            config.scaling_factor,
-            config.model_name
-        );
-    } else {
-        spdlog::critical("Unknown filter type");
-        return -1;
+    std::vector<std::unique_ptr<Filter>> filters;
+    AVStream *in_stream = decoder.get_format_context()->streams[decoder.get_video_stream_index()];
+    ret = init_filters(
+        filter_config,
+        processing_config,
+        analysis,
+        vk_device_index,
+        decoder.get_codec_context(),
+        in_stream->start_time != AV_NOPTS_VALUE ? in_stream->start_time : 0,
+        encoder.get_encoder_context(),
+        hw_ctx,
+        proc_ctx->control,
+        filters
+    );
+    if (ret < 0) {
+        return ret;
     }
 
-    // Check if the filter instance was created successfully
+    ret = run_frame_processing(
+        &segment_encoder_config,
+        processing_config,
+        proc_ctx,
+        decoder,
+        encoder,
+        filters,
+        memory_budget,
+        benchmark,
+        progress
+    );
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error processing frames: {}", errbuf);
+        return ret;
+    }
+
+    av_write_trailer(encoder.get_format_context());
+    return 0;
+}
+
+// Describe the settings that determine the content of the segment files
+// A journal is only resumed with the same settings, so that the stitched segments match.
+static std::string get_settings_fingerprint(
+    const FilterConfig *filter_config,
+    const EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
+    int64_t start_pts,
+    int64_t end_pts
+) {
+    std::ostringstream oss;
+    if (filter_config->filter_type == FILTER_LIBPLACEBO) {
+        const LibplaceboConfig &config = filter_config->config.libplacebo;
+        oss << "filter=libplacebo width=" << config.out_width << " height=" << config.out_height
+            << " shader=" << path_to_u8string(config.shader_path);
+    } else {
+        const RealESRGANConfig &config = filter_config->config.realesrgan;
+        oss << "filter=realesrgan scale=" << config.scaling_factor << " tta=" << config.tta_mode
+            << " model=" << path_to_u8string(config.model_name);
+    }
+
+    const char *preset = encoder_config->preset != nullptr ? encoder_config->preset : "";
+    oss << " codec=" << encoder_config->codec << " pix_fmt=" << encoder_config->pix_fmt
+        << " preset=" << preset << " bit_rate=" << encoder_config->bit_rate
+        << " crf=" << encoder_config->crf << " out_width=" << encoder_config->out_width
+        << " out_height=" << encoder_config->out_height
+        << " frame_rate=" << encoder_config->frame_rate.num << '/' << encoder_config->frame_rate.den
+        << " range=" << start_pts << '-' << end_pts;
+
+    oss << " dedup=" << processing_config->dedup_frames << '/' << processing_config->dedup_threshold
+        << " ivtc=" << processing_config->inverse_telecine
+        << " autocrop=" << processing_config->autocrop << " crop=" << processing_config->crop_x
+        << ',' << processing_config->crop_y << ',' << processing_config->crop_width << ','
+        << processing_config->crop_height << " route=" << processing_config->route_by_complexity
+        << '/' << processing_config->route_threshold
+        << " fused=" << processing_config->fused_output_conversion
+        << " prescale=" << processing_config->prescale_auto << '/'
+        << processing_config->prescale_factor << " roi=";
+    for (int i = 0; i < processing_config->roi_rect_count; i++) {
+        const RoiRect &rect = processing_config->roi_rects[i];
+        oss << rect.x << ',' << rect.y << ',' << rect.width << ',' << rect.height << ';';
+    }
+    if (processing_config->roi_sidecar != nullptr) {
+        oss << " roi_sidecar=" << path_to_u8string(processing_config->roi_sidecar);
+    }
+    if (processing_config->analysis_sidecar != nullptr) {
+        oss << " analysis=" << path_to_u8string(processing_config->analysis_sidecar);
+    }
+    return oss.str();
+}
+
+// Split the input into keyframe-aligned segments, process them concurrently, and stitch the
+// results into the output file.
+// Completed segments are recorded in a journal so that an interrupted job can be resumed.
+static int process_video_segmented(
+    const std::filesystem::path &in_fpath,
+    const std::filesystem::path &out_fpath,
+    bool benchmark,
+    uint32_t vk_device_index,
+    AVHWDeviceType hw_type,
+    AVBufferRef *hw_ctx,
+    const FilterConfig *filter_config,
+    EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
+    VideoProcessingContext *proc_ctx,
+    MemoryBudget *memory_budget,
+    const VideoAnalysis *analysis,
+    int in_vstream_idx,
+    int64_t start_pts,
+    int64_t end_pts
+) {
+    int ret = 0;
+
+    std::vector<Segment> segments;
+    std::vector<int64_t> completed_frames;
+    SegmentJournal journal;
+    std::filesystem::path journal_fpath = get_segment_journal_path(out_fpath);
+    std::string settings = get_settings_fingerprint(
+        filter_config, encoder_config, processing_config, start_pts, end_pts
+    );
+
+    // Resume from the journal of an interrupted run if there is one
+    bool resumed = false;
+    if (processing_config->resume) {
+        if (std::filesystem::exists(journal_fpath)) {
+            ret = journal.load(journal_fpath, in_fpath, settings, segments, completed_frames);
+            if (ret < 0) {
+                spdlog::critical("Failed to load journal '{}'", journal_fpath.u8string());
+                return ret;
+            }
+            resumed = true;
+        } else {
+            spdlog::warn(
+                "No journal found at '{}'; starting from the beginning", journal_fpath.u8string()
+            );
+        }
+    }
+
+    if (!resumed) {
+        ret = split_segments(
+            in_fpath,
+            in_vstream_idx,
+            start_pts,
+            end_pts,
+            processing_config->segments,
+            processing_config->segment_duration,
+            out_fpath,
+            segments
+        );
+        if (ret < 0) {
+            spdlog::critical("Failed to split the input into segments");
+            return ret;
+        }
+        completed_frames.assign(segments.size(), -1);
+
+        ret = journal.create(journal_fpath, in_fpath, settings, segments);
+        if (ret < 0) {
+            spdlog::critical("Failed to create journal '{}'", journal_fpath.u8string());
+            return ret;
+        }
+    }
+
+    // Each segment is processed with its own processing context and publishes its progress
+    // through atomic counters
+    // Completed segments are skipped and their frame counts restored from the journal.
+    std::vector<VideoProcessingContext> segment_ctxs(segments.size());
+    std::vector<ProgressCounters> segment_progress(segments.size());
+    std::vector<size_t> pending_segments;
+    for (size_t i = 0; i < segments.size(); i++) {
+        segment_ctxs[i] = {};
+        segment_ctxs[i].start_time = proc_ctx->start_time;
+        segment_ctxs[i].control = proc_ctx->control;
+        if (completed_frames[i] >= 0) {
+            segment_ctxs[i].processed_frames = completed_frames[i];
+            segment_ctxs[i].completed = true;
+            segment_progress[i].processed_frames = completed_frames[i];
+        } else {
+            pending_segments.push_back(i);
+        }
+    }
+    if (resumed) {
+        spdlog::info(
+            "Resuming with {}/{} segment(s) remaining",
+            pending_segments.size(),
+            segments.size()
+        );
+    }
+    std::vector<int> segment_rets(segments.size(), 0);
+
+    // Idle workers pick up the next pending segment
+    // All segments share the caller's control, so pause and abort requests apply to each of them.
+    size_t max_workers = static_cast<size_t>(std::max(processing_config->segments, 1));
+    size_t num_workers = std::min(max_workers, pending_segments.size());
+    std::atomic<size_t> next_segment(0);
+    size_t finished_workers = 0;
+    std::atomic<bool> failed(false);
+    std::mutex workers_mutex;
+    std::condition_variable worker_finished;
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < num_workers; i++) {
+        workers.emplace_back([&]() {
+            while (!failed && !proc_ctx->control->is_aborted()) {
+                size_t next = next_segment++;
+                if (next >= pending_segments.size()) {
+                    break;
+                }
+                size_t index = pending_segments[next];
+                spdlog::debug("Processing segment {}/{}", index + 1, segments.size());
+
+                segment_rets[index] = process_segment(
+                    in_fpath,
+                    segments[index],
+                    benchmark,
+                    vk_device_index,
+                    hw_type,
+                    hw_ctx,
+                    filter_config,
+                    encoder_config,
+                    processing_config,
+                    &segment_ctxs[index],
+                    &segment_progress[index],
+                    memory_budget,
+                    analysis
+                );
+
+                // Only segments that ran to their end are checkpointed
+                if (segment_rets[index] == 0 && !proc_ctx->control->is_aborted()) {
+                    segment_ctxs[index].completed = true;
+                    segment_rets[index] =
+                        journal.mark_completed(index, segment_ctxs[index].processed_frames);
+                }
+                // Stop the other segments if one of them fails
+                if (segment_rets[index] < 0) {
+                    failed = true;
+                    proc_ctx->control->abort();
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(workers_mutex);
+                finished_workers++;
+            }
+            worker_finished.notify_all();
+        });
+    }
+
+    // Aggregate the segments' progress until all workers have finished
+    auto sync_progress = [&]() {
+        int64_t processed_frames = 0;
+        int64_t prefetch_depth = 0;
+        for (const ProgressCounters &progress : segment_progress) {
+            processed_frames += progress.processed_frames;
+            prefetch_depth += progress.prefetch_depth;
+            proc_ctx->peak_prefetch_depth =
+                std::max(proc_ctx->peak_prefetch_depth, progress.peak_prefetch_depth.load());
+        }
+        proc_ctx->processed_frames = processed_frames;
+        proc_ctx->prefetch_depth = prefetch_depth;
+    };
+    {
+        std::unique_lock<std::mutex> lock(workers_mutex);
+        while (finished_workers < num_workers) {
+            sync_progress();
+            worker_finished.wait_for(lock, std::chrono::milliseconds(100));
+        }
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    sync_progress();
+
+    for (int segment_ret : segment_rets) {
+        if (segment_ret < 0) {
+            ret = segment_ret;
+            break;
+        }
+    }
+
+    // Keep the journal and completed segments of an interrupted run so it can be resumed
+    if (ret < 0 || proc_ctx->control->is_aborted()) {
+        std::vector<Segment> incomplete_segments;
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (!segment_ctxs[i].completed) {
+                incomplete_segments.push_back(segments[i]);
+            }
+        }
+        remove_segment_files(incomplete_segments);
+        spdlog::info(
+            "Progress saved to '{}'; rerun with --resume to continue", journal_fpath.u8string()
+        );
+        return ret;
+    }
+
+    // Concatenate the segments
+    if (!benchmark) {
+        spdlog::info("Stitching {} segment(s) into the output file", segments.size());
+        ret = stitch_segments(segments, in_fpath, out_fpath, encoder_config);
+        if (ret < 0) {
+            spdlog::critical("Failed to stitch segments into the output file");
+            return ret;
+        }
+    }
+
+    remove_segment_files(segments);
+    journal.remove();
+    return 0;
+}
+
+// Filter a sample of evenly spaced keyframes and write them to the output file.
+static int process_video_preview(
+    const std::filesystem::path &out_fpath,
+    bool benchmark,
+    uint32_t vk_device_index,
+    AVBufferRef *hw_ctx,
+    const FilterConfig *filter_config,
+    const EncoderConfig *encoder_config,
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    int num_frames,
+    int64_t start_pts,
+    int64_t end_pts
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret = 0;
+
+    // The preview has its own timeline and no audio or subtitles
+    EncoderConfig preview_encoder_config = *encoder_config;
+    preview_encoder_config.copy_streams = false;
+    preview_encoder_config.start_time = AV_NOPTS_VALUE;
+    preview_encoder_config.end_time = AV_NOPTS_VALUE;
+
+    Encoder encoder;
+    ret = encoder.init(
+        hw_ctx,
+        out_fpath,
+        decoder.get_format_context(),
+        decoder.get_codec_context(),
+        &preview_encoder_config,
+        decoder.get_video_stream_index()
+    );
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Failed to initialize encoder: {}", errbuf);
+        return ret;
+    }
+
+    ret = avformat_write_header(encoder.get_format_context(), NULL);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error occurred when opening output file: {}", errbuf);
+        return ret;
+    }
+
+    std::unique_ptr<Filter> filter = create_filter(filter_config, vk_device_index);
     if (filter == nullptr) {
         spdlog::critical("Failed to create filter instance");
         return -1;
     }
-
-    // Initialize the filter
-    ret = filter->init(dec_ctx, encoder.get_encoder_context(), hw_ctx.get());
+    ret = filter->init(decoder.get_codec_context(), encoder.get_encoder_context(), hw_ctx);
     if (ret < 0) {
         spdlog::critical("Failed to initialize filter");
         return ret;
     }
+    filter->set_processing_control(proc_ctx->control);
+
+    spdlog::info("Generating a preview from {} sampled frame(s)", num_frames);
+    ret = process_frames_preview(
+        proc_ctx, decoder, encoder, filter.get(), num_frames, start_pts, end_pts, benchmark
+    );
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error processing frames: {}", errbuf);
+        return ret;
+    }
+
+    av_write_trailer(encoder.get_format_context());
+    return 0;
+}
+
+// Process a sample of frames into a temporary file and extrapolate the cost of the whole job.
+static int estimate_video_processing(
+    const std::filesystem::path &out_fpath,
+    uint32_t vk_device_index,
+    AVBufferRef *hw_ctx,
+    const FilterConfig *filter_config,
+    const EncoderConfig *encoder_config,
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    int num_samples,
+    int64_t start_pts,
+    int64_t end_pts,
+    ProcessingEstimate *estimate
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret = 0;
+
+    // Encode into a temporary file with the output's container format
+    std::filesystem::path estimate_fname = out_fpath.stem();
+    estimate_fname += STR(".estimate");
+    estimate_fname += out_fpath.extension();
+    std::filesystem::path estimate_fpath = out_fpath.parent_path() / estimate_fname;
+
+    EncoderConfig estimate_encoder_config = *encoder_config;
+    estimate_encoder_config.copy_streams = false;
+    estimate_encoder_config.start_time = AV_NOPTS_VALUE;
+    estimate_encoder_config.end_time = AV_NOPTS_VALUE;
+
+    {
+        Encoder encoder;
+        ret = encoder.init(
+            hw_ctx,
+            estimate_fpath,
+            decoder.get_format_context(),
+            decoder.get_codec_context(),
+            &estimate_encoder_config,
+            decoder.get_video_stream_index()
+        );
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Failed to initialize encoder: {}", errbuf);
+            return ret;
+        }
+
+        ret = avformat_write_header(encoder.get_format_context(), NULL);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error occurred when opening temporary output file: {}", errbuf);
+            return ret;
+        }
+
+        std::unique_ptr<Filter> filter = create_filter(filter_config, vk_device_index);
+        if (filter == nullptr) {
+            spdlog::critical("Failed to create filter instance");
+            return -1;
+        }
+        ret = filter->init(decoder.get_codec_context(), encoder.get_encoder_context(), hw_ctx);
+        if (ret < 0) {
+            spdlog::critical("Failed to initialize filter");
+            return ret;
+        }
+        filter->set_processing_control(proc_ctx->control);
+
+        spdlog::info("Estimating processing cost from {} sample(s)", num_samples);
+        ret = estimate_processing(
+            proc_ctx, decoder, encoder, filter.get(), num_samples, start_pts, end_pts, estimate
+        );
+        if (ret == 0) {
+            av_write_trailer(encoder.get_format_context());
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(estimate_fpath, ec);
+    if (ec) {
+        spdlog::warn(
+            "Failed to remove temporary file '{}': {}", estimate_fpath.u8string(), ec.message()
+        );
+    }
+
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error estimating processing cost: {}", errbuf);
+        return ret;
+    }
+    return 0;
+}
+
+extern "C" ProcessingControl *create_processing_control(void) {
+    return new (std::nothrow) ProcessingControl();
+}
+
+extern "C" void free_processing_control(ProcessingControl *control) {
+    delete control;
+}
+
+extern "C" void set_processing_paused(ProcessingControl *control, bool paused) {
+    control->set_paused(paused);
+}
+
+extern "C" void abort_processing(ProcessingControl *control) {
+    control->abort();
+}
+
+// Set the log level for FFmpeg and spdlog
+static void set_log_level(Libvideo2xLogLevel log_level) {
+    switch (log_level) {
+        case LIBVIDEO2X_LOG_LEVEL_TRACE:
+            av_log_set_level(AV_LOG_TRACE);
+            spdlog::set_level(spdlog::level::trace);
+            break;
+        case LIBVIDEO2X_LOG_LEVEL_DEBUG:
+            av_log_set_level(AV_LOG_DEBUG);
+            spdlog::set_level(spdlog::level::debug);
+            break;
+        case LIBVIDEO2X_LOG_LEVEL_INFO:
+            av_log_set_level(AV_LOG_INFO);
+            spdlog::set_level(spdlog::level::info);
+            break;
+        case LIBVIDEO2X_LOG_LEVEL_WARNING:
+            av_log_set_level(AV_LOG_WARNING);
+            spdlog::set_level(spdlog::level::warn);
+            break;
+        case LIBVIDEO2X_LOG_LEVEL_ERROR:
+            av_log_set_level(AV_LOG_ERROR);
+            spdlog::set_level(spdlog::level::err);
+            break;
+        case LIBVIDEO2X_LOG_LEVEL_CRITICAL:
+            av_log_set_level(AV_LOG_FATAL);
+            spdlog::set_level(spdlog::level::critical);
+            break;
+        case LIBVIDEO2X_LOG_LEVEL_OFF:
+            av_log_set_level(AV_LOG_QUIET);
+            spdlog::set_level(spdlog::level::off);
+            break;
+        default:
+            av_log_set_level(AV_LOG_INFO);
+            spdlog::set_level(spdlog::level::info);
+            break;
+    }
+}
+
+// Determine the active area to filter and, if the borders are not kept, the cropped output size
+// `processing_config` receives the crop; autocropping is disabled if there is nothing to crop.
+static int init_crop(
+    const std::filesystem::path &in_fpath,
+    AVHWDeviceType hw_type,
+    EncoderConfig *encoder_config,
+    ProcessingConfig *processing_config,
+    const VideoAnalysis *analysis,
+    AVCodecContext *dec_ctx,
+    int64_t start_pts,
+    int64_t end_pts
+) {
+    // Hardware frames would have to be downloaded to be cropped
+    if (hw_type != AV_HWDEVICE_TYPE_NONE) {
+        spdlog::warn("Automatic cropping is not supported with hardware decoding; not cropping");
+        processing_config->autocrop = AUTOCROP_NONE;
+        return 0;
+    }
+
+    CropRect crop = {
+        processing_config->crop_x,
+        processing_config->crop_y,
+        processing_config->crop_width,
+        processing_config->crop_height
+    };
+    if (crop.width <= 0 || crop.height <= 0) {
+        // An analysis pass has seen every frame rather than a sample of keyframes
+        int ret;
+        if (analysis != nullptr) {
+            ret = detect_crop_from_analysis(*analysis, start_pts, end_pts, dec_ctx->pix_fmt, crop);
+        } else {
+            ret = detect_crop(in_fpath, start_pts, end_pts, AUTOCROP_SAMPLES, crop);
+        }
+        if (ret < 0) {
+            char errbuf[AV_ERROR_MAX_STRING_SIZE];
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Failed to detect black borders: {}", errbuf);
+            return ret;
+        }
+    } else if (crop.x < 0 || crop.y < 0 || crop.x + crop.width > dec_ctx->width ||
+               crop.y + crop.height > dec_ctx->height) {
+        spdlog::critical("The crop area does not fit in the input frame");
+        return AVERROR(EINVAL);
+    } else {
+        CropRect aligned = crop;
+        align_crop(aligned, dec_ctx->width, dec_ctx->height, dec_ctx->pix_fmt);
+        if (aligned.x != crop.x || aligned.y != crop.y || aligned.width != crop.width ||
+            aligned.height != crop.height) {
+            spdlog::warn(
+                "Extending the crop area to {}x{} at ({}, {}) to align it to the chroma planes",
+                aligned.width,
+                aligned.height,
+                aligned.x,
+                aligned.y
+            );
+            crop = aligned;
+        }
+    }
+
+    if (crop.width == dec_ctx->width && crop.height == dec_ctx->height) {
+        processing_config->autocrop = AUTOCROP_NONE;
+        return 0;
+    }
+    processing_config->crop_x = crop.x;
+    processing_config->crop_y = crop.y;
+    processing_config->crop_width = crop.width;
+    processing_config->crop_height = crop.height;
+
+    if (processing_config->autocrop == AUTOCROP_KEEP) {
+        get_cropped_output_size(
+            crop,
+            dec_ctx->width,
+            dec_ctx->height,
+            encoder_config->out_width,
+            encoder_config->out_height,
+            encoder_config->out_width,
+            encoder_config->out_height
+        );
+        spdlog::debug(
+            "Cropped output video dimensions: {}x{}",
+            encoder_config->out_width,
+            encoder_config->out_height
+        );
+    }
+    return 0;
+}
+
+// Determine the factor by which frames are scaled down before filtering
+// `processing_config` receives the factor; 1 disables downscaling.
+static int init_prescale(
+    const std::filesystem::path &in_fpath,
+    AVHWDeviceType hw_type,
+    ProcessingConfig *processing_config,
+    int64_t start_pts,
+    int64_t end_pts
+) {
+    // Hardware frames would have to be downloaded to be scaled
+    if (hw_type != AV_HWDEVICE_TYPE_NONE) {
+        spdlog::warn("Downscaling is not supported with hardware decoding; not downscaling");
+        processing_config->prescale_factor = 1.0;
+        return 0;
+    }
+
+    if (processing_config->prescale_auto) {
+        int ret = detect_native_scale(
+            in_fpath, start_pts, end_pts, PRESCALE_SAMPLES, processing_config->prescale_factor
+        );
+        if (ret < 0) {
+            char errbuf[AV_ERROR_MAX_STRING_SIZE];
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Failed to detect the native resolution: {}", errbuf);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+// Set up the decoder and run the processing mode selected by the configuration; the video is
+// only sampled if `estimate` is provided.
+static int run_video(
+    const CharType *in_fname,
+    const CharType *out_fname,
+    Libvideo2xLogLevel log_level,
+    bool benchmark,
+    uint32_t vk_device_index,
+    AVHWDeviceType hw_type,
+    const FilterConfig *filter_config,
+    EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
+    VideoProcessingContext *proc_ctx,
+    int num_estimate_samples,
+    ProcessingEstimate *estimate
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret = 0;
+
+    set_log_level(log_level);
+
+    if (proc_ctx->control == nullptr) {
+        spdlog::critical("Processing context has no control");
+        return AVERROR(EINVAL);
+    }
+
+    // Convert the file names to std::filesystem::path
+    std::filesystem::path in_fpath(in_fname);
+    std::filesystem::path out_fpath(out_fname);
+
+    auto hw_ctx_deleter = [](AVBufferRef *ref) {
+        if (ref) {
+            av_buffer_unref(&ref);
+        }
+    };
+    std::unique_ptr<AVBufferRef, decltype(hw_ctx_deleter)> hw_ctx(nullptr, hw_ctx_deleter);
+
+    // Initialize hardware device context
+    if (hw_type != AV_HWDEVICE_TYPE_NONE) {
+        AVBufferRef *tmp_hw_ctx = nullptr;
+        ret = av_hwdevice_ctx_create(&tmp_hw_ctx, hw_type, NULL, NULL, 0);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error initializing hardware device context: {}", errbuf);
+            return ret;
+        }
+        hw_ctx.reset(tmp_hw_ctx);
+    }
+
+    // Initialize input decoder
+    Decoder decoder;
+    ret = decoder.init(hw_type, hw_ctx.get(), in_fpath);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Failed to initialize decoder: {}", errbuf);
+        return ret;
+    }
+
+    AVFormatContext *ifmt_ctx = decoder.get_format_context();
+    AVCodecContext *dec_ctx = decoder.get_codec_context();
+    int in_vstream_idx = decoder.get_video_stream_index();
+
+    // Convert the requested time range into video stream timestamps
+    int64_t start_pts = AV_NOPTS_VALUE;
+    int64_t end_pts = AV_NOPTS_VALUE;
+    if (encoder_config->start_time != AV_NOPTS_VALUE) {
+        start_pts = time_to_stream_pts(ifmt_ctx, in_vstream_idx, encoder_config->start_time);
+    }
+    if (encoder_config->end_time != AV_NOPTS_VALUE) {
+        end_pts = time_to_stream_pts(ifmt_ctx, in_vstream_idx, encoder_config->end_time);
+    }
+
+    // Initialize output dimensions based on filter configuration
+    int output_width = 0, output_height = 0;
+    switch (filter_config->filter_type) {
+        case FILTER_LIBPLACEBO:
+            output_width = filter_config->config.libplacebo.out_width;
+            output_height = filter_config->config.libplacebo.out_height;
+            break;
+        case FILTER_REALESRGAN:
+            output_width = dec_ctx->width * filter_config->config.realesrgan.scaling_factor;
+            output_height = dec_ctx->height * filter_config->config.realesrgan.scaling_factor;
+            break;
+        default:
+            spdlog::critical("Unknown filter type");
+            return -1;
+    }
+    spdlog::debug("Output video dimensions: {}x{}", output_width, output_height);
+
+    // Update encoder configuration with output dimensions
+    encoder_config->out_width = output_width;
+    encoder_config->out_height = output_height;
+
+    // Get total number of frames
+    spdlog::debug("Reading total number of frames");
+    proc_ctx->total_frames = get_video_frame_count(ifmt_ctx, in_vstream_idx);
+
+    // Scale the total by the fraction of the file covered by the time range
+    if (proc_ctx->total_frames > 0 && ifmt_ctx->duration > 0 &&
+        (start_pts != AV_NOPTS_VALUE || end_pts != AV_NOPTS_VALUE)) {
+        int64_t range_start = std::max<int64_t>(encoder_config->start_time, 0);
+        int64_t range_end = encoder_config->end_time != AV_NOPTS_VALUE
+                                ? std::min(encoder_config->end_time, ifmt_ctx->duration)
+                                : ifmt_ctx->duration;
+        int64_t range_duration = std::max<int64_t>(range_end - range_start, 0);
+        proc_ctx->total_frames =
+            av_rescale(proc_ctx->total_frames, range_duration, ifmt_ctx->duration);
+    }
+
+    // Inverse telecine drops one frame in every cycle
+    if (processing_config->inverse_telecine && proc_ctx->total_frames > 0) {
+        proc_ctx->total_frames = proc_ctx->total_frames * InverseTelecine::CYCLE_KEPT /
+                                 InverseTelecine::CYCLE_LENGTH;
+    }
+
+    if (proc_ctx->total_frames <= 0) {
+        spdlog::warn("Unable to determine the total number of frames");
+    } else {
+        spdlog::debug("{} frames to process", proc_ctx->total_frames);
+    }
+
+    // Estimate mode only processes a sample of frames into a temporary file
+    if (estimate != nullptr) {
+        return estimate_video_processing(
+            out_fpath,
+            vk_device_index,
+            hw_ctx.get(),
+            filter_config,
+            encoder_config,
+            proc_ctx,
+            decoder,
+            num_estimate_samples,
+            start_pts,
+            end_pts,
+            estimate
+        );
+    }
+
+    // Preview mode only decodes and filters the sampled frames
+    if (processing_config->preview_frames > 0) {
+        return process_video_preview(
+            out_fpath,
+            benchmark,
+            vk_device_index,
+            hw_ctx.get(),
+            filter_config,
+            encoder_config,
+            proc_ctx,
+            decoder,
+            processing_config->preview_frames,
+            start_pts,
+            end_pts
+        );
+    }
+
+    // Inverse telecine keeps 4 of every 5 frames, so the output runs at 4/5 of the input rate
+    if (processing_config->inverse_telecine) {
+        AVRational frame_rate = dec_ctx->framerate;
+        if (frame_rate.num <= 0 || frame_rate.den <= 0) {
+            frame_rate = av_guess_frame_rate(ifmt_ctx, ifmt_ctx->streams[in_vstream_idx], nullptr);
+        }
+        encoder_config->frame_rate = av_mul_q(
+            frame_rate, {InverseTelecine::CYCLE_KEPT, InverseTelecine::CYCLE_LENGTH}
+        );
+    }
+
+    // Features of every frame from an earlier analysis pass
+    std::unique_ptr<VideoAnalysis> analysis;
+    if (processing_config->analysis_sidecar != nullptr) {
+        analysis = std::make_unique<VideoAnalysis>();
+        ret = analysis->load(processing_config->analysis_sidecar, in_fpath);
+        if (ret < 0) {
+            spdlog::critical("Failed to load the analysis file");
+            return ret;
+        }
+        if (analysis->width() != dec_ctx->width || analysis->height() != dec_ctx->height) {
+            spdlog::critical("The analysis file does not match the input video");
+            return AVERROR(EINVAL);
+        }
+    } else if (processing_config->route_by_complexity &&
+               filter_config->filter_type == FILTER_REALESRGAN) {
+        // Routing needs the scene cuts ahead of the frames, so analyze the video first
+        int64_t total_frames = proc_ctx->total_frames;
+        analysis = std::make_unique<VideoAnalysis>();
+        ret = analysis->analyze(in_fpath, proc_ctx);
+        if (ret < 0) {
+            spdlog::critical("Failed to analyze the video");
+            return ret;
+        }
+        if (proc_ctx->control->is_aborted()) {
+            return 0;
+        }
+        proc_ctx->total_frames = total_frames;
+        proc_ctx->processed_frames = 0;
+    }
+
+    // Settings that depend on the input are resolved once for all segments
+    ProcessingConfig resolved_processing_config = *processing_config;
+
+    // Detect the black borders; the filters only process the active area
+    if (processing_config->autocrop != AUTOCROP_NONE) {
+        ret = init_crop(
+            in_fpath,
+            hw_type,
+            encoder_config,
+            &resolved_processing_config,
+            analysis.get(),
+            dec_ctx,
+            start_pts,
+            end_pts
+        );
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    // Detect the resolution the video was upscaled from
+    if (processing_config->prescale_auto || processing_config->prescale_factor > 1.0) {
+        ret = init_prescale(in_fpath, hw_type, &resolved_processing_config, start_pts, end_pts);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    processing_config = &resolved_processing_config;
+
+    // Frames in flight across all segments and pipeline stages share one memory budget
+    std::unique_ptr<MemoryBudget> memory_budget;
+    if (processing_config->memory_budget > 0) {
+        memory_budget = std::make_unique<MemoryBudget>(processing_config->memory_budget);
+        spdlog::debug("Memory budget: {} bytes", processing_config->memory_budget);
+    }
+
+    // Segments are processed with their own decoders and encoders
+    if (processing_config->segments > 1 || processing_config->segment_duration > 0 ||
+        processing_config->resume) {
+        ret = process_video_segmented(
+            in_fpath,
+            out_fpath,
+            benchmark,
+            vk_device_index,
+            hw_type,
+            hw_ctx.get(),
+            filter_config,
+            encoder_config,
+            processing_config,
+            proc_ctx,
+            memory_budget.get(),
+            analysis.get(),
+            in_vstream_idx,
+            start_pts,
+            end_pts
+        );
+        if (memory_budget) {
+            spdlog::debug("Peak memory in flight: {} bytes", memory_budget->peak_usage());
+        }
+        return ret;
+    }
+
+    // Seek to the keyframe preceding the start of the range; earlier frames are dropped
+    if (start_pts != AV_NOPTS_VALUE || end_pts != AV_NOPTS_VALUE) {
+        ret = decoder.set_frame_range(start_pts, end_pts);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Failed to seek to the start time: {}", errbuf);
+            return ret;
+        }
+    }
+
+    // Initialize the encoder
+    Encoder encoder;
+    ret = encoder.init(hw_ctx.get(), out_fpath, ifmt_ctx, dec_ctx, encoder_config, in_vstream_idx);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Failed to initialize encoder: {}", errbuf);
+        return ret;
+    }
+    encoder.set_reuse_sws_contexts(!processing_config->disable_sws_cache);
+
+    // Write the output file header
+    ret = avformat_write_header(encoder.get_format_context(), NULL);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error occurred when opening output file: {}", errbuf);
+        return ret;
+    }
+
+    // Create and initialize the filters
+    std::vector<std::unique_ptr<Filter>> filters;
+    AVStream *in_stream = ifmt_ctx->streams[in_vstream_idx];
+    ret = init_filters(
+        filter_config,
+        processing_config,
+        analysis.get(),
+        vk_device_index,
+        dec_ctx,
+        in_stream->start_time != AV_NOPTS_VALUE ? in_stream->start_time : 0,
+        encoder.get_encoder_context(),
+        hw_ctx.get(),
+        proc_ctx->control,
+        filters
+    );
+    if (ret < 0) {
+        return ret;
+    }
+
+    // Optionally copy the audio and subtitle streams from a second demuxer that follows the video
+    // instead of muxing them as they are read alongside it
+    EncoderConfig frame_encoder_config = *encoder_config;
+    StreamCopier stream_copier(encoder);
+    bool decoupled = encoder_config->copy_streams && processing_config->decouple_copied_streams;
+    if (decoupled) {
+        ret = stream_copier.init(
+            in_fpath, in_vstream_idx, encoder_config->start_time, encoder_config->end_time
+        );
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Failed to initialize stream copier: {}", errbuf);
+            return ret;
+        }
+        encoder.set_stream_copier(&stream_copier);
+        ret = stream_copier.start();
+        if (ret < 0) {
+            return ret;
+        }
+        frame_encoder_config.copy_streams = false;
+    }
 
     // Process frames using the encoder and decoder
-    ret = process_frames(encoder_config, proc_ctx, decoder, encoder, filter.get(), benchmark);
+    ret = run_frame_processing(
+        &frame_encoder_config,
+        processing_config,
+        proc_ctx,
+        decoder,
+        encoder,
+        filters,
+        memory_budget.get(),
+        benchmark
+    );
     if (ret < 0) {
         av_strerror(ret, errbuf, sizeof(errbuf));
         spdlog::critical("Error processing frames: {}", errbuf);
         return ret;
     }
 
+    if (memory_budget) {
+        spdlog::debug("Peak memory in flight: {} bytes", memory_budget->peak_usage());
+    }
+
+    // Copy the rest of the other streams now that all video has been written
+    if (decoupled && !proc_ctx->control->is_aborted()) {
+        ret = stream_copier.finish();
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error copying audio/subtitle streams: {}", errbuf);
+            return ret;
+        }
+    }
+    stream_copier.stop();
+
     // Write the output file trailer
     av_write_trailer(encoder.get_format_context());
 
@@ -375,3 +1602,109 @@ extern "C" int process_video(
     }
     return 0;
 }
+
+extern "C" int process_video(
+    const CharType *in_fname,
+    const CharType *out_fname,
+    Libvideo2xLogLevel log_level,
+    bool benchmark,
+    uint32_t vk_device_index,
+    AVHWDeviceType hw_type,
+    const FilterConfig *filter_config,
+    EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
+    VideoProcessingContext *proc_ctx
+) {
+    // The cache and the pools are shared with concurrent jobs, so their idle contexts and buffers
+    // are freed when the last one ends
+    SwsContextCache &sws_cache = SwsContextCache::get_instance();
+    sws_cache.begin_job();
+    SwsContextCache::Stats sws_stats = sws_cache.get_stats();
+    FramePool &frame_pool = FramePool::get_instance();
+    frame_pool.begin_job();
+    FramePool::Stats pool_stats = frame_pool.get_stats();
+
+    int ret = run_video(
+        in_fname,
+        out_fname,
+        log_level,
+        benchmark,
+        vk_device_index,
+        hw_type,
+        filter_config,
+        encoder_config,
+        processing_config,
+        proc_ctx,
+        0,
+        nullptr
+    );
+    sws_cache.log_stats(sws_stats);
+    sws_cache.end_job();
+    frame_pool.log_stats(pool_stats);
+    frame_pool.end_job();
+    return ret;
+}
+
+extern "C" int estimate_video(
+    const CharType *in_fname,
+    const CharType *out_fname,
+    Libvideo2xLogLevel log_level,
+    uint32_t vk_device_index,
+    AVHWDeviceType hw_type,
+    const FilterConfig *filter_config,
+    EncoderConfig *encoder_config,
+    int num_samples,
+    VideoProcessingContext *proc_ctx,
+    ProcessingEstimate *estimate
+) {
+    if (num_samples < 1 || estimate == nullptr) {
+        spdlog::critical("At least one sample and an estimate output are required");
+        return AVERROR(EINVAL);
+    }
+
+    // Frames are sampled serially with a single filter instance
+    ProcessingConfig processing_config = {};
+    processing_config.queue_size = 1;
+    processing_config.filter_workers = 1;
+    processing_config.segments = 1;
+
+    return run_video(
+        in_fname,
+        out_fname,
+        log_level,
+        false,
+        vk_device_index,
+        hw_type,
+        filter_config,
+        encoder_config,
+        &processing_config,
+        proc_ctx,
+        num_samples,
+        estimate
+    );
+}
+
+extern "C" int analyze_video(
+    const CharType *in_fname,
+    const CharType *out_fname,
+    Libvideo2xLogLevel log_level,
+    VideoProcessingContext *proc_ctx
+) {
+    set_log_level(log_level);
+
+    if (proc_ctx->control == nullptr) {
+        spdlog::critical("Processing context has no control");
+        return AVERROR(EINVAL);
+    }
+
+    int ret = analyze_video_frames(
+        std::filesystem::path(in_fname), std::filesystem::path(out_fname), proc_ctx
+    );
+    if (ret < 0) {
+        char errbuf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error analyzing video: {}", errbuf);
+        return ret;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+void MemoryBudget::acquire(int64_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_.wait(lock, [this, bytes] { return usage_ == 0 || usage_ + bytes <= limit_; });
+    usage_ += bytes;
+    peak_usage_ = std::max(peak_usage_, usage_);
+}
+
+void MemoryBudget::release(int64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        usage_ -= bytes;
+    }
+    released_.notify_all();
+}
+
+int64_t MemoryBudget::peak_usage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_usage_;
+}
+
+bool MemoryReservation::acquire(int64_t bytes) {
+    if (budget_ == nullptr) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return false;
+        }
+    }
+
+    // Wait for the shared budget without holding the reservation's lock
+    budget_->acquire(bytes);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+        budget_->release(bytes);
+        return false;
+    }
+    held_ += bytes;
+    return true;
+}
+
+void MemoryReservation::release(int64_t bytes) {
+    if (budget_ == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+        return;
+    }
+    bytes = std::min(bytes, held_);
+    held_ -= bytes;
+    budget_->release(bytes);
+}
+
+void MemoryReservation::release_all() {
+    if (budget_ == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    if (held_ > 0) {
+        budget_->release(held_);
+        held_ = 0;
+    }
+}
+
+// Get the size of an image, using the software format of hardware frames
+static int64_t get_image_size(int format, int width, int height) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(format));
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        // Assume a 4:2:0 8-bit layout for frames without a known software format
+        format = AV_PIX_FMT_YUV420P;
+    }
+    int size = av_image_get_buffer_size(static_cast<AVPixelFormat>(format), width, height, 1);
+    return size > 0 ? size : 0;
+}
+
+int64_t estimate_frame_memory(const AVFrame *frame, const AVCodecContext *enc_ctx) {
+    int64_t in_pixels = static_cast<int64_t>(frame->width) * frame->height;
+    int64_t out_pixels = static_cast<int64_t>(enc_ctx->width) * enc_ctx->height;
+
+    int64_t in_frame_size = get_image_size(frame->format, frame->width, frame->height);
+    int64_t out_frame_size = get_image_size(enc_ctx->pix_fmt, enc_ctx->width, enc_ctx->height);
+
+    // BGR24 buffers holding the filter's input and output
+    int64_t rgb_size = (in_pixels + out_pixels) * 3;
+
+    return in_frame_size + rgb_size + out_frame_size;
+}
@@ -0,0 +1,157 @@
+#include "native_resolution.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+extern "C" {
+#include <libavutil/mathematics.h>
+#include <libswscale/swscale.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "avutils.h"
+#include "conversions.h"
+#include "decoder.h"
+#include "frame_analysis.h"
+
+// Downscaling factors that are tried, from the largest
+static constexpr double CANDIDATE_FACTORS[] = {4.0, 3.0, 2.0, 1.5, 4.0 / 3.0};
+
+// Largest mean absolute luma error (8-bit scale) of a downscale and upscale round trip for a
+// frame to have no detail above the reduced resolution's Nyquist frequency
+static constexpr double MAX_ROUND_TRIP_ERROR = 0.75;
+
+// Frames with less detail than this say nothing about the resolution
+static constexpr double MIN_SAMPLE_EDGES = 2.0;
+
+// Mean absolute difference between the luma of two frames of the same size
+static double mean_luma_diff(const AVFrame *a, const AVFrame *b) {
+    uint64_t sum = 0;
+    for (int y = 0; y < a->height; y++) {
+        const uint8_t *row_a = a->data[0] + static_cast<ptrdiff_t>(y) * a->linesize[0];
+        const uint8_t *row_b = b->data[0] + static_cast<ptrdiff_t>(y) * b->linesize[0];
+        for (int x = 0; x < a->width; x++) {
+            sum += static_cast<uint64_t>(std::abs(row_a[x] - row_b[x]));
+        }
+    }
+    return static_cast<double>(sum) / (static_cast<double>(a->width) * a->height);
+}
+
+// Find the largest factor by which the luma can be scaled down and back up without losing detail
+static int measure_frame_scale(const AVFrame *frame, double &factor) {
+    AVFramePtr luma(scale_avframe(frame, frame->width, frame->height, AV_PIX_FMT_GRAY8, SWS_POINT));
+    if (!luma) {
+        return AVERROR(ENOMEM);
+    }
+
+    factor = 1.0;
+    for (double candidate : CANDIDATE_FACTORS) {
+        int width = static_cast<int>(frame->width / candidate) & ~1;
+        int height = static_cast<int>(frame->height / candidate) & ~1;
+        if (width < 16 || height < 16) {
+            continue;
+        }
+
+        AVFramePtr reduced(scale_avframe(luma.get(), width, height, AV_PIX_FMT_GRAY8, SWS_AREA));
+        AVFramePtr restored;
+        if (reduced) {
+            restored.reset(scale_avframe(
+                reduced.get(), frame->width, frame->height, AV_PIX_FMT_GRAY8, SWS_BICUBIC
+            ));
+        }
+        if (!restored) {
+            return AVERROR(ENOMEM);
+        }
+
+        if (mean_luma_diff(luma.get(), restored.get()) <= MAX_ROUND_TRIP_ERROR) {
+            factor = candidate;
+            break;
+        }
+    }
+    return 0;
+}
+
+int detect_native_scale(
+    const std::filesystem::path &in_fpath,
+    int64_t start_pts,
+    int64_t end_pts,
+    int num_samples,
+    double &factor
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    factor = 1.0;
+
+    // Decode in software so that the pixels can be inspected
+    Decoder decoder;
+    int ret = decoder.init(AV_HWDEVICE_TYPE_NONE, nullptr, in_fpath);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::error("Failed to initialize decoder: {}", errbuf);
+        return ret;
+    }
+
+    ret = resolve_stream_range(
+        decoder.get_format_context(), decoder.get_video_stream_index(), start_pts, end_pts
+    );
+    if (ret < 0) {
+        spdlog::error("Unable to determine the range to sample from");
+        return ret;
+    }
+
+    AVFramePtr frame(av_frame_alloc());
+    if (!frame) {
+        spdlog::error("Could not allocate AVFrame");
+        return AVERROR(ENOMEM);
+    }
+
+    std::vector<double> sample_factors;
+    for (int i = 0; i < num_samples; i++) {
+        int64_t target_pts =
+            start_pts + av_rescale(end_pts - start_pts, 2 * i + 1, 2 * num_samples);
+        ret = decoder.seek_to_keyframe(target_pts);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Error seeking to resolution sample {}: {}", i + 1, errbuf);
+            return ret;
+        }
+
+        ret = decoder.decode_next_frame(frame.get());
+        if (ret == AVERROR_EOF) {
+            continue;
+        } else if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Error decoding video frame: {}", errbuf);
+            return ret;
+        }
+
+        // Dark and flat frames would pass at any factor
+        FrameComplexity complexity;
+        if (measure_frame_complexity(frame.get(), nullptr, complexity) &&
+            complexity.edges >= MIN_SAMPLE_EDGES) {
+            double sample_factor;
+            ret = measure_frame_scale(frame.get(), sample_factor);
+            if (ret < 0) {
+                return ret;
+            }
+            sample_factors.push_back(sample_factor);
+        }
+        av_frame_unref(frame.get());
+    }
+
+    if (sample_factors.empty()) {
+        spdlog::warn("No frames suitable for resolution detection; not downscaling");
+        return 0;
+    }
+
+    // Take the median so that a few soft shots do not decide for the whole video
+    std::sort(sample_factors.begin(), sample_factors.end());
+    factor = sample_factors[(sample_factors.size() - 1) / 2];
+    spdlog::info(
+        "Estimated native resolution: 1/{:.2f} of the stored resolution ({} samples)",
+        factor,
+        sample_factors.size()
+    );
+    return 0;
+}
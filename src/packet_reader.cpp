@@ -0,0 +1,146 @@
+#include "packet_reader.h"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+PacketReader::PacketReader(AVFormatContext *ifmt_ctx, int video_stream_index, size_t capacity)
+    : ifmt_ctx_(ifmt_ctx),
+      video_stream_index_(video_stream_index),
+      video_capacity_(capacity),
+      other_capacity_(std::max<size_t>(capacity * OTHER_PACKETS_PER_VIDEO_PACKET, 1)) {}
+
+PacketReader::~PacketReader() {
+    stop();
+}
+
+int PacketReader::start() {
+    if (video_capacity_ == 0) {
+        return 0;
+    }
+    try {
+        thread_ = std::thread(&PacketReader::run, this);
+    } catch (const std::system_error &e) {
+        spdlog::error("Failed to start packet reader thread: {}", e.what());
+        return AVERROR(EAGAIN);
+    }
+    return 0;
+}
+
+bool PacketReader::is_video(const AVPacket *packet) const {
+    return packet->stream_index == video_stream_index_;
+}
+
+void PacketReader::run() {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+
+    while (true) {
+        AVPacketPtr packet(av_packet_alloc());
+        int ret = packet ? av_read_frame(ifmt_ctx_, packet.get()) : AVERROR(ENOMEM);
+        if (ret < 0) {
+            if (ret != AVERROR_EOF) {
+                av_strerror(ret, errbuf, sizeof(errbuf));
+                spdlog::error("Error reading packet: {}", errbuf);
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            read_ret_ = ret;
+            finished_ = true;
+            not_empty_.notify_all();
+            return;
+        }
+
+        // Wait for room in the queue of the packet's stream
+        bool video = is_video(packet.get());
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this, video] {
+            return stopped_ || (video ? video_packets_ < video_capacity_
+                                      : other_packets_ < other_capacity_);
+        });
+        if (stopped_) {
+            return;
+        }
+
+        if (video) {
+            video_packets_++;
+            peak_video_packets_ = std::max(peak_video_packets_, video_packets_);
+        } else {
+            other_packets_++;
+            peak_other_packets_ = std::max(peak_other_packets_, other_packets_);
+        }
+        packets_.push_back(std::move(packet));
+        peak_packets_ = std::max(peak_packets_, packets_.size());
+        not_empty_.notify_one();
+    }
+}
+
+int PacketReader::read_packet(AVPacket *packet) {
+    if (video_capacity_ == 0) {
+        return av_read_frame(ifmt_ctx_, packet);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (packets_.empty() && !finished_) {
+        // The reader has fallen behind; I/O latency is not being hidden
+        auto wait_start = std::chrono::steady_clock::now();
+        not_empty_.wait(lock, [this] { return finished_ || !packets_.empty(); });
+        wait_time_ += std::chrono::steady_clock::now() - wait_start;
+    }
+    if (packets_.empty()) {
+        return read_ret_;
+    }
+
+    AVPacketPtr next = std::move(packets_.front());
+    packets_.pop_front();
+    if (is_video(next.get())) {
+        video_packets_--;
+    } else {
+        other_packets_--;
+    }
+    not_full_.notify_one();
+
+    av_packet_move_ref(packet, next.get());
+    return 0;
+}
+
+void PacketReader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    not_full_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    packets_.clear();
+    video_packets_ = 0;
+    other_packets_ = 0;
+}
+
+size_t PacketReader::depth() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return packets_.size();
+}
+
+size_t PacketReader::peak_depth() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_packets_;
+}
+
+void PacketReader::log_stats() const {
+    if (video_capacity_ == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    spdlog::debug(
+        "Packet prefetch: peak depth {}/{} video and {}/{} other packets; waited {} ms for "
+        "packets",
+        peak_video_packets_,
+        video_capacity_,
+        peak_other_packets_,
+        other_capacity_,
+        std::chrono::duration_cast<std::chrono::milliseconds>(wait_time_).count()
+    );
+}
@@ -0,0 +1,563 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "avutils.h"
+#include "bounded_queue.h"
+#include "concurrency_controller.h"
+#include "ivtc.h"
+#include "memory_budget.h"
+#include "packet_reader.h"
+#include "reorder_buffer.h"
+
+// Default number of frames buffered between two pipeline stages
+static constexpr size_t DEFAULT_QUEUE_SIZE = 4;
+
+// Decoded frame tagged with its position in decoding order
+struct SequencedFrame {
+    int64_t seq;
+    AVFramePtr frame;
+};
+
+using FrameQueue = BoundedQueue<SequencedFrame>;
+using FrameReorderBuffer = ReorderBuffer<AVFramePtr>;
+
+// Memory held by the frames in flight in one pipeline
+// Every frame of a stream has the same dimensions, so the estimate for the latest decoded frame is
+// used when any frame leaves the pipeline.
+struct PipelineMemory {
+    explicit PipelineMemory(MemoryBudget *budget) : reservation(budget) {}
+
+    MemoryReservation reservation;
+    std::atomic<int64_t> frame_memory{0};
+};
+
+// Frames returned by the filters' flush calls, collected from all filter workers
+struct FlushedFrames {
+    std::mutex mutex;
+    std::vector<AVFramePtr> frames;
+};
+
+// Demux the input and push decoded video frames into the decoded frame queue.
+static int decode_frames(
+    EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    Encoder &encoder,
+    FrameQueue &decoded_frames,
+    PipelineMemory &memory,
+    ConcurrencyController &controller,
+    ProgressCounters *progress
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret = 0;
+
+    // Get required objects
+    AVFormatContext *ifmt_ctx = decoder.get_format_context();
+    AVCodecContext *dec_ctx = decoder.get_codec_context();
+    int in_vstream_idx = decoder.get_video_stream_index();
+    int *stream_map = encoder.get_stream_map();
+
+    AVPacketPtr packet(av_packet_alloc());
+    if (!packet) {
+        spdlog::critical("Could not allocate AVPacket");
+        return AVERROR(ENOMEM);
+    }
+
+    // Demux ahead on a separate thread if enabled
+    PacketReader reader(
+        ifmt_ctx, in_vstream_idx, static_cast<size_t>(processing_config->prefetch_packets)
+    );
+    ret = reader.start();
+    if (ret < 0) {
+        return ret;
+    }
+
+    // Report the prefetch statistics however decoding ends
+    struct PrefetchStats {
+        PacketReader &reader;
+        VideoProcessingContext *proc_ctx;
+        ProgressCounters *progress;
+        ~PrefetchStats() {
+            reader.stop();
+            reader.log_stats();
+            proc_ctx->prefetch_depth = 0;
+            proc_ctx->peak_prefetch_depth = static_cast<int64_t>(reader.peak_depth());
+            if (progress != nullptr) {
+                progress->prefetch_depth = 0;
+                progress->peak_prefetch_depth = proc_ctx->peak_prefetch_depth;
+            }
+        }
+    } prefetch_stats{reader, proc_ctx, progress};
+
+    // Restore progressive frames before filtering if enabled
+    std::unique_ptr<InverseTelecine> ivtc;
+    if (processing_config->inverse_telecine) {
+        ivtc = std::make_unique<InverseTelecine>();
+        ret = ivtc->init(dec_ctx);
+        if (ret < 0) {
+            spdlog::critical("Failed to initialize inverse telecine");
+            return ret;
+        }
+    }
+
+    int64_t seq = 0;
+
+    // Queue a frame for the filters
+    // Returns AVERROR_EXIT if the pipeline is shutting down.
+    auto queue_frame = [&](AVFramePtr queued_frame) -> int {
+        // Blocks until the frame fits in the memory budget
+        int64_t frame_memory =
+            estimate_frame_memory(queued_frame.get(), encoder.get_encoder_context());
+        memory.frame_memory = frame_memory;
+        if (!memory.reservation.acquire(frame_memory)) {
+            return AVERROR_EXIT;
+        }
+
+        // Blocks while the filter stage is behind
+        if (!decoded_frames.push({seq++, std::move(queued_frame)})) {
+            return AVERROR_EXIT;
+        }
+        controller.record_frame(PipelineStage::Decode);
+        return 0;
+    };
+
+    // Queue a decoded frame, or the frames the inverse telecine stage returns for it
+    // A null frame flushes the inverse telecine stage.
+    auto queue_decoded_frame = [&](AVFramePtr decoded_frame) -> int {
+        if (!ivtc) {
+            return queue_frame(std::move(decoded_frame));
+        }
+
+        int ivtc_ret = ivtc->send_frame(decoded_frame.get());
+        decoded_frame.reset();
+        while (ivtc_ret >= 0) {
+            AVFramePtr progressive_frame(av_frame_alloc());
+            if (!progressive_frame) {
+                spdlog::critical("Could not allocate AVFrame");
+                return AVERROR(ENOMEM);
+            }
+            ivtc_ret = ivtc->receive_frame(progressive_frame.get());
+            if (ivtc_ret == AVERROR(EAGAIN) || ivtc_ret == AVERROR_EOF) {
+                return 0;
+            } else if (ivtc_ret < 0) {
+                break;
+            }
+            ivtc_ret = queue_frame(std::move(progressive_frame));
+        }
+        return ivtc_ret;
+    };
+
+    // Set once a frame past the end of the decoder's frame range has been decoded
+    bool end_of_range = false;
+
+    // Read frames from the input file until EOF or the end of the decoder's frame range
+    while (!proc_ctx->control->is_aborted() && !end_of_range) {
+        ret = reader.read_packet(packet.get());
+        proc_ctx->prefetch_depth = static_cast<int64_t>(reader.depth());
+        if (progress != nullptr) {
+            progress->prefetch_depth = proc_ctx->prefetch_depth;
+        }
+        if (ret < 0) {
+            if (ret == AVERROR_EOF) {
+                spdlog::debug("Reached end of file");
+                break;
+            }
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error reading packet: {}", errbuf);
+            return ret;
+        }
+
+        if (packet->stream_index == in_vstream_idx) {
+            ret = avcodec_send_packet(dec_ctx, packet.get());
+            av_packet_unref(packet.get());
+            if (ret < 0) {
+                av_strerror(ret, errbuf, sizeof(errbuf));
+                spdlog::critical("Error sending packet to decoder: {}", errbuf);
+                return ret;
+            }
+
+            // Block while paused and stop receiving frames once aborted
+            while (proc_ctx->control->wait_if_paused()) {
+                AVFramePtr frame(av_frame_alloc());
+                if (!frame) {
+                    spdlog::critical("Could not allocate AVFrame");
+                    return AVERROR(ENOMEM);
+                }
+
+                ret = avcodec_receive_frame(dec_ctx, frame.get());
+                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                    spdlog::debug("Frame not ready");
+                    break;
+                } else if (ret < 0) {
+                    av_strerror(ret, errbuf, sizeof(errbuf));
+                    spdlog::critical("Error decoding video frame: {}", errbuf);
+                    return ret;
+                }
+
+                // Skip frames outside of the range being processed
+                if (decoder.is_before_range(frame.get())) {
+                    continue;
+                }
+                if (decoder.is_past_range(frame.get())) {
+                    end_of_range = true;
+                    break;
+                }
+
+                ret = queue_decoded_frame(std::move(frame));
+                if (ret == AVERROR_EXIT) {
+                    return 0;
+                } else if (ret < 0) {
+                    return ret;
+                }
+            }
+        } else if (encoder_config->copy_streams && stream_map[packet->stream_index] >= 0) {
+            ret = encoder.copy_packet(packet.get(), ifmt_ctx);
+            av_packet_unref(packet.get());
+            if (ret < 0) {
+                av_strerror(ret, errbuf, sizeof(errbuf));
+                spdlog::critical("Error muxing audio/subtitle packet: {}", errbuf);
+                return ret;
+            }
+        } else {
+            av_packet_unref(packet.get());
+        }
+    }
+
+    // Queue the frames still held by the inverse telecine stage
+    if (ivtc && !proc_ctx->control->is_aborted()) {
+        ret = queue_decoded_frame(nullptr);
+        if (ret < 0 && ret != AVERROR_EXIT) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error flushing inverse telecine: {}", errbuf);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+// Run decoded frames through one filter instance and hand the results to the reorder buffer.
+// Several workers may run this concurrently, each with its own filter instance.
+static int filter_frames(
+    VideoProcessingContext *proc_ctx,
+    Filter *filter,
+    size_t worker_index,
+    FrameQueue &decoded_frames,
+    FrameReorderBuffer &filtered_frames,
+    FlushedFrames &flushed_frames,
+    PipelineMemory &memory,
+    ConcurrencyController &controller
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret = 0;
+
+    SequencedFrame item;
+    while (true) {
+        // Parked workers wait here until the controller activates them again
+        controller.wait_until_active(worker_index);
+        if (!decoded_frames.pop(item)) {
+            break;
+        }
+
+        if (!proc_ctx->control->wait_if_paused()) {
+            return 0;
+        }
+
+        AVFrame *raw_processed_frame = nullptr;
+        ret = filter->process_frame(item.frame.get(), &raw_processed_frame);
+        item.frame.reset();
+
+        if (ret == AVERROR_EXIT && proc_ctx->control->is_aborted()) {
+            // The filter stopped partway through the frame
+            return 0;
+        } else if (ret < 0 && ret != AVERROR(EAGAIN)) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error filtering frame: {}", errbuf);
+            return ret;
+        }
+
+        // An empty frame tells the reorder buffer that this sequence number produced no output
+        AVFramePtr processed_frame(ret == 0 ? raw_processed_frame : nullptr);
+        if (!processed_frame) {
+            memory.reservation.release(memory.frame_memory);
+        }
+        if (!filtered_frames.put(item.seq, std::move(processed_frame))) {
+            return 0;
+        }
+        controller.record_frame(PipelineStage::Filter);
+    }
+
+    if (proc_ctx->control->is_aborted()) {
+        return 0;
+    }
+
+    // Flush the filter
+    std::vector<AVFrame *> raw_flushed_frames;
+    ret = filter->flush(raw_flushed_frames);
+
+    // Wrap flushed frames in unique_ptrs
+    std::lock_guard<std::mutex> lock(flushed_frames.mutex);
+    for (AVFrame *raw_frame : raw_flushed_frames) {
+        flushed_frames.frames.emplace_back(raw_frame);
+    }
+
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error flushing filter: {}", errbuf);
+        return ret;
+    }
+
+    return 0;
+}
+
+// Encode and write a single filtered frame.
+static int encode_frame(
+    VideoProcessingContext *proc_ctx,
+    Encoder &encoder,
+    AVFrame *frame,
+    bool benchmark,
+    ProgressCounters *progress
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+
+    if (!benchmark) {
+        int ret = encoder.write_frame(frame, proc_ctx->processed_frames);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error encoding/writing frame: {}", errbuf);
+            return ret;
+        }
+    }
+    proc_ctx->processed_frames++;
+    if (progress != nullptr) {
+        progress->processed_frames = proc_ctx->processed_frames;
+    }
+
+    spdlog::debug("Processed frame {}/{}", proc_ctx->processed_frames, proc_ctx->total_frames);
+    return 0;
+}
+
+// Encode and write filtered frames in decoding order, followed by the filters' flushed frames.
+static int encode_frames(
+    VideoProcessingContext *proc_ctx,
+    Encoder &encoder,
+    FrameReorderBuffer &filtered_frames,
+    FlushedFrames &flushed_frames,
+    PipelineMemory &memory,
+    ConcurrencyController &controller,
+    bool benchmark,
+    ProgressCounters *progress
+) {
+    int ret = 0;
+
+    AVFramePtr frame;
+    while (filtered_frames.get(frame)) {
+        ret = encode_frame(proc_ctx, encoder, frame.get(), benchmark, progress);
+        frame.reset();
+        memory.reservation.release(memory.frame_memory);
+        if (ret < 0) {
+            return ret;
+        }
+        controller.record_frame(PipelineStage::Encode);
+    }
+
+    if (proc_ctx->control->is_aborted() || filtered_frames.is_cancelled()) {
+        return 0;
+    }
+
+    // All filter workers have finished; write their flushed frames in presentation order
+    std::lock_guard<std::mutex> lock(flushed_frames.mutex);
+    std::stable_sort(
+        flushed_frames.frames.begin(),
+        flushed_frames.frames.end(),
+        [](const AVFramePtr &a, const AVFramePtr &b) { return a->pts < b->pts; }
+    );
+    for (auto &flushed_frame : flushed_frames.frames) {
+        ret = encode_frame(proc_ctx, encoder, flushed_frame.get(), benchmark, progress);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    flushed_frames.frames.clear();
+
+    return 0;
+}
+
+int process_frames_pipelined(
+    EncoderConfig *encoder_config,
+    const ProcessingConfig *processing_config,
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    Encoder &encoder,
+    std::vector<std::unique_ptr<Filter>> &filters,
+    MemoryBudget *memory_budget,
+    bool benchmark,
+    ProgressCounters *progress
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+
+    size_t queue_size = processing_config->queue_size > 0
+                            ? static_cast<size_t>(processing_config->queue_size)
+                            : DEFAULT_QUEUE_SIZE;
+    spdlog::debug(
+        "Starting pipelined processing with {} filter worker(s) and queue size {}",
+        filters.size(),
+        queue_size
+    );
+
+    // Bounded buffers linking the stages; a full buffer blocks the stage that feeds it
+    FrameQueue decoded_frames(queue_size);
+    FrameReorderBuffer filtered_frames(queue_size + filters.size());
+    FlushedFrames flushed_frames;
+
+    // Frames are admitted by the decoder only while they fit in the memory budget, so a tight
+    // budget leaves fewer frames in flight than the queues and filter workers could hold
+    PipelineMemory memory(memory_budget);
+
+    // Decides how many of the filter workers pull frames
+    ConcurrencyController controller(filters.size(), processing_config->adaptive_workers);
+
+    // Stop every stage if any one of them fails
+    // Memory held by the frames left in the buffers is returned so a blocked decoder can exit.
+    auto cancel_pipeline = [&]() {
+        controller.stop();
+        decoded_frames.cancel();
+        filtered_frames.cancel();
+        memory.reservation.release_all();
+    };
+
+    int decode_ret = 0;
+    std::thread decode_thread([&]() {
+        decode_ret = decode_frames(
+            encoder_config,
+            processing_config,
+            proc_ctx,
+            decoder,
+            encoder,
+            decoded_frames,
+            memory,
+            controller,
+            progress
+        );
+        if (decode_ret < 0) {
+            cancel_pipeline();
+        } else {
+            // Every worker helps drain the remaining frames
+            controller.stop();
+            decoded_frames.close();
+        }
+    });
+
+    // Sample the buffers' occupancy and let the controller adjust the number of active workers
+    std::thread controller_thread;
+    if (controller.is_adaptive()) {
+        controller_thread = std::thread([&]() {
+            while (controller.wait_for_next_sample()) {
+                if (proc_ctx->control->is_aborted()) {
+                    controller.stop();
+                    break;
+                }
+                if (proc_ctx->control->is_paused()) {
+                    continue;
+                }
+                controller.sample(
+                    static_cast<double>(decoded_frames.size()) /
+                        static_cast<double>(decoded_frames.capacity()),
+                    static_cast<double>(filtered_frames.size()) /
+                        static_cast<double>(filtered_frames.capacity())
+                );
+            }
+        });
+    }
+
+    // Start one thread per filter instance; idle workers pull the next decoded frame
+    std::atomic<size_t> active_workers(filters.size());
+    std::vector<int> filter_rets(filters.size(), 0);
+    std::vector<std::thread> filter_threads;
+    for (size_t i = 0; i < filters.size(); i++) {
+        filter_threads.emplace_back([&, i]() {
+            filter_rets[i] = filter_frames(
+                proc_ctx,
+                filters[i].get(),
+                i,
+                decoded_frames,
+                filtered_frames,
+                flushed_frames,
+                memory,
+                controller
+            );
+
+            if (filter_rets[i] < 0) {
+                cancel_pipeline();
+            } else if (active_workers.fetch_sub(1) == 1) {
+                // The last worker to finish unblocks the decoder in case the workers stopped
+                // early, and lets the encoder drain the remaining frames
+                decoded_frames.cancel();
+                filtered_frames.close();
+                if (proc_ctx->control->is_aborted()) {
+                    memory.reservation.release_all();
+                }
+            }
+        });
+    }
+
+    // Encode on the calling thread
+    int encode_ret = encode_frames(
+        proc_ctx, encoder, filtered_frames, flushed_frames, memory, controller, benchmark, progress
+    );
+    if (encode_ret < 0) {
+        cancel_pipeline();
+    }
+
+    decode_thread.join();
+    for (std::thread &filter_thread : filter_threads) {
+        filter_thread.join();
+    }
+    if (controller_thread.joinable()) {
+        controller.stop();
+        controller_thread.join();
+    }
+
+    if (controller.is_adaptive()) {
+        controller.log_summary();
+        spdlog::info(
+            "Codec threads: {} decoder, {} encoder",
+            decoder.get_codec_context()->thread_count,
+            encoder.get_encoder_context()->thread_count
+        );
+    }
+
+    if (decode_ret < 0) {
+        return decode_ret;
+    }
+    for (int filter_ret : filter_rets) {
+        if (filter_ret < 0) {
+            return filter_ret;
+        }
+    }
+    if (encode_ret < 0) {
+        return encode_ret;
+    }
+
+    // Flush the encoder
+    int ret = encoder.flush();
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error flushing encoder: {}", errbuf);
+        return ret;
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "prescale_filter.h"
+
+#include <spdlog/spdlog.h>
+
+#include "avutils.h"
+#include "conversions.h"
+
+PrescaleFilter::PrescaleFilter(
+    std::unique_ptr<Filter> filter,
+    int scaling_factor,
+    double factor,
+    bool reuse_sws_contexts
+)
+    : filter_(std::move(filter)),
+      scaling_factor_(scaling_factor),
+      factor_(factor),
+      reuse_sws_contexts_(reuse_sws_contexts) {}
+
+PrescaleFilter::~PrescaleFilter() {
+    if (reduced_ctx_) {
+        avcodec_free_context(&reduced_ctx_);
+    }
+}
+
+int PrescaleFilter::init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) {
+    out_width_ = dec_ctx->width * scaling_factor_;
+    out_height_ = dec_ctx->height * scaling_factor_;
+
+    // Keep the reduced size even for subsampled chroma
+    int width = static_cast<int>(dec_ctx->width / factor_) & ~1;
+    int height = static_cast<int>(dec_ctx->height / factor_) & ~1;
+    reduced_ctx_ = alloc_resized_codec_context(dec_ctx, width, height);
+    if (reduced_ctx_ == nullptr) {
+        return AVERROR(ENOMEM);
+    }
+    spdlog::info(
+        "Downscaling frames from {}x{} to {}x{} before filtering",
+        dec_ctx->width,
+        dec_ctx->height,
+        width,
+        height
+    );
+
+    return filter_->init(reduced_ctx_, enc_ctx, hw_ctx);
+}
+
+void PrescaleFilter::set_processing_control(ProcessingControl *control) {
+    Filter::set_processing_control(control);
+    filter_->set_processing_control(control);
+}
+
+int PrescaleFilter::process_frame(AVFrame *in_frame, AVFrame **out_frame) {
+    if (in_frame->hw_frames_ctx != nullptr) {
+        spdlog::error("Downscaling hardware frames is not supported");
+        return AVERROR(ENOSYS);
+    }
+
+    // Area averaging keeps all of the detail that fits in the reduced size
+    AVFramePtr reduced_frame(scale_avframe(
+        in_frame,
+        reduced_ctx_->width,
+        reduced_ctx_->height,
+        static_cast<AVPixelFormat>(in_frame->format),
+        SWS_AREA,
+        reuse_sws_contexts_
+    ));
+    if (!reduced_frame) {
+        return AVERROR(ENOMEM);
+    }
+    av_frame_copy_props(reduced_frame.get(), in_frame);
+
+    AVFrame *filtered_frame = nullptr;
+    int ret = filter_->process_frame(reduced_frame.get(), &filtered_frame);
+    if (ret < 0) {
+        return ret;
+    }
+    return restore_frame(filtered_frame, out_frame);
+}
+
+int PrescaleFilter::flush(std::vector<AVFrame *> &flushed_frames) {
+    std::vector<AVFrame *> filtered_frames;
+    int ret = filter_->flush(filtered_frames);
+    if (ret < 0) {
+        flushed_frames.insert(flushed_frames.end(), filtered_frames.begin(), filtered_frames.end());
+        return ret;
+    }
+
+    for (size_t i = 0; i < filtered_frames.size(); i++) {
+        AVFrame *restored_frame = nullptr;
+        ret = restore_frame(filtered_frames[i], &restored_frame);
+        if (ret < 0) {
+            for (size_t j = i + 1; j < filtered_frames.size(); j++) {
+                av_frame_free(&filtered_frames[j]);
+            }
+            return ret;
+        }
+        flushed_frames.push_back(restored_frame);
+    }
+    return 0;
+}
+
+int PrescaleFilter::restore_frame(AVFrame *frame, AVFrame **out_frame) {
+    AVFramePtr filtered_frame(frame);
+    if (frame->width == out_width_ && frame->height == out_height_) {
+        *out_frame = filtered_frame.release();
+        return 0;
+    }
+
+    AVFrame *restored_frame = scale_avframe(
+        frame,
+        out_width_,
+        out_height_,
+        static_cast<AVPixelFormat>(frame->format),
+        SWS_LANCZOS,
+        reuse_sws_contexts_
+    );
+    if (restored_frame == nullptr) {
+        return AVERROR(ENOMEM);
+    }
+    restored_frame->pts = frame->pts;
+    *out_frame = restored_frame;
+    return 0;
+}
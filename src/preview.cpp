@@ -0,0 +1,155 @@
+#include "preview.h"
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "avutils.h"
+
+// Encode and write a filtered preview frame.
+static int write_preview_frame(
+    VideoProcessingContext *proc_ctx,
+    Encoder &encoder,
+    AVFrame *frame,
+    bool benchmark
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+
+    if (!benchmark) {
+        int ret = encoder.write_frame(frame, proc_ctx->processed_frames);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error encoding/writing frame: {}", errbuf);
+            return ret;
+        }
+    }
+    proc_ctx->processed_frames++;
+
+    spdlog::debug(
+        "Processed preview frame {}/{}", proc_ctx->processed_frames, proc_ctx->total_frames
+    );
+    return 0;
+}
+
+int process_frames_preview(
+    VideoProcessingContext *proc_ctx,
+    Decoder &decoder,
+    Encoder &encoder,
+    Filter *filter,
+    int num_frames,
+    int64_t start_pts,
+    int64_t end_pts,
+    bool benchmark
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret = 0;
+
+    AVFormatContext *ifmt_ctx = decoder.get_format_context();
+    AVCodecContext *dec_ctx = decoder.get_codec_context();
+
+    // Determine the range to sample from
+    ret = resolve_stream_range(ifmt_ctx, decoder.get_video_stream_index(), start_pts, end_pts);
+    if (ret < 0) {
+        spdlog::critical("Unable to determine the range to sample from");
+        return ret;
+    }
+
+    AVFramePtr frame(av_frame_alloc());
+    if (!frame) {
+        spdlog::critical("Could not allocate AVFrame");
+        return AVERROR(ENOMEM);
+    }
+
+    proc_ctx->total_frames = num_frames;
+    int64_t last_sample_pts = AV_NOPTS_VALUE;
+    int64_t preview_idx = 0;
+
+    for (int i = 0; i < num_frames; i++) {
+        if (!proc_ctx->control->wait_if_paused()) {
+            break;
+        }
+
+        // Sample the middle of each of the evenly sized intervals
+        int64_t target_pts = start_pts + av_rescale(end_pts - start_pts, 2 * i + 1, 2 * num_frames);
+        ret = decoder.seek_to_keyframe(target_pts);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error seeking to sample {}: {}", i + 1, errbuf);
+            return ret;
+        }
+
+        // The first frame decoded after the seek is the keyframe
+        ret = decoder.decode_next_frame(frame.get());
+        if (ret == AVERROR_EOF) {
+            spdlog::debug("No frame found for sample {}", i + 1);
+            continue;
+        } else if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error decoding video frame: {}", errbuf);
+            return ret;
+        }
+
+        // Neighboring samples may land on the same keyframe if keyframes are sparse
+        if (frame->pts != AV_NOPTS_VALUE && frame->pts == last_sample_pts) {
+            spdlog::debug("Sample {} repeats the previous keyframe; skipping", i + 1);
+            av_frame_unref(frame.get());
+            proc_ctx->total_frames--;
+            continue;
+        }
+        last_sample_pts = frame->pts;
+
+        // Show each sampled frame for one second
+        frame->pts = av_rescale_q(preview_idx++, AVRational{1, 1}, dec_ctx->time_base);
+
+        AVFrame *raw_processed_frame = nullptr;
+        ret = filter->process_frame(frame.get(), &raw_processed_frame);
+        av_frame_unref(frame.get());
+        if (ret == AVERROR_EXIT && proc_ctx->control->is_aborted()) {
+            break;
+        } else if (ret < 0 && ret != AVERROR(EAGAIN)) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::critical("Error filtering frame: {}", errbuf);
+            return ret;
+        } else if (ret == 0 && raw_processed_frame != nullptr) {
+            AVFramePtr processed_frame(raw_processed_frame);
+            ret = write_preview_frame(proc_ctx, encoder, processed_frame.get(), benchmark);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    // Flush the filter
+    std::vector<AVFrame *> raw_flushed_frames;
+    ret = filter->flush(raw_flushed_frames);
+
+    std::vector<AVFramePtr> flushed_frames;
+    for (AVFrame *raw_frame : raw_flushed_frames) {
+        flushed_frames.emplace_back(raw_frame);
+    }
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error flushing filter: {}", errbuf);
+        return ret;
+    }
+
+    for (auto &flushed_frame : flushed_frames) {
+        ret = write_preview_frame(proc_ctx, encoder, flushed_frame.get(), benchmark);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    // Flush the encoder
+    ret = encoder.flush();
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::critical("Error flushing encoder: {}", errbuf);
+        return ret;
+    }
+
+    return 0;
+}
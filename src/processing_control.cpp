@@ -0,0 +1,28 @@
+#include "processing_control.h"
+
+void ProcessingControl::set_paused(bool paused) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        paused_ = paused;
+    }
+    state_changed_.notify_all();
+}
+
+void ProcessingControl::abort() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        aborted_ = true;
+    }
+    state_changed_.notify_all();
+}
+
+bool ProcessingControl::wait_if_paused() {
+    // Avoid taking the lock in the common case where processing is running
+    if (!paused_.load()) {
+        return !aborted_.load();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    state_changed_.wait(lock, [this] { return !paused_.load() || aborted_.load(); });
+    return !aborted_.load();
+}
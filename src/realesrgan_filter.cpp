@@ -1,14 +1,80 @@
 #include "realesrgan_filter.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
 
 #include <spdlog/spdlog.h>
 
+#include "avutils.h"
 #include "conversions.h"
+#include "frame_pool.h"
 #include "fsutils.h"
 
+// Largest difference between the channel values of a region for it to count as a solid color
+// The network reproduces such regions as the same flat color, so it does not need to run.
+static constexpr int FLAT_TOLERANCE = 2;
+
+// Largest mean difference from swscale for frames to be converted with the YUV to BGR kernel
+static constexpr double MAX_DIRECT_INPUT_MEAN_DIFF = 1.0;
+
+// Check whether all pixels of a region of an RGB24 ncnn::Mat have about the same color and
+// return the region's mid-range color
+static bool is_flat_region(
+    const ncnn::Mat &mat,
+    int x0,
+    int y0,
+    int x1,
+    int y1,
+    unsigned char color[3]
+) {
+    const unsigned char *first = mat.row<const unsigned char>(y0) + static_cast<size_t>(x0) * 3;
+    int min_value[3] = {first[0], first[1], first[2]};
+    int max_value[3] = {first[0], first[1], first[2]};
+
+    for (int y = y0; y < y1; y++) {
+        const unsigned char *row = mat.row<const unsigned char>(y);
+        for (int x = x0; x < x1; x++) {
+            for (int c = 0; c < 3; c++) {
+                int value = row[x * 3 + c];
+                min_value[c] = std::min(min_value[c], value);
+                max_value[c] = std::max(max_value[c], value);
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            if (max_value[c] - min_value[c] > FLAT_TOLERANCE) {
+                return false;
+            }
+        }
+    }
+
+    for (int c = 0; c < 3; c++) {
+        color[c] = static_cast<unsigned char>((min_value[c] + max_value[c] + 1) / 2);
+    }
+    return true;
+}
+
+// Fill a region of an RGB24 ncnn::Mat with a color
+static void fill_region(
+    ncnn::Mat &mat,
+    int x0,
+    int y0,
+    int x1,
+    int y1,
+    const unsigned char color[3]
+) {
+    for (int y = y0; y < y1; y++) {
+        unsigned char *row = mat.row<unsigned char>(y);
+        for (int x = x0; x < x1; x++) {
+            row[x * 3] = color[0];
+            row[x * 3 + 1] = color[1];
+            row[x * 3 + 2] = color[2];
+        }
+    }
+}
+
 RealesrganFilter::RealesrganFilter(
     int gpuid,
     bool tta_mode,
@@ -19,7 +85,18 @@ RealesrganFilter::RealesrganFilter(
       gpuid(gpuid),
       tta_mode(tta_mode),
       scaling_factor(scaling_factor),
-      model_name(std::move(model_name)) {}
+      model_name(std::move(model_name)),
+      reuse_sws_contexts(true),
+      fused_output_conversion(false),
+      total_frames(0),
+      flat_frames(0),
+      total_tiles(0),
+      flat_tiles(0),
+      roi_start_pts(0),
+      bicubic_tiles(0),
+      yuv_kernel(get_yuv_to_bgr_kernel()),
+      direct_input(true),
+      direct_input_checked(false) {}
 
 RealesrganFilter::~RealesrganFilter() {
     if (realesrgan) {
@@ -89,29 +166,301 @@ int RealesrganFilter::init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVB
     return 0;
 }
 
+void RealesrganFilter::set_roi_map(std::shared_ptr<const RoiMap> map, int64_t start_pts) {
+    roi_map = std::move(map);
+    roi_start_pts = start_pts;
+}
+
+void RealesrganFilter::set_reuse_sws_contexts(bool reuse) {
+    reuse_sws_contexts = reuse;
+}
+
+void RealesrganFilter::set_fused_output_conversion(bool fused) {
+    fused_output_conversion = fused;
+}
+
+// Check whether a rectangle overlaps any of the regions
+static bool
+overlaps_regions(int x, int y, int width, int height, const std::vector<RoiRect> &rects) {
+    for (const RoiRect &rect : rects) {
+        if (x < rect.x + rect.width && rect.x < x + width && y < rect.y + rect.height &&
+            rect.y < y + height) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RealesrganFilter::use_direct_input(const AVFrame *frame) {
+    if (!direct_input || !is_yuv_to_bgr_supported(static_cast<AVPixelFormat>(frame->format))) {
+        return false;
+    }
+    if (direct_input_checked) {
+        return true;
+    }
+    direct_input_checked = true;
+
+    double mean_diff;
+    int max_diff;
+    if (check_yuv_to_bgr_kernel(frame, yuv_kernel, mean_diff, max_diff) < 0) {
+        spdlog::warn("Failed to check the YUV to BGR kernel; falling back to swscale");
+        direct_input = false;
+        return false;
+    }
+    spdlog::debug(
+        "{} YUV to BGR kernel differs from swscale by {:.3f} on average and {} at most",
+        get_yuv_to_bgr_kernel_name(yuv_kernel),
+        mean_diff,
+        max_diff
+    );
+    if (mean_diff > MAX_DIRECT_INPUT_MEAN_DIFF) {
+        spdlog::warn("The YUV to BGR kernel does not match swscale; falling back to swscale");
+        direct_input = false;
+    }
+    return direct_input;
+}
+
+int RealesrganFilter::process_tiles(
+    const ncnn::Mat &in_mat,
+    ncnn::Mat &out_mat,
+    const std::vector<RoiRect> *tile_regions
+) {
+    const int tilesize = realesrgan->tilesize;
+    const int prepadding = realesrgan->prepadding;
+    const int scale = realesrgan->scale;
+    const size_t elemsize = in_mat.elemsize;
+    ncnn::Allocator *mat_allocator = FramePool::get_instance().get_mat_allocator();
+
+    // Find the tiles that need the network; tiles outside the regions of interest keep the
+    // bicubic upscale, and tiles whose padded input is a solid color upscale to the same color
+    std::vector<RoiRect> infer_tiles;
+    size_t tile_count = 0;
+    for (int tile_y = 0; tile_y < in_mat.h; tile_y += tilesize) {
+        for (int tile_x = 0; tile_x < in_mat.w; tile_x += tilesize) {
+            int tile_w = std::min(tilesize, in_mat.w - tile_x);
+            int tile_h = std::min(tilesize, in_mat.h - tile_y);
+            tile_count++;
+            total_tiles++;
+
+            if (tile_regions != nullptr &&
+                !overlaps_regions(tile_x, tile_y, tile_w, tile_h, *tile_regions)) {
+                bicubic_tiles++;
+                continue;
+            }
+
+            unsigned char color[3];
+            if (is_flat_region(
+                    in_mat,
+                    std::max(tile_x - prepadding, 0),
+                    std::max(tile_y - prepadding, 0),
+                    std::min(tile_x + tile_w + prepadding, in_mat.w),
+                    std::min(tile_y + tile_h + prepadding, in_mat.h),
+                    color
+                )) {
+                fill_region(
+                    out_mat,
+                    tile_x * scale,
+                    tile_y * scale,
+                    (tile_x + tile_w) * scale,
+                    (tile_y + tile_h) * scale,
+                    color
+                );
+                flat_tiles++;
+                continue;
+            }
+
+            infer_tiles.push_back({tile_x, tile_y, tile_w, tile_h});
+        }
+    }
+
+    // When every tile needs the network, RealESRGAN tiles the frame itself in a single call;
+    // pause and abort requests then take effect between frames
+    if (infer_tiles.size() == tile_count) {
+        if (control_ != nullptr && !control_->wait_if_paused()) {
+            return AVERROR_EXIT;
+        }
+        return realesrgan->process(in_mat, out_mat);
+    }
+
+    // Otherwise run the model on the remaining tiles one at a time, checking for pause and abort
+    // requests between them
+    // Each tile is extended by the model's padding on the sides that have neighboring pixels so
+    // that the stitched result has no seams. RealESRGAN's tile size is raised to cover the padded
+    // tile, which then runs in a single dispatch instead of being split again.
+    realesrgan->tilesize = tilesize + 2 * prepadding;
+    int ret = 0;
+    for (const RoiRect &tile : infer_tiles) {
+        if (control_ != nullptr && !control_->wait_if_paused()) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+
+        // Bounds of the padded input region
+        int in_x0 = std::max(tile.x - prepadding, 0);
+        int in_y0 = std::max(tile.y - prepadding, 0);
+        int in_x1 = std::min(tile.x + tile.width + prepadding, in_mat.w);
+        int in_y1 = std::min(tile.y + tile.height + prepadding, in_mat.h);
+
+        ncnn::Mat in_tile(in_x1 - in_x0, in_y1 - in_y0, elemsize, in_mat.elempack, mat_allocator);
+        for (int y = in_y0; y < in_y1; y++) {
+            memcpy(
+                in_tile.row<unsigned char>(y - in_y0),
+                in_mat.row<const unsigned char>(y) + static_cast<size_t>(in_x0) * elemsize,
+                static_cast<size_t>(in_tile.w) * elemsize
+            );
+        }
+
+        ncnn::Mat out_tile(
+            in_tile.w * scale, in_tile.h * scale, elemsize, in_mat.elempack, mat_allocator
+        );
+        ret = realesrgan->process(in_tile, out_tile);
+        if (ret != 0) {
+            break;
+        }
+
+        // Copy the tile without its padding into the output frame
+        int offset_x = (tile.x - in_x0) * scale;
+        int offset_y = (tile.y - in_y0) * scale;
+        for (int y = 0; y < tile.height * scale; y++) {
+            memcpy(
+                out_mat.row<unsigned char>(tile.y * scale + y) +
+                    static_cast<size_t>(tile.x * scale) * elemsize,
+                out_tile.row<const unsigned char>(offset_y + y) +
+                    static_cast<size_t>(offset_x) * elemsize,
+                static_cast<size_t>(tile.width * scale) * elemsize
+            );
+        }
+    }
+    realesrgan->tilesize = tilesize;
+
+    return ret;
+}
+
 int RealesrganFilter::process_frame(AVFrame *in_frame, AVFrame **out_frame) {
     int ret;
 
-    // Convert the input frame to RGB24
-    ncnn::Mat in_mat = avframe_to_ncnn_mat(in_frame);
+    // YUV 4:2:0 frames are converted straight into the network input in a single pass
+    ncnn::Mat in_mat;
+    AVFramePtr converted_frame;
+    if (use_direct_input(in_frame)) {
+        in_mat = ncnn::Mat(
+            in_frame->width,
+            in_frame->height,
+            static_cast<size_t>(3),
+            3,
+            FramePool::get_instance().get_mat_allocator()
+        );
+        if (in_mat.empty()) {
+            return AVERROR(ENOMEM);
+        }
+        ret = convert_yuv420_to_bgr24(
+            in_frame, static_cast<uint8_t *>(in_mat.data), in_mat.w * 3, yuv_kernel
+        );
+        if (ret < 0) {
+            return ret;
+        }
+    } else {
+        // Convert the input frame to BGR24
+        AVFrame *bgr_frame = in_frame;
+        if (in_frame->format != AV_PIX_FMT_BGR24) {
+            converted_frame.reset(
+                convert_avframe_pix_fmt(in_frame, AV_PIX_FMT_BGR24, reuse_sws_contexts)
+            );
+            if (!converted_frame) {
+                spdlog::error("Failed to convert AVFrame to BGR24");
+                return AVERROR(ENOMEM);
+            }
+            bgr_frame = converted_frame.get();
+        }
+
+        // Read the frame in place unless its lines are padded
+        in_mat = avframe_to_ncnn_mat_view(bgr_frame);
+        if (in_mat.empty()) {
+            in_mat = avframe_to_ncnn_mat(bgr_frame, reuse_sws_contexts);
+        }
+    }
     if (in_mat.empty()) {
         spdlog::error("Failed to convert AVFrame to ncnn::Mat");
         return -1;
     }
 
-    // Allocate space for ouptut ncnn::Mat
+    // The network writes straight into a pooled BGR24 frame; ROI processing starts from a bicubic
+    // upscale and runs the network only on the regions of interest
     int output_width = in_mat.w * realesrgan->scale;
     int output_height = in_mat.h * realesrgan->scale;
-    ncnn::Mat out_mat = ncnn::Mat(output_width, output_height, static_cast<size_t>(3), 3);
+    bool process_regions = roi_map != nullptr;
+    AVFramePtr out_bgr_frame;
+    if (process_regions) {
+        double time = static_cast<double>(in_frame->pts - roi_start_pts) * av_q2d(in_time_base);
+        roi_map->get_regions(time, regions);
+        out_bgr_frame.reset(scale_avframe(
+            in_frame,
+            output_width,
+            output_height,
+            AV_PIX_FMT_BGR24,
+            SWS_BICUBIC,
+            reuse_sws_contexts
+        ));
+    } else {
+        out_bgr_frame.reset(
+            FramePool::get_instance().alloc_frame(AV_PIX_FMT_BGR24, output_width, output_height)
+        );
+    }
+    if (!out_bgr_frame) {
+        return AVERROR(ENOMEM);
+    }
+    ncnn::Mat out_mat = avframe_to_ncnn_mat_view(out_bgr_frame.get());
+    bool out_in_place = !out_mat.empty();
+    if (!out_in_place && process_regions) {
+        out_mat = avframe_to_ncnn_mat(out_bgr_frame.get(), reuse_sws_contexts);
+        if (out_mat.empty()) {
+            spdlog::error("Failed to convert AVFrame to ncnn::Mat");
+            return -1;
+        }
+    } else if (!out_in_place) {
+        out_mat = ncnn::Mat(
+            output_width,
+            output_height,
+            static_cast<size_t>(3),
+            3,
+            FramePool::get_instance().get_mat_allocator()
+        );
+    }
 
-    ret = realesrgan->process(in_mat, out_mat);
-    if (ret != 0) {
+    // Solid color frames such as black lead-ins skip the network entirely
+    total_frames++;
+    unsigned char color[3];
+    if (is_flat_region(in_mat, 0, 0, in_mat.w, in_mat.h, color)) {
+        fill_region(out_mat, 0, 0, output_width, output_height, color);
+        flat_frames++;
+        ret = 0;
+    } else {
+        ret = process_tiles(in_mat, out_mat, process_regions ? &regions : nullptr);
+    }
+    if (ret == AVERROR_EXIT) {
+        return ret;
+    } else if (ret != 0) {
         spdlog::error("RealESRGAN processing failed");
         return ret;
     }
 
     // Convert ncnn::Mat to AVFrame
-    *out_frame = ncnn_mat_to_avframe(out_mat, out_pix_fmt);
+    if (out_in_place && out_pix_fmt == AV_PIX_FMT_BGR24) {
+        *out_frame = out_bgr_frame.release();
+    } else {
+        *out_frame = ncnn_mat_to_avframe(
+            out_mat,
+            out_pix_fmt,
+            in_frame->colorspace,
+            in_frame->color_range,
+            reuse_sws_contexts,
+            fused_output_conversion
+        );
+    }
+    if (*out_frame == nullptr) {
+        spdlog::error("Failed to convert ncnn::Mat to AVFrame");
+        return AVERROR(ENOMEM);
+    }
 
     // Rescale PTS to encoder's time base
     (*out_frame)->pts = av_rescale_q(in_frame->pts, in_time_base, out_time_base);
@@ -119,3 +468,23 @@ int RealesrganFilter::process_frame(AVFrame *in_frame, AVFrame **out_frame) {
     // Return the processed frame to the caller
     return ret;
 }
+
+int RealesrganFilter::flush(std::vector<AVFrame *> &_) {
+    if (flat_frames > 0 || flat_tiles > 0) {
+        spdlog::info(
+            "Filled {}/{} solid color frames and {}/{} flat tiles without upscaling",
+            flat_frames,
+            total_frames,
+            flat_tiles,
+            total_tiles
+        );
+    }
+    if (roi_map) {
+        spdlog::info(
+            "Upscaled {}/{} tiles outside the regions of interest with bicubic scaling",
+            bicubic_tiles,
+            total_tiles
+        );
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "roi_map.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+void RoiMap::add_static_region(const RoiRect &rect) {
+    static_regions_.push_back(rect);
+}
+
+int RoiMap::load_sidecar(const std::filesystem::path &fpath) {
+    std::ifstream in_file(fpath);
+    if (!in_file) {
+        spdlog::error("Could not open region of interest file '{}'", fpath.u8string());
+        return AVERROR(ENOENT);
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in_file, line)) {
+        line_number++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+
+        std::istringstream iss(line);
+        double time;
+        if (!(iss >> time)) {
+            if (line.find_first_not_of(" \t\r") != std::string::npos) {
+                spdlog::error("Malformed region of interest at line {}: {}", line_number, line);
+                return AVERROR_INVALIDDATA;
+            }
+            continue;
+        }
+
+        if (timed_regions_.empty() || timed_regions_.back().time != time) {
+            if (!timed_regions_.empty() && time < timed_regions_.back().time) {
+                spdlog::error("Region of interest times must be ascending (line {})", line_number);
+                return AVERROR_INVALIDDATA;
+            }
+            timed_regions_.push_back({time, {}});
+        }
+
+        // Either a rectangle or nothing may follow the time
+        std::vector<int> values;
+        int value;
+        while (iss >> value) {
+            values.push_back(value);
+        }
+        if (!iss.eof() || (values.size() != 0 && values.size() != 4)) {
+            spdlog::error("Malformed region of interest at line {}: {}", line_number, line);
+            return AVERROR_INVALIDDATA;
+        }
+        if (values.size() == 4) {
+            RoiRect rect = {values[0], values[1], values[2], values[3]};
+            if (rect.width <= 0 || rect.height <= 0) {
+                spdlog::error("Empty region of interest at line {}", line_number);
+                return AVERROR_INVALIDDATA;
+            }
+            timed_regions_.back().rects.push_back(rect);
+        }
+    }
+
+    spdlog::debug("Loaded {} sets of regions of interest", timed_regions_.size());
+    return 0;
+}
+
+void RoiMap::get_regions(double time, std::vector<RoiRect> &regions) const {
+    regions = static_regions_;
+
+    // Find the last set of timed regions starting at or before the time
+    auto it = std::upper_bound(
+        timed_regions_.begin(),
+        timed_regions_.end(),
+        time,
+        [](double t, const TimedRegions &entry) { return t < entry.time; }
+    );
+    if (it != timed_regions_.begin()) {
+        const std::vector<RoiRect> &rects = std::prev(it)->rects;
+        regions.insert(regions.end(), rects.begin(), rects.end());
+    }
+}
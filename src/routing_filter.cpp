@@ -0,0 +1,150 @@
+#include "routing_filter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+#include <spdlog/spdlog.h>
+
+#include "conversions.h"
+
+// Frames with a lower luma standard deviation count as flat and have their score reduced
+static constexpr double FLAT_DEVIATION = 8.0;
+
+// Motion that halves the score, since fast motion blurs away fine detail
+static constexpr double BLUR_MOTION = 16.0;
+
+// Score the detail of an analyzed frame
+// The first frame of a scene is not blurred by the motion across the cut.
+static double score_frame(const FrameFeatures &features, bool scene_cut) {
+    double score = features.edges * std::min(features.deviation / FLAT_DEVIATION, 1.0);
+    if (!scene_cut) {
+        score /= 1.0 + features.motion / BLUR_MOTION;
+    }
+    return score;
+}
+
+RoutingFilter::RoutingFilter(
+    std::unique_ptr<Filter> filter,
+    int scaling_factor,
+    double threshold,
+    const VideoAnalysis &analysis,
+    bool reuse_sws_contexts
+)
+    : filter_(std::move(filter)),
+      scaling_factor_(scaling_factor),
+      threshold_(threshold),
+      reuse_sws_contexts_(reuse_sws_contexts),
+      in_time_base_({0, 1}),
+      out_time_base_({0, 1}),
+      out_pix_fmt_(AV_PIX_FMT_NONE) {
+    const std::vector<FrameFeatures> &frames = analysis.frames();
+    size_t filtered_scenes = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        bool scene_cut = i == 0 || (frames[i].flags & FRAME_SCENE_CUT);
+        if (scene_cut) {
+            scenes_.push_back({frames[i].pts, false});
+        }
+        RoutedScene &scene = scenes_.back();
+        if (!scene.filter && score_frame(frames[i], scene_cut) > threshold_) {
+            scene.filter = true;
+            filtered_scenes++;
+        }
+    }
+    spdlog::debug("Routing {}/{} scenes to the filter", filtered_scenes, scenes_.size());
+}
+
+int RoutingFilter::init(AVCodecContext *dec_ctx, AVCodecContext *enc_ctx, AVBufferRef *hw_ctx) {
+    in_time_base_ = dec_ctx->time_base;
+    out_time_base_ = enc_ctx->time_base;
+    out_pix_fmt_ = enc_ctx->pix_fmt;
+    return filter_->init(dec_ctx, enc_ctx, hw_ctx);
+}
+
+void RoutingFilter::set_processing_control(ProcessingControl *control) {
+    Filter::set_processing_control(control);
+    filter_->set_processing_control(control);
+}
+
+bool RoutingFilter::needs_filter(const AVFrame *in_frame) const {
+    if (in_frame->pts == AV_NOPTS_VALUE) {
+        return true;
+    }
+
+    // Find the last scene starting at or before the frame
+    auto it = std::upper_bound(
+        scenes_.begin(),
+        scenes_.end(),
+        in_frame->pts,
+        [](int64_t pts, const RoutedScene &scene) { return pts < scene.start_pts; }
+    );
+    if (it == scenes_.begin()) {
+        return true;
+    }
+    return std::prev(it)->filter;
+}
+
+int RoutingFilter::resample_frame(AVFrame *in_frame, AVFrame **out_frame) {
+    AVFrame *resampled_frame = scale_avframe(
+        in_frame,
+        in_frame->width * scaling_factor_,
+        in_frame->height * scaling_factor_,
+        out_pix_fmt_,
+        SWS_BICUBIC,
+        reuse_sws_contexts_
+    );
+    if (resampled_frame == nullptr) {
+        return AVERROR(ENOMEM);
+    }
+
+    resampled_frame->pts = av_rescale_q(in_frame->pts, in_time_base_, out_time_base_);
+    *out_frame = resampled_frame;
+    return 0;
+}
+
+int RoutingFilter::process_frame(AVFrame *in_frame, AVFrame **out_frame) {
+    bool filter = needs_filter(in_frame);
+
+    auto start = std::chrono::steady_clock::now();
+    int ret = filter ? filter_->process_frame(in_frame, out_frame)
+                     : resample_frame(in_frame, out_frame);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (filter) {
+        filtered_frames_++;
+        filter_time_ += elapsed.count();
+    } else {
+        resampled_frames_++;
+        resample_time_ += elapsed.count();
+    }
+    return 0;
+}
+
+int RoutingFilter::flush(std::vector<AVFrame *> &flushed_frames) {
+    int64_t total_frames = filtered_frames_ + resampled_frames_;
+    if (total_frames > 0) {
+        spdlog::info(
+            "Filtered {}/{} frames ({:.1f}%); resampled {} low-detail frames ({:.1f}%)",
+            filtered_frames_,
+            total_frames,
+            100.0 * static_cast<double>(filtered_frames_) / static_cast<double>(total_frames),
+            resampled_frames_,
+            100.0 * static_cast<double>(resampled_frames_) / static_cast<double>(total_frames)
+        );
+    }
+
+    // Compare with the time the filter would have taken for every frame
+    if (filtered_frames_ > 0 && resampled_frames_ > 0) {
+        double filter_time_per_frame = filter_time_ / static_cast<double>(filtered_frames_);
+        double unrouted_time = filter_time_per_frame * static_cast<double>(total_frames);
+        spdlog::info(
+            "Routing saved an estimated {:.1f}s ({:.2f}x speedup)",
+            unrouted_time - filter_time_ - resample_time_,
+            unrouted_time / (filter_time_ + resample_time_)
+        );
+    }
+    return filter_->flush(flushed_frames);
+}
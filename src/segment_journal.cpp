@@ -0,0 +1,226 @@
+#include "segment_journal.h"
+
+#include <sstream>
+#include <string>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "char_defs.h"
+
+// Identifies the journal format; bump the version when the format changes
+static constexpr const char *JOURNAL_MAGIC = "video2x-journal";
+static constexpr int JOURNAL_VERSION = 2;
+
+std::filesystem::path get_segment_journal_path(const std::filesystem::path &out_fpath) {
+    std::filesystem::path journal_fname = out_fpath.stem();
+    journal_fname += STR(".journal");
+    return out_fpath.parent_path() / journal_fname;
+}
+
+// Get the absolute path and size that identify the input file
+static int get_input_identity(
+    const std::filesystem::path &in_fpath,
+    std::string &in_path_string,
+    uintmax_t &in_size
+) {
+    std::error_code ec;
+    std::filesystem::path abs_fpath = std::filesystem::absolute(in_fpath, ec);
+    if (ec) {
+        spdlog::error("Failed to resolve input path '{}': {}", in_fpath.u8string(), ec.message());
+        return AVERROR(EINVAL);
+    }
+    in_size = std::filesystem::file_size(abs_fpath, ec);
+    if (ec) {
+        spdlog::error("Failed to get the size of '{}': {}", in_fpath.u8string(), ec.message());
+        return AVERROR(EIO);
+    }
+    in_path_string = abs_fpath.u8string();
+    return 0;
+}
+
+int SegmentJournal::create(
+    const std::filesystem::path &fpath,
+    const std::filesystem::path &in_fpath,
+    const std::string &settings,
+    const std::vector<Segment> &segments
+) {
+    std::string in_path_string;
+    uintmax_t in_size;
+    int ret = get_input_identity(in_fpath, in_path_string, in_size);
+    if (ret < 0) {
+        return ret;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    fpath_ = fpath;
+    file_.open(fpath_, std::ios::out | std::ios::trunc);
+    if (!file_) {
+        spdlog::error("Could not create journal file '{}'", fpath_.u8string());
+        return AVERROR(EIO);
+    }
+
+    file_ << JOURNAL_MAGIC << ' ' << JOURNAL_VERSION << '\n';
+    file_ << "input " << in_size << ' ' << in_path_string << '\n';
+    file_ << "settings " << settings << '\n';
+    for (const Segment &segment : segments) {
+        file_ << "segment " << segment.start_pts << ' ' << segment.end_pts << ' '
+              << segment.fpath.u8string() << '\n';
+    }
+    file_.flush();
+
+    if (!file_) {
+        spdlog::error("Error writing journal file '{}'", fpath_.u8string());
+        return AVERROR(EIO);
+    }
+    return 0;
+}
+
+int SegmentJournal::load(
+    const std::filesystem::path &fpath,
+    const std::filesystem::path &in_fpath,
+    const std::string &settings,
+    std::vector<Segment> &segments,
+    std::vector<int64_t> &completed_frames
+) {
+    std::string in_path_string;
+    uintmax_t in_size;
+    int ret = get_input_identity(in_fpath, in_path_string, in_size);
+    if (ret < 0) {
+        return ret;
+    }
+
+    std::ifstream in_file(fpath);
+    if (!in_file) {
+        spdlog::error("Could not open journal file '{}'", fpath.u8string());
+        return AVERROR(ENOENT);
+    }
+
+    // Check the format identifier and version
+    std::string line;
+    std::string magic;
+    int version = 0;
+    if (std::getline(in_file, line)) {
+        std::istringstream iss(line);
+        iss >> magic >> version;
+    }
+    if (magic != JOURNAL_MAGIC || version != JOURNAL_VERSION) {
+        spdlog::error("'{}' is not a supported journal file", fpath.u8string());
+        return AVERROR_INVALIDDATA;
+    }
+
+    segments.clear();
+    completed_frames.clear();
+    bool input_matches = false;
+    bool settings_match = false;
+
+    while (std::getline(in_file, line)) {
+        std::istringstream iss(line);
+        std::string keyword;
+        iss >> keyword;
+
+        if (keyword == "input") {
+            uintmax_t journal_in_size = 0;
+            std::string journal_in_path;
+            iss >> journal_in_size;
+            std::getline(iss >> std::ws, journal_in_path);
+            input_matches = journal_in_size == in_size && journal_in_path == in_path_string;
+        } else if (keyword == "settings") {
+            std::string journal_settings;
+            std::getline(iss >> std::ws, journal_settings);
+            settings_match = journal_settings == settings;
+            if (!settings_match) {
+                spdlog::debug("Journal settings: {}", journal_settings);
+                spdlog::debug("Current settings: {}", settings);
+            }
+        } else if (keyword == "segment") {
+            int64_t start_pts = AV_NOPTS_VALUE, end_pts = AV_NOPTS_VALUE;
+            std::string segment_path;
+            iss >> start_pts >> end_pts;
+            std::getline(iss >> std::ws, segment_path);
+            if (iss.fail() || segment_path.empty()) {
+                spdlog::error("Malformed segment entry in journal: {}", line);
+                return AVERROR_INVALIDDATA;
+            }
+            segments.push_back({start_pts, end_pts, std::filesystem::u8path(segment_path)});
+            completed_frames.push_back(-1);
+        } else if (keyword == "completed") {
+            // The last entry may be truncated if the process was killed while writing it
+            size_t index = 0;
+            int64_t frames = 0;
+            iss >> index >> frames;
+            if (iss.fail() || index >= segments.size()) {
+                spdlog::warn("Ignoring malformed journal entry: {}", line);
+                continue;
+            }
+            completed_frames[index] = frames;
+        } else if (!keyword.empty()) {
+            spdlog::warn("Ignoring unknown journal entry: {}", line);
+        }
+    }
+
+    if (!input_matches) {
+        spdlog::error("Journal '{}' was created for a different input file", fpath.u8string());
+        return AVERROR(EINVAL);
+    }
+    if (!settings_match) {
+        spdlog::error(
+            "Journal '{}' was created with different processing settings", fpath.u8string()
+        );
+        return AVERROR(EINVAL);
+    }
+    if (segments.empty()) {
+        spdlog::error("Journal '{}' does not contain any segments", fpath.u8string());
+        return AVERROR_INVALIDDATA;
+    }
+
+    // Segments whose intermediate files are missing have to be processed again
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (completed_frames[i] >= 0 && !std::filesystem::exists(segments[i].fpath)) {
+            spdlog::warn(
+                "Segment file '{}' is missing; the segment will be reprocessed",
+                segments[i].fpath.u8string()
+            );
+            completed_frames[i] = -1;
+        }
+    }
+    in_file.close();
+
+    // Append further completion records to the existing journal
+    std::lock_guard<std::mutex> lock(mutex_);
+    fpath_ = fpath;
+    file_.open(fpath_, std::ios::out | std::ios::app);
+    if (!file_) {
+        spdlog::error("Could not open journal file '{}' for writing", fpath_.u8string());
+        return AVERROR(EIO);
+    }
+    return 0;
+}
+
+int SegmentJournal::mark_completed(size_t index, int64_t processed_frames) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_ << "completed " << index << ' ' << processed_frames << '\n';
+    file_.flush();
+
+    if (!file_) {
+        spdlog::error("Error writing journal file '{}'", fpath_.u8string());
+        return AVERROR(EIO);
+    }
+    return 0;
+}
+
+void SegmentJournal::remove() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_.is_open()) {
+        file_.close();
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(fpath_, ec);
+    if (ec) {
+        spdlog::warn("Failed to remove journal file '{}': {}", fpath_.u8string(), ec.message());
+    }
+}
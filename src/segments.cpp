@@ -0,0 +1,464 @@
+#include "segments.h"
+
+#include <algorithm>
+#include <cmath>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "avutils.h"
+#include "char_defs.h"
+#include "fsutils.h"
+
+// Get the path of the intermediate file of the segment at the given index
+static std::filesystem::path
+get_segment_path(const std::filesystem::path &out_fpath, size_t index) {
+    // NUT preserves the encoder's time base exactly and accepts any codec
+    std::filesystem::path segment_fname = out_fpath.stem();
+    segment_fname += STR(".part");
+    segment_fname += to_string_type(static_cast<int>(index));
+    segment_fname += STR(".nut");
+    return out_fpath.parent_path() / segment_fname;
+}
+
+// Get the timestamp used to interleave a packet
+static int64_t get_packet_ts(const AVPacket *packet) {
+    return packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+}
+
+int split_segments(
+    const std::filesystem::path &in_fpath,
+    int in_vstream_idx,
+    int64_t start_pts,
+    int64_t end_pts,
+    int num_segments,
+    double segment_duration,
+    const std::filesystem::path &out_fpath,
+    std::vector<Segment> &segments
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret;
+
+    AVInputFormatContextPtr ifmt_ctx;
+    ret = open_input_file(in_fpath, ifmt_ctx);
+    if (ret < 0) {
+        return ret;
+    }
+
+    // Only demux the video stream
+    for (int i = 0; i < static_cast<int>(ifmt_ctx->nb_streams); i++) {
+        if (i != in_vstream_idx) {
+            ifmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    AVPacketPtr packet(av_packet_alloc());
+    if (!packet) {
+        spdlog::error("Could not allocate AVPacket");
+        return AVERROR(ENOMEM);
+    }
+
+    // Only scan the part of the file within the range
+    if (start_pts != AV_NOPTS_VALUE) {
+        ret = avformat_seek_file(
+            ifmt_ctx.get(), in_vstream_idx, INT64_MIN, start_pts, start_pts, 0
+        );
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Failed to seek to the start of the range: {}", errbuf);
+            return ret;
+        }
+    }
+
+    // Collect the timestamps of the keyframes within the range
+    spdlog::debug("Scanning input for keyframes");
+    std::vector<int64_t> keyframes;
+    while ((ret = av_read_frame(ifmt_ctx.get(), packet.get())) >= 0) {
+        int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        bool is_keyframe = packet->stream_index == in_vstream_idx &&
+                           (packet->flags & AV_PKT_FLAG_KEY) && ts != AV_NOPTS_VALUE;
+        av_packet_unref(packet.get());
+
+        if (!is_keyframe || (start_pts != AV_NOPTS_VALUE && ts < start_pts)) {
+            continue;
+        }
+        if (end_pts != AV_NOPTS_VALUE && ts >= end_pts) {
+            ret = AVERROR_EOF;
+            break;
+        }
+        keyframes.push_back(ts);
+    }
+    if (ret != AVERROR_EOF) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::error("Error reading packet while scanning for keyframes: {}", errbuf);
+        return ret;
+    }
+
+    std::sort(keyframes.begin(), keyframes.end());
+    keyframes.erase(std::unique(keyframes.begin(), keyframes.end()), keyframes.end());
+    spdlog::debug("Found {} keyframes", keyframes.size());
+
+    // Measure the range from its first to its last keyframe unless its ends are given
+    int64_t range_start = start_pts;
+    int64_t range_end = end_pts;
+    if (range_start == AV_NOPTS_VALUE) {
+        range_start = keyframes.empty() ? 0 : keyframes.front();
+    }
+    if (range_end == AV_NOPTS_VALUE) {
+        range_end = keyframes.empty() ? range_start : keyframes.back();
+    }
+    int64_t duration = std::max<int64_t>(range_end - range_start, 0);
+
+    // Derive the number of segments from the requested segment duration
+    if (segment_duration > 0) {
+        AVRational time_base = ifmt_ctx->streams[in_vstream_idx]->time_base;
+        double duration_seconds = static_cast<double>(duration) * av_q2d(time_base);
+        num_segments = static_cast<int>(std::ceil(duration_seconds / segment_duration));
+        num_segments = std::max(num_segments, 1);
+    }
+
+    // Use the keyframes closest to evenly spaced points in time as segment boundaries
+    std::vector<int64_t> boundaries;
+    if (!keyframes.empty() && num_segments > 1) {
+        for (int i = 1; i < num_segments; i++) {
+            int64_t target = range_start + av_rescale(duration, i, num_segments);
+            auto it = std::lower_bound(keyframes.begin(), keyframes.end(), target);
+            if (it == keyframes.end()) {
+                break;
+            }
+            if (*it > range_start && (boundaries.empty() || *it > boundaries.back())) {
+                boundaries.push_back(*it);
+            }
+        }
+    }
+
+    // The first and last segments extend to the ends of the range
+    segments.clear();
+    int64_t segment_start = start_pts;
+    for (size_t i = 0; i <= boundaries.size(); i++) {
+        int64_t segment_end = i < boundaries.size() ? boundaries[i] : end_pts;
+        segments.push_back({segment_start, segment_end, get_segment_path(out_fpath, i)});
+        segment_start = segment_end;
+    }
+
+    spdlog::info("Input split into {} segment(s)", segments.size());
+    return 0;
+}
+
+int stitch_segments(
+    const std::vector<Segment> &segments,
+    const std::filesystem::path &in_fpath,
+    const std::filesystem::path &out_fpath,
+    const EncoderConfig *encoder_config
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    int ret;
+
+    if (segments.empty()) {
+        spdlog::error("No segments to stitch");
+        return AVERROR(EINVAL);
+    }
+
+    // Open the first segment to retrieve the encoded video stream's parameters
+    AVInputFormatContextPtr seg_ctx;
+    ret = open_input_file(segments.front().fpath, seg_ctx);
+    if (ret < 0) {
+        return ret;
+    }
+    AVStream *seg_vstream = seg_ctx->streams[0];
+
+    // Allocate the output format context
+    AVFormatContext *raw_ofmt_ctx = nullptr;
+    avformat_alloc_output_context2(&raw_ofmt_ctx, nullptr, nullptr, out_fpath.u8string().c_str());
+    if (!raw_ofmt_ctx) {
+        spdlog::error("Could not create output context");
+        return AVERROR_UNKNOWN;
+    }
+    AVOutputFormatContextPtr ofmt_ctx(raw_ofmt_ctx);
+
+    // Create the output video stream with the segments' codec parameters
+    AVStream *out_vstream = avformat_new_stream(ofmt_ctx.get(), nullptr);
+    if (!out_vstream) {
+        spdlog::error("Failed to allocate the output video stream");
+        return AVERROR_UNKNOWN;
+    }
+    ret = avcodec_parameters_copy(out_vstream->codecpar, seg_vstream->codecpar);
+    if (ret < 0) {
+        spdlog::error("Failed to copy video codec parameters");
+        return ret;
+    }
+    out_vstream->codecpar->codec_tag = 0;
+    out_vstream->time_base = seg_vstream->time_base;
+    out_vstream->avg_frame_rate = seg_vstream->avg_frame_rate;
+    out_vstream->r_frame_rate = seg_vstream->r_frame_rate;
+
+    // Map the input's audio and subtitle streams to output streams
+    AVInputFormatContextPtr ifmt_ctx;
+    std::vector<int> stream_map;
+    if (encoder_config->copy_streams) {
+        ret = open_input_file(in_fpath, ifmt_ctx);
+        if (ret < 0) {
+            return ret;
+        }
+
+        stream_map.assign(ifmt_ctx->nb_streams, -1);
+        for (int i = 0; i < static_cast<int>(ifmt_ctx->nb_streams); i++) {
+            AVStream *in_stream = ifmt_ctx->streams[i];
+            AVCodecParameters *in_codecpar = in_stream->codecpar;
+
+            if (in_codecpar->codec_type != AVMEDIA_TYPE_AUDIO &&
+                in_codecpar->codec_type != AVMEDIA_TYPE_SUBTITLE) {
+                in_stream->discard = AVDISCARD_ALL;
+                continue;
+            }
+
+            AVStream *out_stream = avformat_new_stream(ofmt_ctx.get(), nullptr);
+            if (!out_stream) {
+                spdlog::error("Failed allocating output stream");
+                return AVERROR_UNKNOWN;
+            }
+
+            ret = avcodec_parameters_copy(out_stream->codecpar, in_codecpar);
+            if (ret < 0) {
+                spdlog::error("Failed to copy codec parameters");
+                return ret;
+            }
+            out_stream->codecpar->codec_tag = 0;
+            out_stream->time_base = in_stream->time_base;
+
+            spdlog::debug("Stream mapping: {} (in) -> {} (out)", i, out_stream->index);
+            stream_map[i] = out_stream->index;
+        }
+    }
+
+    // Open the output file and write its header
+    if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&ofmt_ctx->pb, out_fpath.u8string().c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            spdlog::error("Could not open output file '{}'", out_fpath.u8string());
+            return ret;
+        }
+    }
+
+    ret = avformat_write_header(ofmt_ctx.get(), nullptr);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::error("Error occurred when opening output file: {}", errbuf);
+        return ret;
+    }
+
+    AVPacketPtr packet(av_packet_alloc());
+    AVPacketPtr copied_packet(av_packet_alloc());
+    if (!packet || !copied_packet) {
+        spdlog::error("Could not allocate AVPacket");
+        return AVERROR(ENOMEM);
+    }
+
+    // The next packet of a copied stream waiting to be interleaved with the video packets
+    bool copied_packet_ready = false;
+
+    // Read the next packet of a copied stream within the time range, shifted to start at zero
+    int64_t start_time = encoder_config->start_time;
+    int64_t end_time = encoder_config->end_time;
+    auto read_copied_packet = [&]() -> int {
+        while (true) {
+            int read_ret = av_read_frame(ifmt_ctx.get(), copied_packet.get());
+            if (read_ret < 0) {
+                copied_packet_ready = false;
+                return read_ret == AVERROR_EOF ? 0 : read_ret;
+            }
+
+            int stream_index = copied_packet->stream_index;
+            int64_t ts = copied_packet->pts != AV_NOPTS_VALUE ? copied_packet->pts
+                                                               : copied_packet->dts;
+            bool in_range = stream_map[stream_index] >= 0;
+            if (in_range && ts != AV_NOPTS_VALUE) {
+                if (start_time != AV_NOPTS_VALUE &&
+                    ts < time_to_stream_pts(ifmt_ctx.get(), stream_index, start_time)) {
+                    in_range = false;
+                }
+                if (end_time != AV_NOPTS_VALUE &&
+                    ts >= time_to_stream_pts(ifmt_ctx.get(), stream_index, end_time)) {
+                    in_range = false;
+                }
+            }
+            if (!in_range) {
+                av_packet_unref(copied_packet.get());
+                continue;
+            }
+
+            if (start_time != AV_NOPTS_VALUE) {
+                int64_t start_ts = time_to_stream_pts(ifmt_ctx.get(), stream_index, start_time);
+                if (copied_packet->pts != AV_NOPTS_VALUE) {
+                    copied_packet->pts -= start_ts;
+                }
+                if (copied_packet->dts != AV_NOPTS_VALUE) {
+                    copied_packet->dts -= start_ts;
+                }
+            }
+            copied_packet_ready = true;
+            return 0;
+        }
+    };
+
+    auto write_copied_packet = [&]() -> int {
+        AVStream *in_stream = ifmt_ctx->streams[copied_packet->stream_index];
+        int out_stream_index = stream_map[copied_packet->stream_index];
+        AVStream *out_stream = ofmt_ctx->streams[out_stream_index];
+
+        av_packet_rescale_ts(copied_packet.get(), in_stream->time_base, out_stream->time_base);
+        copied_packet->stream_index = out_stream_index;
+
+        int write_ret = av_interleaved_write_frame(ofmt_ctx.get(), copied_packet.get());
+        if (write_ret < 0) {
+            spdlog::error("Error muxing audio/subtitle packet");
+            return write_ret;
+        }
+        return read_copied_packet();
+    };
+
+    if (ifmt_ctx) {
+        // Skip to the start of the time range
+        if (start_time != AV_NOPTS_VALUE) {
+            int64_t file_start_time = ifmt_ctx->start_time != AV_NOPTS_VALUE ? ifmt_ctx->start_time
+                                                                             : 0;
+            int64_t seek_ts = file_start_time + start_time;
+            ret = avformat_seek_file(ifmt_ctx.get(), -1, INT64_MIN, seek_ts, seek_ts, 0);
+            if (ret < 0) {
+                av_strerror(ret, errbuf, sizeof(errbuf));
+                spdlog::error("Failed to seek to the start of the time range: {}", errbuf);
+                return ret;
+            }
+        }
+
+        ret = read_copied_packet();
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Error reading packet: {}", errbuf);
+            return ret;
+        }
+    }
+
+    // Append the video packets of each segment in order
+    // Segments are encoded independently, so the reordering delay at the start of a segment can
+    // make its first DTS overlap the end of the previous one. Such a segment is shifted as a
+    // whole, PTS and DTS alike, to start where the previous segment's last packet ends.
+    int64_t last_dts = AV_NOPTS_VALUE;
+    int64_t last_duration = 0;
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (i > 0) {
+            seg_ctx.reset();
+            ret = open_input_file(segments[i].fpath, seg_ctx);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        AVRational seg_time_base = seg_ctx->streams[0]->time_base;
+        spdlog::debug("Stitching segment {}/{}", i + 1, segments.size());
+
+        int64_t ts_shift = 0;
+        bool ts_shift_known = false;
+        while ((ret = av_read_frame(seg_ctx.get(), packet.get())) >= 0) {
+            av_packet_rescale_ts(packet.get(), seg_time_base, out_vstream->time_base);
+            packet->stream_index = out_vstream->index;
+
+            if (!ts_shift_known && packet->dts != AV_NOPTS_VALUE) {
+                ts_shift_known = true;
+                if (last_dts != AV_NOPTS_VALUE) {
+                    ts_shift = std::max<int64_t>(last_dts + last_duration - packet->dts, 0);
+                }
+                if (ts_shift > 0) {
+                    spdlog::debug("Shifting segment {} timestamps by {}", i + 1, ts_shift);
+                }
+            }
+            if (packet->pts != AV_NOPTS_VALUE) {
+                packet->pts += ts_shift;
+            }
+
+            // DTS within a segment only go backwards in malformed files
+            if (packet->dts != AV_NOPTS_VALUE) {
+                packet->dts += ts_shift;
+                if (last_dts != AV_NOPTS_VALUE && packet->dts <= last_dts) {
+                    spdlog::warn(
+                        "Adjusting non-monotonic DTS {} to {} in segment {}",
+                        packet->dts,
+                        last_dts + 1,
+                        i + 1
+                    );
+                    packet->dts = last_dts + 1;
+                    if (packet->pts != AV_NOPTS_VALUE && packet->pts < packet->dts) {
+                        packet->pts = packet->dts;
+                    }
+                }
+
+                // Packets without a duration last until the next DTS
+                if (packet->duration > 0) {
+                    last_duration = packet->duration;
+                } else if (last_dts != AV_NOPTS_VALUE) {
+                    last_duration = packet->dts - last_dts;
+                }
+                last_dts = packet->dts;
+            }
+
+            // Write the copied packets that precede this video packet
+            int64_t video_ts = get_packet_ts(packet.get());
+            while (copied_packet_ready && video_ts != AV_NOPTS_VALUE) {
+                int64_t copied_ts = get_packet_ts(copied_packet.get());
+                AVRational copied_time_base =
+                    ifmt_ctx->streams[copied_packet->stream_index]->time_base;
+                if (copied_ts != AV_NOPTS_VALUE &&
+                    av_compare_ts(copied_ts, copied_time_base, video_ts, out_vstream->time_base) >
+                        0) {
+                    break;
+                }
+                ret = write_copied_packet();
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+
+            ret = av_interleaved_write_frame(ofmt_ctx.get(), packet.get());
+            if (ret < 0) {
+                spdlog::error("Error muxing video packet");
+                return ret;
+            }
+        }
+        if (ret != AVERROR_EOF) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Error reading segment '{}': {}", segments[i].fpath.u8string(), errbuf);
+            return ret;
+        }
+    }
+
+    // Write the remaining copied packets
+    while (copied_packet_ready) {
+        ret = write_copied_packet();
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    ret = av_write_trailer(ofmt_ctx.get());
+    if (ret < 0) {
+        spdlog::error("Error writing output file trailer");
+        return ret;
+    }
+
+    return 0;
+}
+
+void remove_segment_files(const std::vector<Segment> &segments) {
+    for (const Segment &segment : segments) {
+        std::error_code ec;
+        std::filesystem::remove(segment.fpath, ec);
+        if (ec) {
+            spdlog::warn(
+                "Failed to remove segment file '{}': {}", segment.fpath.u8string(), ec.message()
+            );
+        }
+    }
+}
@@ -0,0 +1,184 @@
+#include "stream_copier.h"
+
+extern "C" {
+#include <libavutil/mathematics.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "encoder.h"
+
+// How far past the end of the time range reading continues, to catch packets that the input
+// interleaves late
+static constexpr int64_t END_MARGIN = 5 * AV_TIME_BASE;
+
+StreamCopier::StreamCopier(Encoder &encoder) : encoder_(encoder) {}
+
+StreamCopier::~StreamCopier() {
+    stop();
+}
+
+int StreamCopier::init(
+    const std::filesystem::path &in_fpath,
+    int in_vstream_idx,
+    int64_t start_time,
+    int64_t end_time
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+
+    int ret = open_input_file(in_fpath, ifmt_ctx_);
+    if (ret < 0) {
+        return ret;
+    }
+    in_vstream_idx_ = in_vstream_idx;
+    start_time_ = start_time;
+    end_time_ = end_time;
+
+    // Only the copied streams are read
+    int *stream_map = encoder_.get_stream_map();
+    for (unsigned int i = 0; i < ifmt_ctx_->nb_streams; i++) {
+        if (static_cast<int>(i) == in_vstream_idx_ || stream_map[i] < 0) {
+            ifmt_ctx_->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    // Skip to the start of the time range
+    if (start_time_ != AV_NOPTS_VALUE) {
+        int64_t file_start_time = ifmt_ctx_->start_time != AV_NOPTS_VALUE ? ifmt_ctx_->start_time
+                                                                           : 0;
+        int64_t seek_ts = file_start_time + start_time_;
+        ret = avformat_seek_file(ifmt_ctx_.get(), -1, INT64_MIN, seek_ts, seek_ts, 0);
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Failed to seek to the start of the time range: {}", errbuf);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+int StreamCopier::start() {
+    try {
+        thread_ = std::thread(&StreamCopier::run, this);
+    } catch (const std::system_error &e) {
+        spdlog::error("Failed to start stream copier thread: {}", e.what());
+        return AVERROR(EAGAIN);
+    }
+    return 0;
+}
+
+void StreamCopier::advance(int64_t video_time) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (video_time_ != AV_NOPTS_VALUE && video_time <= video_time_) {
+            return;
+        }
+        video_time_ = video_time;
+    }
+    advanced_.notify_one();
+}
+
+int StreamCopier::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        video_finished_ = true;
+    }
+    advanced_.notify_one();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    return ret_;
+}
+
+void StreamCopier::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    advanced_.notify_one();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void StreamCopier::run() {
+    int ret = copy_packets();
+    std::lock_guard<std::mutex> lock(mutex_);
+    ret_ = ret;
+}
+
+int64_t StreamCopier::get_output_time(const AVPacket *packet) const {
+    int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (ts == AV_NOPTS_VALUE) {
+        return AV_NOPTS_VALUE;
+    }
+
+    int64_t range_start = start_time_ != AV_NOPTS_VALUE ? start_time_ : 0;
+    int64_t start_ts = time_to_stream_pts(ifmt_ctx_.get(), packet->stream_index, range_start);
+    return av_rescale_q(
+        ts - start_ts,
+        ifmt_ctx_->streams[packet->stream_index]->time_base,
+        AVRational{1, AV_TIME_BASE}
+    );
+}
+
+int StreamCopier::copy_packets() {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+
+    AVPacketPtr packet(av_packet_alloc());
+    if (!packet) {
+        spdlog::error("Could not allocate AVPacket");
+        return AVERROR(ENOMEM);
+    }
+
+    int64_t range_duration = AV_NOPTS_VALUE;
+    if (end_time_ != AV_NOPTS_VALUE) {
+        range_duration = end_time_ - (start_time_ != AV_NOPTS_VALUE ? start_time_ : 0);
+    }
+
+    while (true) {
+        int ret = av_read_frame(ifmt_ctx_.get(), packet.get());
+        if (ret == AVERROR_EOF) {
+            return 0;
+        } else if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Error reading packet: {}", errbuf);
+            return ret;
+        }
+        if (packet->stream_index == in_vstream_idx_ ||
+            encoder_.get_stream_map()[packet->stream_index] < 0) {
+            av_packet_unref(packet.get());
+            continue;
+        }
+
+        int64_t output_time = get_output_time(packet.get());
+        if (range_duration != AV_NOPTS_VALUE && output_time != AV_NOPTS_VALUE &&
+            output_time > range_duration + END_MARGIN) {
+            av_packet_unref(packet.get());
+            return 0;
+        }
+
+        // Wait until the video has caught up with the packet
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            advanced_.wait(lock, [this, output_time] {
+                return stopped_ || video_finished_ || output_time == AV_NOPTS_VALUE ||
+                       (video_time_ != AV_NOPTS_VALUE && output_time <= video_time_);
+            });
+            if (stopped_) {
+                av_packet_unref(packet.get());
+                return 0;
+            }
+        }
+
+        ret = encoder_.copy_packet(packet.get(), ifmt_ctx_.get());
+        av_packet_unref(packet.get());
+        if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Error muxing audio/subtitle packet: {}", errbuf);
+            return ret;
+        }
+    }
+}
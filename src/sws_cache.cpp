@@ -0,0 +1,258 @@
+#include "sws_cache.h"
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#include <spdlog/spdlog.h>
+
+// Upper bound on idle contexts kept across all keys; the least recently used ones are freed
+static constexpr size_t MAX_IDLE_CONTEXTS = 32;
+
+bool SwsContextKey::operator==(const SwsContextKey &other) const {
+    return src_width == other.src_width && src_height == other.src_height &&
+           src_pix_fmt == other.src_pix_fmt && dst_width == other.dst_width &&
+           dst_height == other.dst_height && dst_pix_fmt == other.dst_pix_fmt &&
+           flags == other.flags && colorspace == other.colorspace &&
+           color_range == other.color_range;
+}
+
+// Get the swscale range flag of a pixel format; RGB is always full range
+static int get_sws_range(AVPixelFormat pix_fmt, AVColorRange color_range) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    if (desc != nullptr && (desc->flags & AV_PIX_FMT_FLAG_RGB)) {
+        return 1;
+    }
+    return color_range == AVCOL_RANGE_JPEG ? 1 : 0;
+}
+
+static SwsContext *create_sws_context(const SwsContextKey &key) {
+    SwsContext *sws_ctx = sws_getContext(
+        key.src_width,
+        key.src_height,
+        key.src_pix_fmt,
+        key.dst_width,
+        key.dst_height,
+        key.dst_pix_fmt,
+        key.flags,
+        nullptr,
+        nullptr,
+        nullptr
+    );
+    if (sws_ctx == nullptr) {
+        spdlog::error("Failed to initialize swscale context.");
+        return nullptr;
+    }
+
+    // Keep the swscale defaults (BT.601, limited range) for untagged frames
+    if (key.colorspace == AVCOL_SPC_UNSPECIFIED && key.color_range == AVCOL_RANGE_UNSPECIFIED) {
+        return sws_ctx;
+    }
+
+    int sws_colorspace = SWS_CS_DEFAULT;
+    if (key.colorspace != AVCOL_SPC_UNSPECIFIED && key.colorspace != AVCOL_SPC_RGB) {
+        sws_colorspace = static_cast<int>(key.colorspace);
+    }
+    const int *coefficients = sws_getCoefficients(sws_colorspace);
+
+    // Fails for conversions that do not involve YUV, which need no coefficients
+    sws_setColorspaceDetails(
+        sws_ctx,
+        coefficients,
+        get_sws_range(key.src_pix_fmt, key.color_range),
+        coefficients,
+        get_sws_range(key.dst_pix_fmt, key.color_range),
+        0,
+        1 << 16,
+        1 << 16
+    );
+    return sws_ctx;
+}
+
+SwsContextCache::Lease::Lease(Lease &&other) noexcept
+    : cache_(other.cache_),
+      key_(other.key_),
+      sws_ctx_(other.sws_ctx_),
+      reuse_(other.reuse_),
+      start_time_(other.start_time_) {
+    other.cache_ = nullptr;
+    other.sws_ctx_ = nullptr;
+}
+
+SwsContextCache::Lease &SwsContextCache::Lease::operator=(Lease &&other) noexcept {
+    if (this != &other) {
+        release();
+        cache_ = other.cache_;
+        key_ = other.key_;
+        sws_ctx_ = other.sws_ctx_;
+        reuse_ = other.reuse_;
+        start_time_ = other.start_time_;
+        other.cache_ = nullptr;
+        other.sws_ctx_ = nullptr;
+    }
+    return *this;
+}
+
+SwsContextCache::Lease::~Lease() {
+    release();
+}
+
+void SwsContextCache::Lease::release() {
+    if (sws_ctx_ == nullptr) {
+        return;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start_time_;
+    cache_->release(
+        key_,
+        sws_ctx_,
+        reuse_,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()
+    );
+    cache_ = nullptr;
+    sws_ctx_ = nullptr;
+}
+
+SwsContextCache &SwsContextCache::get_instance() {
+    static SwsContextCache instance;
+    return instance;
+}
+
+SwsContextCache::~SwsContextCache() {
+    clear();
+}
+
+SwsContextCache::Lease SwsContextCache::acquire(const SwsContextKey &key, bool reuse) {
+    Lease lease;
+    lease.start_time_ = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Search from the most recently returned context
+        for (auto it = idle_contexts_.rbegin(); reuse && it != idle_contexts_.rend(); ++it) {
+            if (it->first == key) {
+                lease.sws_ctx_ = it->second;
+                idle_contexts_.erase(std::next(it).base());
+                hits_++;
+                break;
+            }
+        }
+        if (lease.sws_ctx_ == nullptr) {
+            misses_++;
+        }
+    }
+
+    // Create contexts outside the lock since initialization can take a while
+    if (lease.sws_ctx_ == nullptr) {
+        lease.sws_ctx_ = create_sws_context(key);
+        if (lease.sws_ctx_ == nullptr) {
+            return Lease();
+        }
+    }
+    lease.cache_ = this;
+    lease.key_ = key;
+    lease.reuse_ = reuse;
+    return lease;
+}
+
+SwsContextCache::Lease SwsContextCache::acquire(
+    const AVFrame *src_frame,
+    int dst_width,
+    int dst_height,
+    AVPixelFormat dst_pix_fmt,
+    int flags,
+    bool reuse
+) {
+    SwsContextKey key{
+        src_frame->width,
+        src_frame->height,
+        static_cast<AVPixelFormat>(src_frame->format),
+        dst_width,
+        dst_height,
+        dst_pix_fmt,
+        flags,
+        src_frame->colorspace,
+        src_frame->color_range
+    };
+    return acquire(key, reuse);
+}
+
+void SwsContextCache::release(
+    const SwsContextKey &key,
+    SwsContext *sws_ctx,
+    bool reuse,
+    int64_t elapsed_ns
+) {
+    SwsContext *evicted_ctx = sws_ctx;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        conversions_++;
+        conversion_ns_ += elapsed_ns;
+
+        if (reuse) {
+            idle_contexts_.emplace_back(key, sws_ctx);
+            evicted_ctx = nullptr;
+            if (idle_contexts_.size() > MAX_IDLE_CONTEXTS) {
+                evicted_ctx = idle_contexts_.front().second;
+                idle_contexts_.erase(idle_contexts_.begin());
+            }
+        }
+    }
+    if (evicted_ctx != nullptr) {
+        sws_freeContext(evicted_ctx);
+    }
+}
+
+void SwsContextCache::begin_job() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_jobs_++;
+}
+
+void SwsContextCache::end_job() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_jobs_ > 0) {
+            return;
+        }
+    }
+    clear();
+}
+
+void SwsContextCache::clear() {
+    std::vector<std::pair<SwsContextKey, SwsContext *>> idle_contexts;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_contexts.swap(idle_contexts_);
+    }
+    for (auto &entry : idle_contexts) {
+        sws_freeContext(entry.second);
+    }
+}
+
+SwsContextCache::Stats SwsContextCache::get_stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {hits_, misses_, conversions_, conversion_ns_};
+}
+
+void SwsContextCache::log_stats(const Stats &since) {
+    Stats stats = get_stats();
+    int64_t conversions = stats.conversions - since.conversions;
+    if (conversions == 0) {
+        return;
+    }
+
+    // Setup time is included so runs with and without the cache can be compared
+    // Concurrent jobs share the counters, so their conversions are included as well.
+    double total_ms = static_cast<double>(stats.conversion_ns - since.conversion_ns) / 1e6;
+    spdlog::debug(
+        "Pixel conversions: {} in {:.1f} ms ({:.3f} ms per conversion, {:.0f} per second)",
+        conversions,
+        total_ms,
+        total_ms / static_cast<double>(conversions),
+        total_ms > 0.0 ? static_cast<double>(conversions) * 1000.0 / total_ms : 0.0
+    );
+    spdlog::debug(
+        "Scaling contexts: {} created, {} reused",
+        stats.misses - since.misses,
+        stats.hits - since.hits
+    );
+}
@@ -0,0 +1,356 @@
+#include "video_analysis.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+extern "C" {
+#include <libavutil/intreadwrite.h>
+#include <libavutil/mathematics.h>
+#include <libswscale/swscale.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "autocrop.h"
+#include "avutils.h"
+#include "conversions.h"
+#include "decoder.h"
+#include "frame_analysis.h"
+#include "processing_control.h"
+
+// Identifies the sidecar format; bump the version when the format changes
+static constexpr char SIDECAR_MAGIC[8] = {'V', '2', 'X', 'F', 'E', 'A', 'T', 'S'};
+static constexpr uint32_t SIDECAR_VERSION = 1;
+static constexpr size_t HEADER_SIZE = 40;
+static constexpr size_t RECORD_SIZE = 41;
+
+// Frames are analyzed at no more than this width
+static constexpr int ANALYSIS_WIDTH = 480;
+
+// Largest decoder resolution reduction, as a power of two
+static constexpr int MAX_LOWRES = 3;
+
+// Smallest uniform brightness change (8-bit scale) between frames of a fade
+static constexpr double FADE_STEP = 0.5;
+
+static void write_float(uint8_t *p, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    AV_WL32(p, bits);
+}
+
+static float read_float(const uint8_t *p) {
+    uint32_t bits = AV_RL32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void write_record(uint8_t *p, const FrameFeatures &features) {
+    AV_WL64(p, static_cast<uint64_t>(features.pts));
+    AV_WL64(p + 8, features.hash);
+    write_float(p + 16, features.brightness);
+    write_float(p + 20, features.edges);
+    write_float(p + 24, features.deviation);
+    write_float(p + 28, features.motion);
+    AV_WL16(p + 32, features.active_x);
+    AV_WL16(p + 34, features.active_y);
+    AV_WL16(p + 36, features.active_width);
+    AV_WL16(p + 38, features.active_height);
+    p[40] = features.flags;
+}
+
+static void read_record(const uint8_t *p, FrameFeatures &features) {
+    features.pts = static_cast<int64_t>(AV_RL64(p));
+    features.hash = AV_RL64(p + 8);
+    features.brightness = read_float(p + 16);
+    features.edges = read_float(p + 20);
+    features.deviation = read_float(p + 24);
+    features.motion = read_float(p + 28);
+    features.active_x = static_cast<uint16_t>(AV_RL16(p + 32));
+    features.active_y = static_cast<uint16_t>(AV_RL16(p + 34));
+    features.active_width = static_cast<uint16_t>(AV_RL16(p + 36));
+    features.active_height = static_cast<uint16_t>(AV_RL16(p + 38));
+    features.flags = p[40];
+}
+
+// Measure the features of a downscaled luma frame
+static void measure_features(
+    const AVFrame *luma,
+    const AVFrame *prev_luma,
+    const FrameFeatures *prev_features,
+    int width,
+    int height,
+    FrameFeatures &features
+) {
+    FrameComplexity complexity;
+    measure_frame_complexity(luma, prev_luma, complexity);
+    features.hash = hash_frame(luma);
+    features.brightness = static_cast<float>(complexity.brightness);
+    features.edges = static_cast<float>(complexity.edges);
+    features.deviation = static_cast<float>(complexity.deviation);
+    features.motion = static_cast<float>(complexity.motion);
+    features.flags = 0;
+
+    // Scale the active area outwards to input coordinates
+    CropRect area;
+    if (find_active_area(luma, area)) {
+        int left = area.x * width / luma->width;
+        int top = area.y * height / luma->height;
+        int right = std::min((area.x + area.width) * width / luma->width + 1, width);
+        int bottom = std::min((area.y + area.height) * height / luma->height + 1, height);
+        features.active_x = static_cast<uint16_t>(left);
+        features.active_y = static_cast<uint16_t>(top);
+        features.active_width = static_cast<uint16_t>(right - left);
+        features.active_height = static_cast<uint16_t>(bottom - top);
+    } else {
+        features.active_x = features.active_y = 0;
+        features.active_width = features.active_height = 0;
+        features.flags |= FRAME_BLACK;
+    }
+
+    if (prev_features == nullptr || complexity.motion > SCENE_CUT_MOTION) {
+        features.flags |= FRAME_SCENE_CUT;
+        return;
+    }
+    if (features.hash == prev_features->hash) {
+        features.flags |= FRAME_DUPLICATE;
+    }
+
+    // In a fade, the frame differs from the previous one only by the change in brightness
+    double brightness_step = std::abs(complexity.brightness - prev_features->brightness);
+    if (brightness_step >= FADE_STEP && complexity.motion <= brightness_step + FADE_STEP) {
+        features.flags |= FRAME_FADE;
+    }
+}
+
+static int write_sidecar(
+    const std::filesystem::path &fpath,
+    const std::filesystem::path &in_fpath,
+    int width,
+    int height,
+    const std::vector<FrameFeatures> &frames
+) {
+    std::error_code ec;
+    uintmax_t in_size = std::filesystem::file_size(in_fpath, ec);
+    if (ec) {
+        spdlog::error("Failed to get the size of '{}': {}", in_fpath.u8string(), ec.message());
+        return AVERROR(EIO);
+    }
+
+    std::vector<uint8_t> buffer(HEADER_SIZE + RECORD_SIZE * frames.size());
+    memcpy(buffer.data(), SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+    AV_WL32(buffer.data() + 8, SIDECAR_VERSION);
+    AV_WL32(buffer.data() + 12, static_cast<uint32_t>(RECORD_SIZE));
+    AV_WL32(buffer.data() + 16, static_cast<uint32_t>(width));
+    AV_WL32(buffer.data() + 20, static_cast<uint32_t>(height));
+    AV_WL64(buffer.data() + 24, static_cast<uint64_t>(in_size));
+    AV_WL64(buffer.data() + 32, static_cast<uint64_t>(frames.size()));
+    for (size_t i = 0; i < frames.size(); i++) {
+        write_record(buffer.data() + HEADER_SIZE + i * RECORD_SIZE, frames[i]);
+    }
+
+    std::ofstream file(fpath, std::ios::binary | std::ios::trunc);
+    file.write(
+        reinterpret_cast<const char *>(buffer.data()), static_cast<std::streamsize>(buffer.size())
+    );
+    if (!file) {
+        spdlog::error("Error writing analysis file '{}'", fpath.u8string());
+        return AVERROR(EIO);
+    }
+    return 0;
+}
+
+int VideoAnalysis::analyze(
+    const std::filesystem::path &in_fpath,
+    VideoProcessingContext *proc_ctx
+) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    auto start_time = std::chrono::steady_clock::now();
+
+    // Read the full size first to pick the decoder's resolution reduction
+    int width, height;
+    {
+        AVInputFormatContextPtr fmt_ctx;
+        int ret = open_input_file(in_fpath, fmt_ctx);
+        if (ret < 0) {
+            return ret;
+        }
+        ret = av_find_best_stream(fmt_ctx.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (ret < 0) {
+            spdlog::error("Could not find video stream in the input file");
+            return ret;
+        }
+        width = fmt_ctx->streams[ret]->codecpar->width;
+        height = fmt_ctx->streams[ret]->codecpar->height;
+    }
+    int lowres = 0;
+    while (lowres < MAX_LOWRES && (width >> (lowres + 1)) >= ANALYSIS_WIDTH) {
+        lowres++;
+    }
+
+    Decoder decoder;
+    int ret = decoder.init(AV_HWDEVICE_TYPE_NONE, nullptr, in_fpath, lowres, true);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        spdlog::error("Failed to initialize decoder: {}", errbuf);
+        return ret;
+    }
+    AVFormatContext *ifmt_ctx = decoder.get_format_context();
+    int in_vstream_idx = decoder.get_video_stream_index();
+    AVRational time_base = ifmt_ctx->streams[in_vstream_idx]->time_base;
+    proc_ctx->total_frames = get_video_frame_count(ifmt_ctx, in_vstream_idx);
+
+    int luma_width = std::min(width, ANALYSIS_WIDTH);
+    int luma_height = std::max(static_cast<int>(av_rescale(height, luma_width, width)) & ~1, 2);
+    spdlog::info("Analyzing frames at {}x{}", luma_width, luma_height);
+
+    AVFramePtr frame(av_frame_alloc());
+    if (!frame) {
+        spdlog::error("Could not allocate AVFrame");
+        return AVERROR(ENOMEM);
+    }
+
+    std::vector<FrameFeatures> frames;
+    AVFramePtr prev_luma;
+    while (true) {
+        if (!proc_ctx->control->wait_if_paused()) {
+            ret = 0;
+            break;
+        }
+
+        ret = decoder.decode_next_frame(frame.get());
+        if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        } else if (ret < 0) {
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            spdlog::error("Error decoding video frame: {}", errbuf);
+            break;
+        }
+
+        AVFramePtr luma(
+            scale_avframe(frame.get(), luma_width, luma_height, AV_PIX_FMT_GRAY8, SWS_AREA)
+        );
+        if (!luma) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+
+        FrameFeatures features;
+        features.pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+        measure_features(
+            luma.get(),
+            prev_luma.get(),
+            frames.empty() ? nullptr : &frames.back(),
+            width,
+            height,
+            features
+        );
+        frames.push_back(features);
+        prev_luma = std::move(luma);
+        av_frame_unref(frame.get());
+        proc_ctx->processed_frames++;
+    }
+    if (ret < 0 || proc_ctx->control->is_aborted()) {
+        return ret;
+    }
+
+    // Frames are looked up by timestamp
+    std::stable_sort(frames.begin(), frames.end(), [](const auto &a, const auto &b) {
+        return a.pts < b.pts;
+    });
+    width_ = width;
+    height_ = height;
+    frames_ = std::move(frames);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    if (frames_.size() > 1 && elapsed.count() > 0) {
+        double duration = static_cast<double>(frames_.back().pts - frames_.front().pts) *
+                          av_q2d(time_base);
+        spdlog::info(
+            "Analyzed {} frames in {:.1f}s ({:.1f}x realtime)",
+            frames_.size(),
+            elapsed.count(),
+            duration / elapsed.count()
+        );
+    }
+    return 0;
+}
+
+int analyze_video_frames(
+    const std::filesystem::path &in_fpath,
+    const std::filesystem::path &sidecar_fpath,
+    VideoProcessingContext *proc_ctx
+) {
+    VideoAnalysis analysis;
+    int ret = analysis.analyze(in_fpath, proc_ctx);
+    if (ret < 0 || proc_ctx->control->is_aborted()) {
+        return ret;
+    }
+    return write_sidecar(
+        sidecar_fpath, in_fpath, analysis.width(), analysis.height(), analysis.frames()
+    );
+}
+
+int VideoAnalysis::load(const std::filesystem::path &fpath, const std::filesystem::path &in_fpath) {
+    std::ifstream file(fpath, std::ios::binary);
+    if (!file) {
+        spdlog::error("Could not open analysis file '{}'", fpath.u8string());
+        return AVERROR(ENOENT);
+    }
+
+    uint8_t header[HEADER_SIZE];
+    if (!file.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+        memcmp(header, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) != 0 ||
+        AV_RL32(header + 8) != SIDECAR_VERSION || AV_RL32(header + 12) != RECORD_SIZE) {
+        spdlog::error("'{}' is not a supported analysis file", fpath.u8string());
+        return AVERROR_INVALIDDATA;
+    }
+
+    std::error_code ec;
+    uintmax_t in_size = std::filesystem::file_size(in_fpath, ec);
+    if (ec || AV_RL64(header + 24) != in_size) {
+        spdlog::error("Analysis '{}' was created for a different input file", fpath.u8string());
+        return AVERROR(EINVAL);
+    }
+
+    width_ = static_cast<int>(AV_RL32(header + 16));
+    height_ = static_cast<int>(AV_RL32(header + 20));
+    uint64_t frame_count = AV_RL64(header + 32);
+    if (std::filesystem::file_size(fpath, ec) != HEADER_SIZE + RECORD_SIZE * frame_count) {
+        spdlog::error("Analysis file '{}' is truncated", fpath.u8string());
+        return AVERROR_INVALIDDATA;
+    }
+
+    std::vector<uint8_t> records(RECORD_SIZE * frame_count);
+    if (!file.read(
+            reinterpret_cast<char *>(records.data()), static_cast<std::streamsize>(records.size())
+        )) {
+        spdlog::error("Analysis file '{}' is truncated", fpath.u8string());
+        return AVERROR_INVALIDDATA;
+    }
+    frames_.resize(frame_count);
+    for (size_t i = 0; i < frames_.size(); i++) {
+        read_record(records.data() + i * RECORD_SIZE, frames_[i]);
+    }
+
+    spdlog::debug("Loaded the analysis of {} frames", frames_.size());
+    return 0;
+}
+
+const FrameFeatures *VideoAnalysis::find(int64_t pts) const {
+    auto it = std::lower_bound(
+        frames_.begin(),
+        frames_.end(),
+        pts,
+        [](const FrameFeatures &features, int64_t value) { return features.pts < value; }
+    );
+    if (it == frames_.end() || it->pts != pts) {
+        return nullptr;
+    }
+    return &*it;
+}
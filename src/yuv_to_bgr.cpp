@@ -0,0 +1,509 @@
+#include "yuv_to_bgr.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/cpu.h>
+}
+
+#include <spdlog/spdlog.h>
+
+#include "avutils.h"
+#include "conversions.h"
+#include "fused_conversion.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define YUV_TO_BGR_X86
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+#endif
+
+// Samples are scaled up by SAMPLE_SHIFT bits and multiplied by coefficients with COEFF_BITS
+// fractional bits, keeping the high 16 bits of the product as _mm_mulhi_epi16 does
+// This leaves RESULT_BITS fractional bits in the BGR values while staying within 16 bits.
+static constexpr int SAMPLE_SHIFT = 7;
+static constexpr int COEFF_BITS = 12;
+static constexpr int RESULT_BITS = SAMPLE_SHIFT + COEFF_BITS - 16;
+
+// Fixed-point YUV to BGR coefficients for one color space and range
+struct BgrCoefficients {
+    int y_offset;
+    int y;
+    int u_b, u_g;
+    int v_g, v_r;
+};
+
+// Pointers to the rows of the planes holding one line of a frame
+// For semi-planar formats `u` points to the interleaved chroma and `v` is unused.
+struct Yuv420Row {
+    const uint8_t *y;
+    const uint8_t *u;
+    const uint8_t *v;
+};
+
+static BgrCoefficients get_coefficients(AVColorSpace colorspace, AVColorRange color_range) {
+    double kr, kb;
+    get_luma_weights(colorspace, kr, kb);
+    double kg = 1.0 - kr - kb;
+
+    bool full_range = color_range == AVCOL_RANGE_JPEG;
+    double y_scale = full_range ? 1.0 : 255.0 / 219.0;
+    double c_scale = full_range ? 1.0 : 255.0 / 224.0;
+    auto fixed = [](double value) {
+        return static_cast<int>(std::lround(value * (1 << COEFF_BITS)));
+    };
+
+    BgrCoefficients coeffs;
+    coeffs.y_offset = full_range ? 0 : 16;
+    coeffs.y = fixed(y_scale);
+    coeffs.u_b = fixed(2.0 * (1.0 - kb) * c_scale);
+    coeffs.u_g = fixed(-2.0 * kb * (1.0 - kb) / kg * c_scale);
+    coeffs.v_g = fixed(-2.0 * kr * (1.0 - kr) / kg * c_scale);
+    coeffs.v_r = fixed(2.0 * (1.0 - kr) * c_scale);
+    return coeffs;
+}
+
+static Yuv420Row get_row(const AVFrame *frame, int y) {
+    Yuv420Row row;
+    row.y = frame->data[0] + static_cast<ptrdiff_t>(y) * frame->linesize[0];
+    row.u = frame->data[1] + static_cast<ptrdiff_t>(y / 2) * frame->linesize[1];
+    row.v = nullptr;
+    if (frame->format == AV_PIX_FMT_YUV420P) {
+        row.v = frame->data[2] + static_cast<ptrdiff_t>(y / 2) * frame->linesize[2];
+    }
+    return row;
+}
+
+// Reduce an MSB-aligned 16-bit sample to 8 bits, rounding and saturating like _mm_adds_epu16
+static inline int reduce_sample(uint16_t sample) {
+    return std::min(sample + 128, 65535) >> 8;
+}
+
+static inline uint8_t clip_result(int value) {
+    return static_cast<uint8_t>(
+        std::clamp((value + (1 << (RESULT_BITS - 1))) >> RESULT_BITS, 0, 255)
+    );
+}
+
+// Reference implementation; also converts the pixels left over by the SIMD kernels
+static void convert_row_scalar(
+    AVPixelFormat pix_fmt,
+    const Yuv420Row &row,
+    int x,
+    int width,
+    uint8_t *dst,
+    const BgrCoefficients &coeffs
+) {
+    const uint16_t *y16 = reinterpret_cast<const uint16_t *>(row.y);
+    const uint16_t *uv16 = reinterpret_cast<const uint16_t *>(row.u);
+    for (; x < width; x++) {
+        int y, u, v;
+        if (pix_fmt == AV_PIX_FMT_YUV420P) {
+            y = row.y[x];
+            u = row.u[x / 2];
+            v = row.v[x / 2];
+        } else if (pix_fmt == AV_PIX_FMT_NV12) {
+            y = row.y[x];
+            u = row.u[x / 2 * 2];
+            v = row.u[x / 2 * 2 + 1];
+        } else {
+            y = reduce_sample(y16[x]);
+            u = reduce_sample(uv16[x / 2 * 2]);
+            v = reduce_sample(uv16[x / 2 * 2 + 1]);
+        }
+
+        int y_term = ((y - coeffs.y_offset) * (1 << SAMPLE_SHIFT) * coeffs.y) >> 16;
+        int u_diff = (u - 128) * (1 << SAMPLE_SHIFT);
+        int v_diff = (v - 128) * (1 << SAMPLE_SHIFT);
+        dst[x * 3] = clip_result(y_term + ((u_diff * coeffs.u_b) >> 16));
+        dst[x * 3 + 1] = clip_result(
+            y_term + ((u_diff * coeffs.u_g) >> 16) + ((v_diff * coeffs.v_g) >> 16)
+        );
+        dst[x * 3 + 2] = clip_result(y_term + ((v_diff * coeffs.v_r) >> 16));
+    }
+}
+
+#ifdef YUV_TO_BGR_X86
+
+TARGET_SSE41 static inline __m128i reduce_samples_sse41(__m128i samples) {
+    return _mm_srli_epi16(_mm_adds_epu16(samples, _mm_set1_epi16(128)), 8);
+}
+
+// Convert 8 pixels of 16-bit Y, U, and V samples into 16-bit B, G, and R values
+TARGET_SSE41 static inline void yuv_to_bgr_sse41(
+    __m128i y,
+    __m128i u,
+    __m128i v,
+    const BgrCoefficients &coeffs,
+    __m128i &b,
+    __m128i &g,
+    __m128i &r
+) {
+    __m128i y_offset = _mm_set1_epi16(static_cast<int16_t>(coeffs.y_offset));
+    __m128i y_coeff = _mm_set1_epi16(static_cast<int16_t>(coeffs.y));
+    __m128i u_b = _mm_set1_epi16(static_cast<int16_t>(coeffs.u_b));
+    __m128i u_g = _mm_set1_epi16(static_cast<int16_t>(coeffs.u_g));
+    __m128i v_g = _mm_set1_epi16(static_cast<int16_t>(coeffs.v_g));
+    __m128i v_r = _mm_set1_epi16(static_cast<int16_t>(coeffs.v_r));
+    __m128i chroma_offset = _mm_set1_epi16(128);
+    __m128i rounding = _mm_set1_epi16(1 << (RESULT_BITS - 1));
+
+    __m128i y_term =
+        _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(y, y_offset), SAMPLE_SHIFT), y_coeff);
+    __m128i u_diff = _mm_slli_epi16(_mm_sub_epi16(u, chroma_offset), SAMPLE_SHIFT);
+    __m128i v_diff = _mm_slli_epi16(_mm_sub_epi16(v, chroma_offset), SAMPLE_SHIFT);
+
+    b = _mm_add_epi16(y_term, _mm_mulhi_epi16(u_diff, u_b));
+    g = _mm_add_epi16(
+        _mm_add_epi16(y_term, _mm_mulhi_epi16(u_diff, u_g)), _mm_mulhi_epi16(v_diff, v_g)
+    );
+    r = _mm_add_epi16(y_term, _mm_mulhi_epi16(v_diff, v_r));
+    b = _mm_srai_epi16(_mm_add_epi16(b, rounding), RESULT_BITS);
+    g = _mm_srai_epi16(_mm_add_epi16(g, rounding), RESULT_BITS);
+    r = _mm_srai_epi16(_mm_add_epi16(r, rounding), RESULT_BITS);
+}
+
+// Byte shuffles moving the B, G, and R values of 16 pixels to their positions in each of the
+// three 16-byte blocks of BGR24 output; -1 clears the byte
+alignas(16) static const int8_t BGR_SHUFFLES[3][3][16] = {
+    {
+        {0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5},
+        {-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1},
+        {-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1},
+    },
+    {
+        {-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1},
+        {5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10},
+        {-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1},
+    },
+    {
+        {-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1},
+        {-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1},
+        {10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15},
+    },
+};
+
+// Interleave 16 pixels of B, G, and R bytes into 48 bytes of BGR24
+TARGET_SSE41 static inline void store_bgr_sse41(uint8_t *dst, __m128i b, __m128i g, __m128i r) {
+    for (int i = 0; i < 3; i++) {
+        const __m128i *shuffles = reinterpret_cast<const __m128i *>(BGR_SHUFFLES[i]);
+        __m128i out = _mm_or_si128(
+            _mm_or_si128(
+                _mm_shuffle_epi8(b, _mm_load_si128(shuffles)),
+                _mm_shuffle_epi8(g, _mm_load_si128(shuffles + 1))
+            ),
+            _mm_shuffle_epi8(r, _mm_load_si128(shuffles + 2))
+        );
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 16), out);
+    }
+}
+
+// Convert 16 pixels at a time; returns the first pixel left for the caller
+TARGET_SSE41 static int convert_row_sse41(
+    AVPixelFormat pix_fmt,
+    const Yuv420Row &row,
+    int x,
+    int width,
+    uint8_t *dst,
+    const BgrCoefficients &coeffs
+) {
+    const uint16_t *y16 = reinterpret_cast<const uint16_t *>(row.y);
+    const uint16_t *uv16 = reinterpret_cast<const uint16_t *>(row.u);
+    for (; x + 16 <= width; x += 16) {
+        // Luma of the 16 pixels and chroma of the 8 pixel pairs as 16-bit samples
+        __m128i y_lo, y_hi, u, v;
+        if (pix_fmt == AV_PIX_FMT_P010) {
+            y_lo =
+                reduce_samples_sse41(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y16 + x)));
+            y_hi = reduce_samples_sse41(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(y16 + x + 8))
+            );
+            __m128i uv0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(uv16 + x));
+            __m128i uv1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(uv16 + x + 8));
+            __m128i mask = _mm_set1_epi32(0xffff);
+            u = reduce_samples_sse41(
+                _mm_packus_epi32(_mm_and_si128(uv0, mask), _mm_and_si128(uv1, mask))
+            );
+            v = reduce_samples_sse41(
+                _mm_packus_epi32(_mm_srli_epi32(uv0, 16), _mm_srli_epi32(uv1, 16))
+            );
+        } else {
+            __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row.y + x));
+            y_lo = _mm_cvtepu8_epi16(y8);
+            y_hi = _mm_cvtepu8_epi16(_mm_srli_si128(y8, 8));
+            if (pix_fmt == AV_PIX_FMT_NV12) {
+                __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row.u + x));
+                u = _mm_and_si128(uv, _mm_set1_epi16(0xff));
+                v = _mm_srli_epi16(uv, 8);
+            } else {
+                u = _mm_cvtepu8_epi16(
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i *>(row.u + x / 2))
+                );
+                v = _mm_cvtepu8_epi16(
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i *>(row.v + x / 2))
+                );
+            }
+        }
+
+        // Each chroma sample covers two neighboring pixels
+        __m128i b_lo, g_lo, r_lo, b_hi, g_hi, r_hi;
+        yuv_to_bgr_sse41(
+            y_lo, _mm_unpacklo_epi16(u, u), _mm_unpacklo_epi16(v, v), coeffs, b_lo, g_lo, r_lo
+        );
+        yuv_to_bgr_sse41(
+            y_hi, _mm_unpackhi_epi16(u, u), _mm_unpackhi_epi16(v, v), coeffs, b_hi, g_hi, r_hi
+        );
+        store_bgr_sse41(
+            dst + x * 3,
+            _mm_packus_epi16(b_lo, b_hi),
+            _mm_packus_epi16(g_lo, g_hi),
+            _mm_packus_epi16(r_lo, r_hi)
+        );
+    }
+    return x;
+}
+
+TARGET_AVX2 static inline __m256i reduce_samples_avx2(__m256i samples) {
+    return _mm256_srli_epi16(_mm256_adds_epu16(samples, _mm256_set1_epi16(128)), 8);
+}
+
+// Convert 16 pixels of 16-bit Y, U, and V samples into 16-bit B, G, and R values
+TARGET_AVX2 static inline void yuv_to_bgr_avx2(
+    __m256i y,
+    __m256i u,
+    __m256i v,
+    const BgrCoefficients &coeffs,
+    __m256i &b,
+    __m256i &g,
+    __m256i &r
+) {
+    __m256i y_offset = _mm256_set1_epi16(static_cast<int16_t>(coeffs.y_offset));
+    __m256i y_coeff = _mm256_set1_epi16(static_cast<int16_t>(coeffs.y));
+    __m256i u_b = _mm256_set1_epi16(static_cast<int16_t>(coeffs.u_b));
+    __m256i u_g = _mm256_set1_epi16(static_cast<int16_t>(coeffs.u_g));
+    __m256i v_g = _mm256_set1_epi16(static_cast<int16_t>(coeffs.v_g));
+    __m256i v_r = _mm256_set1_epi16(static_cast<int16_t>(coeffs.v_r));
+    __m256i chroma_offset = _mm256_set1_epi16(128);
+    __m256i rounding = _mm256_set1_epi16(1 << (RESULT_BITS - 1));
+
+    __m256i y_term = _mm256_mulhi_epi16(
+        _mm256_slli_epi16(_mm256_sub_epi16(y, y_offset), SAMPLE_SHIFT), y_coeff
+    );
+    __m256i u_diff = _mm256_slli_epi16(_mm256_sub_epi16(u, chroma_offset), SAMPLE_SHIFT);
+    __m256i v_diff = _mm256_slli_epi16(_mm256_sub_epi16(v, chroma_offset), SAMPLE_SHIFT);
+
+    b = _mm256_add_epi16(y_term, _mm256_mulhi_epi16(u_diff, u_b));
+    g = _mm256_add_epi16(
+        _mm256_add_epi16(y_term, _mm256_mulhi_epi16(u_diff, u_g)),
+        _mm256_mulhi_epi16(v_diff, v_g)
+    );
+    r = _mm256_add_epi16(y_term, _mm256_mulhi_epi16(v_diff, v_r));
+    b = _mm256_srai_epi16(_mm256_add_epi16(b, rounding), RESULT_BITS);
+    g = _mm256_srai_epi16(_mm256_add_epi16(g, rounding), RESULT_BITS);
+    r = _mm256_srai_epi16(_mm256_add_epi16(r, rounding), RESULT_BITS);
+}
+
+// Pack two vectors of 16 16-bit values into 32 bytes in order
+TARGET_AVX2 static inline __m256i pack_bytes_avx2(__m256i lo, __m256i hi) {
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8);
+}
+
+// Convert 32 pixels at a time; returns the first pixel left for the caller
+TARGET_AVX2 static int convert_row_avx2(
+    AVPixelFormat pix_fmt,
+    const Yuv420Row &row,
+    int x,
+    int width,
+    uint8_t *dst,
+    const BgrCoefficients &coeffs
+) {
+    const uint16_t *y16 = reinterpret_cast<const uint16_t *>(row.y);
+    const uint16_t *uv16 = reinterpret_cast<const uint16_t *>(row.u);
+    for (; x + 32 <= width; x += 32) {
+        // Luma of the 32 pixels and chroma of the 16 pixel pairs as 16-bit samples
+        __m256i y_lo, y_hi, u, v;
+        if (pix_fmt == AV_PIX_FMT_P010) {
+            y_lo = reduce_samples_avx2(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y16 + x))
+            );
+            y_hi = reduce_samples_avx2(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y16 + x + 16))
+            );
+            __m256i uv0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(uv16 + x));
+            __m256i uv1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(uv16 + x + 16));
+            __m256i mask = _mm256_set1_epi32(0xffff);
+            u = _mm256_packus_epi32(_mm256_and_si256(uv0, mask), _mm256_and_si256(uv1, mask));
+            v = _mm256_packus_epi32(_mm256_srli_epi32(uv0, 16), _mm256_srli_epi32(uv1, 16));
+            u = reduce_samples_avx2(_mm256_permute4x64_epi64(u, 0xd8));
+            v = reduce_samples_avx2(_mm256_permute4x64_epi64(v, 0xd8));
+        } else {
+            __m256i y8 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row.y + x));
+            y_lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(y8));
+            y_hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(y8, 1));
+            if (pix_fmt == AV_PIX_FMT_NV12) {
+                __m256i uv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row.u + x));
+                u = _mm256_and_si256(uv, _mm256_set1_epi16(0xff));
+                v = _mm256_srli_epi16(uv, 8);
+            } else {
+                u = _mm256_cvtepu8_epi16(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(row.u + x / 2))
+                );
+                v = _mm256_cvtepu8_epi16(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(row.v + x / 2))
+                );
+            }
+        }
+
+        // Unpacking works within 128-bit lanes, so move the chroma of pixels 8-15 to the upper
+        // lane first; each chroma sample then covers two neighboring pixels
+        u = _mm256_permute4x64_epi64(u, 0xd8);
+        v = _mm256_permute4x64_epi64(v, 0xd8);
+        __m256i b_lo, g_lo, r_lo, b_hi, g_hi, r_hi;
+        yuv_to_bgr_avx2(
+            y_lo, _mm256_unpacklo_epi16(u, u), _mm256_unpacklo_epi16(v, v), coeffs, b_lo, g_lo, r_lo
+        );
+        yuv_to_bgr_avx2(
+            y_hi, _mm256_unpackhi_epi16(u, u), _mm256_unpackhi_epi16(v, v), coeffs, b_hi, g_hi, r_hi
+        );
+
+        __m256i b = pack_bytes_avx2(b_lo, b_hi);
+        __m256i g = pack_bytes_avx2(g_lo, g_hi);
+        __m256i r = pack_bytes_avx2(r_lo, r_hi);
+        store_bgr_sse41(
+            dst + x * 3,
+            _mm256_castsi256_si128(b),
+            _mm256_castsi256_si128(g),
+            _mm256_castsi256_si128(r)
+        );
+        store_bgr_sse41(
+            dst + x * 3 + 48,
+            _mm256_extracti128_si256(b, 1),
+            _mm256_extracti128_si256(g, 1),
+            _mm256_extracti128_si256(r, 1)
+        );
+    }
+    return x;
+}
+
+#endif  // YUV_TO_BGR_X86
+
+YuvToBgrKernel get_yuv_to_bgr_kernel() {
+#ifdef YUV_TO_BGR_X86
+    int cpu_flags = av_get_cpu_flags();
+    if (cpu_flags & AV_CPU_FLAG_AVX2) {
+        return YUV_TO_BGR_AVX2;
+    }
+    if (cpu_flags & AV_CPU_FLAG_SSE4) {
+        return YUV_TO_BGR_SSE41;
+    }
+#endif
+    return YUV_TO_BGR_SCALAR;
+}
+
+const char *get_yuv_to_bgr_kernel_name(YuvToBgrKernel kernel) {
+    switch (kernel) {
+        case YUV_TO_BGR_SSE41:
+            return "SSE4.1";
+        case YUV_TO_BGR_AVX2:
+            return "AVX2";
+        default:
+            return "scalar";
+    }
+}
+
+bool is_yuv_to_bgr_supported(AVPixelFormat pix_fmt) {
+    return pix_fmt == AV_PIX_FMT_YUV420P || pix_fmt == AV_PIX_FMT_NV12 ||
+           pix_fmt == AV_PIX_FMT_P010;
+}
+
+int convert_yuv420_to_bgr24(
+    const AVFrame *src_frame,
+    uint8_t *dst,
+    int dst_linesize,
+    YuvToBgrKernel kernel
+) {
+    AVPixelFormat pix_fmt = static_cast<AVPixelFormat>(src_frame->format);
+    if (!is_yuv_to_bgr_supported(pix_fmt)) {
+        spdlog::error("Direct conversion from pixel format {} is not supported", src_frame->format);
+        return AVERROR(ENOSYS);
+    }
+
+    BgrCoefficients coeffs = get_coefficients(src_frame->colorspace, src_frame->color_range);
+    for (int y = 0; y < src_frame->height; y++) {
+        Yuv420Row row = get_row(src_frame, y);
+        uint8_t *dst_row = dst + static_cast<ptrdiff_t>(y) * dst_linesize;
+        int x = 0;
+#ifdef YUV_TO_BGR_X86
+        if (kernel == YUV_TO_BGR_AVX2) {
+            x = convert_row_avx2(pix_fmt, row, x, src_frame->width, dst_row, coeffs);
+        }
+        if (kernel == YUV_TO_BGR_AVX2 || kernel == YUV_TO_BGR_SSE41) {
+            x = convert_row_sse41(pix_fmt, row, x, src_frame->width, dst_row, coeffs);
+        }
+#endif
+        convert_row_scalar(pix_fmt, row, x, src_frame->width, dst_row, coeffs);
+    }
+    return 0;
+}
+
+int check_yuv_to_bgr_kernel(
+    const AVFrame *frame,
+    YuvToBgrKernel kernel,
+    double &mean_diff,
+    int &max_diff
+) {
+    int linesize = frame->width * 3;
+    size_t size = static_cast<size_t>(linesize) * static_cast<size_t>(frame->height);
+    std::vector<uint8_t> output(size);
+    std::vector<uint8_t> reference(size);
+
+    int ret = convert_yuv420_to_bgr24(frame, output.data(), linesize, kernel);
+    if (ret < 0) {
+        return ret;
+    }
+    if (kernel != YUV_TO_BGR_SCALAR) {
+        ret = convert_yuv420_to_bgr24(frame, reference.data(), linesize, YUV_TO_BGR_SCALAR);
+        if (ret < 0) {
+            return ret;
+        }
+        if (output != reference) {
+            spdlog::error(
+                "The {} YUV to BGR kernel does not match the scalar kernel",
+                get_yuv_to_bgr_kernel_name(kernel)
+            );
+            return AVERROR_BUG;
+        }
+    }
+
+    AVFramePtr sws_frame(
+        scale_avframe(frame, frame->width, frame->height, AV_PIX_FMT_BGR24, SWS_BILINEAR)
+    );
+    if (!sws_frame) {
+        return AVERROR(ENOMEM);
+    }
+
+    int64_t total_diff = 0;
+    max_diff = 0;
+    for (int y = 0; y < frame->height; y++) {
+        const uint8_t *sws_row = sws_frame->data[0] + y * sws_frame->linesize[0];
+        const uint8_t *row = output.data() + static_cast<ptrdiff_t>(y) * linesize;
+        for (int x = 0; x < linesize; x++) {
+            int diff = std::abs(row[x] - sws_row[x]);
+            total_diff += diff;
+            max_diff = std::max(max_diff, diff);
+        }
+    }
+    mean_diff = static_cast<double>(total_diff) / static_cast<double>(size);
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <csignal>
+#include <cinttypes>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
@@ -11,6 +13,7 @@
 #include <string>
 #include <thread>
 #include <unordered_set>
+#include <vector>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -25,6 +28,7 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/hwcontext.h>
+#include <libavutil/parseutils.h>
 #include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 
@@ -53,6 +57,9 @@ std::atomic<bool> newline_required = false;
 // Mutex for synchronizing access to VideoProcessingContext
 std::mutex proc_ctx_mutex;
 
+// Signaled when the processing thread completes
+std::condition_variable proc_ctx_cv;
+
 // Structure to hold parsed arguments
 struct Arguments {
     StringType loglevel = STR("info");
@@ -67,12 +74,41 @@ struct Arguments {
     bool nocopystreams = false;
     bool benchmark = false;
 
+    // Processing options
+    bool pipelined = false;
+    int queue_size = 4;
+    int filter_workers = 1;
+    bool adaptive_workers = false;
+    int segments = 1;
+    double segment_duration = 0;
+    bool resume = false;
+    int preview_frames = 0;
+    int estimate_samples = 0;
+    int64_t memory_budget = 0;
+    int prefetch_packets = 0;
+    bool decouple_streams = false;
+    bool dedup_frames = false;
+    double dedup_threshold = 0;
+    bool inverse_telecine = false;
+    StringType autocrop = STR("none");
+    bool route_by_complexity = false;
+    double route_threshold = 4.0;
+    StringType prescale = STR("none");
+    std::vector<std::string> roi_rects;
+    std::filesystem::path roi_sidecar;
+    bool analyze = false;
+    std::filesystem::path analysis_sidecar;
+    bool noswscache = false;
+    bool fused_conversion = false;
+
     // Encoder options
     StringType codec = STR("libx264");
     StringType preset = STR("slow");
     StringType pix_fmt;
     int64_t bitrate = 0;
     float crf = 20.0f;
+    StringType start_time;
+    StringType end_time;
 
     // libplacebo options
     std::filesystem::path shader_path;
@@ -273,6 +309,31 @@ int is_valid_gpu_id(uint32_t gpu_id) {
     return 1;
 }
 
+// Print a processing estimate as a single-line JSON object for use by other tools
+void print_estimate_json(const ProcessingEstimate &estimate) {
+    printf(
+        "{\"total_frames\":%" PRId64 ",\"sampled_frames\":%" PRId64
+        ",\"seconds_per_frame\":{\"decode\":%.6f,\"filter\":%.6f,\"encode\":%.6f}"
+        ",\"total_seconds\":{\"estimate\":%.1f,\"lower\":%.1f,\"upper\":%.1f}"
+        ",\"bytes_per_frame\":%.1f"
+        ",\"output_bytes\":{\"estimate\":%" PRId64 ",\"lower\":%" PRId64 ",\"upper\":%" PRId64
+        "},\"confidence\":0.95}\n",
+        estimate.total_frames,
+        estimate.sampled_frames,
+        estimate.decode_time_per_frame,
+        estimate.filter_time_per_frame,
+        estimate.encode_time_per_frame,
+        estimate.total_time,
+        estimate.total_time_lower,
+        estimate.total_time_upper,
+        estimate.bytes_per_frame,
+        estimate.output_size,
+        estimate.output_size_lower,
+        estimate.output_size_upper
+    );
+    fflush(stdout);
+}
+
 // Wrapper function for video processing thread
 void process_video_thread(
     Arguments *arguments,
@@ -280,7 +341,9 @@ void process_video_thread(
     AVHWDeviceType hw_device_type,
     FilterConfig *filter_config,
     EncoderConfig *encoder_config,
-    VideoProcessingContext *proc_ctx
+    ProcessingConfig *processing_config,
+    VideoProcessingContext *proc_ctx,
+    ProcessingEstimate *estimate
 ) {
     enum Libvideo2xLogLevel log_level = parse_log_level(arguments->loglevel);
 
@@ -298,22 +361,41 @@ void process_video_thread(
     const CharType *in_fname = in_fname_string.c_str();
     const CharType *out_fname = out_fname_string.c_str();
 
-    *proc_ret = process_video(
-        in_fname,
-        out_fname,
-        log_level,
-        arguments->benchmark,
-        arguments->gpuid,
-        hw_device_type,
-        filter_config,
-        encoder_config,
-        proc_ctx
-    );
+    if (arguments->analyze) {
+        *proc_ret = analyze_video(in_fname, out_fname, log_level, proc_ctx);
+    } else if (arguments->estimate_samples > 0) {
+        *proc_ret = estimate_video(
+            in_fname,
+            out_fname,
+            log_level,
+            arguments->gpuid,
+            hw_device_type,
+            filter_config,
+            encoder_config,
+            arguments->estimate_samples,
+            proc_ctx,
+            estimate
+        );
+    } else {
+        *proc_ret = process_video(
+            in_fname,
+            out_fname,
+            log_level,
+            arguments->benchmark,
+            arguments->gpuid,
+            hw_device_type,
+            filter_config,
+            encoder_config,
+            processing_config,
+            proc_ctx
+        );
+    }
 
     {
         std::lock_guard<std::mutex> lock(proc_ctx_mutex);
         proc_ctx->completed = true;
     }
+    proc_ctx_cv.notify_all();
 }
 
 #ifdef _WIN32
@@ -353,12 +435,41 @@ int main(int argc, char **argv) {
             ("nocopystreams", po::bool_switch(&arguments.nocopystreams), "Do not copy audio and subtitle streams")
             ("benchmark", po::bool_switch(&arguments.benchmark), "Discard processed frames and calculate average FPS")
 
+            // Processing options
+            ("pipelined", po::bool_switch(&arguments.pipelined), "Decode, filter, and encode frames concurrently on separate threads")
+            ("queuesize", po::value<int>(&arguments.queue_size)->default_value(4), "Number of frames buffered between pipeline stages (default: 4)")
+            ("workers,j", po::value<int>(&arguments.filter_workers)->default_value(1), "Number of filter instances processing frames in parallel (default: 1)")
+            ("adaptive", po::bool_switch(&arguments.adaptive_workers), "Adjust the number of active filter workers (up to --workers) to the slowest pipeline stage at runtime")
+            ("segments", po::value<int>(&arguments.segments)->default_value(1), "Number of keyframe-aligned segments processed in parallel (default: 1)")
+            ("segmentduration", po::value<double>(&arguments.segment_duration)->default_value(0), "Split the input into checkpointed segments of about this many seconds (default: 0, disabled)")
+            ("resume", po::bool_switch(&arguments.resume), "Resume an interrupted job from its checkpoint journal")
+            ("prefetch", po::value<int>(&arguments.prefetch_packets)->default_value(0), "Demux up to this many video packets ahead on a separate thread to hide I/O latency (default: 0, disabled)")
+            ("decouplestreams", po::bool_switch(&arguments.decouple_streams), "Copy audio and subtitle streams from a separate reader that follows the video, keeping muxer buffering small")
+            ("ivtc", po::bool_switch(&arguments.inverse_telecine), "Restore progressive frames from telecined video (e.g., 29.97i to 23.976p) before filtering")
+            ("autocrop", PO_STR_VALUE<StringType>(&arguments.autocrop)->default_value(STR("none"), "none"), "Only filter the area inside black borders: 'pad' restores the borders in black, 'keep' outputs the cropped area (default: none)")
+            ("route", po::bool_switch(&arguments.route_by_complexity), "Upscale scenes with little detail (fades, flat credits, blurry motion) with a bicubic resampler instead of RealESRGAN; the scenes are analyzed first unless --analysis is given")
+            ("routethreshold", po::value<double>(&arguments.route_threshold)->default_value(4.0), "Detail score (mean luma gradient, 0-255) above which a scene is sent to RealESRGAN (default: 4.0)")
+            ("prescale", PO_STR_VALUE<StringType>(&arguments.prescale)->default_value(STR("none"), "none"), "Scale upscaled masters down by this factor (e.g., 2) or by the detected factor ('auto') before RealESRGAN, keeping the output size (default: none)")
+            ("roi", po::value<std::vector<std::string>>(&arguments.roi_rects)->composing(), "Region of interest as x,y,width,height in input pixels; only tiles overlapping a region are upscaled with RealESRGAN and the rest with bicubic scaling (repeatable)")
+            ("roisidecar", PO_STR_VALUE<StringType>(), "File of timed regions of interest, one '<seconds> <x> <y> <width> <height>' per line; times count from the start of the video stream")
+            ("analyze", po::bool_switch(&arguments.analyze), "Only analyze the frames at reduced resolution and write the per-frame features to the output path as a sidecar file")
+            ("analysis", PO_STR_VALUE<StringType>(), "Use the per-frame features of a sidecar file written with --analyze instead of analyzing frames during processing")
+            ("noswscache", po::bool_switch(&arguments.noswscache), "Create a new scaling context for every pixel format conversion instead of reusing cached ones (for measuring conversion throughput)")
+            ("fusedconversion", po::bool_switch(&arguments.fused_conversion), "Convert RealESRGAN output to yuv420p, nv12, yuv420p10, or p010 in a single scalar pass instead of with swscale (experimental)")
+            ("dedup", po::bool_switch(&arguments.dedup_frames), "Reuse the previous output for frames that repeat the previous frame instead of filtering them again (uses a single filter worker)")
+            ("dedupthreshold", po::value<double>(&arguments.dedup_threshold)->default_value(0), "Largest mean absolute pixel difference (0-255) for a frame to count as a repeat (default: 0, identical only)")
+            ("memorybudget", po::value<int64_t>(&arguments.memory_budget)->default_value(0), "Limit the memory held by frames in flight to this many MiB; processing slows down instead of exceeding it (default: 0, unlimited)")
+            ("estimate", po::value<int>(&arguments.estimate_samples)->default_value(0), "Estimate the processing time and output size from this many sampled segments and print the result as JSON (default: 0, disabled)")
+            ("preview", po::value<int>(&arguments.preview_frames)->default_value(0), "Only process this many evenly spaced keyframes and write them as a clip, one per second; use an image codec and pattern (e.g., -c png -o preview%03d.png) to write images (default: 0, disabled)")
+
             // Encoder options
             ("codec,c", PO_STR_VALUE<StringType>(&arguments.codec)->default_value(STR("libx264"), "libx264"), "Output codec (default: libx264)")
             ("preset,p", PO_STR_VALUE<StringType>(&arguments.preset)->default_value(STR("slow"), "slow"), "Encoder preset (default: slow)")
             ("pixfmt,x", PO_STR_VALUE<StringType>(&arguments.pix_fmt), "Output pixel format (default: auto)")
             ("bitrate,b", po::value<int64_t>(&arguments.bitrate)->default_value(0), "Bitrate in bits per second (default: 0 (VBR))")
             ("crf,q", po::value<float>(&arguments.crf)->default_value(20.0f), "Constant Rate Factor (default: 20.0)")
+            ("start", PO_STR_VALUE<StringType>(&arguments.start_time), "Start processing at this time (e.g., 90 or 00:01:30.5)")
+            ("end", PO_STR_VALUE<StringType>(&arguments.end_time), "Stop processing at this time (e.g., 120 or 00:02:00)")
 
             // libplacebo options
             ("shader,s", PO_STR_VALUE<StringType>(), "Name or path of the GLSL shader file to use")
@@ -412,7 +523,7 @@ int main(int argc, char **argv) {
             return 1;
         }
 
-        if (!vm.count("filter")) {
+        if (!vm.count("filter") && !arguments.analyze) {
             spdlog::critical("Filter type is required (libplacebo or realesrgan).");
             return 1;
         }
@@ -421,6 +532,14 @@ int main(int argc, char **argv) {
             arguments.shader_path = std::filesystem::path(vm["shader"].as<StringType>());
         }
 
+        if (vm.count("analysis")) {
+            arguments.analysis_sidecar = std::filesystem::path(vm["analysis"].as<StringType>());
+        }
+
+        if (vm.count("roisidecar")) {
+            arguments.roi_sidecar = std::filesystem::path(vm["roisidecar"].as<StringType>());
+        }
+
         if (vm.count("model")) {
             if (!is_valid_realesrgan_model(vm["model"].as<StringType>())) {
                 spdlog::critical(
@@ -458,7 +577,7 @@ int main(int argc, char **argv) {
             spdlog::critical("Scaling factor must be 2, 3, or 4.");
             return 1;
         }
-    } else {
+    } else if (!arguments.analyze) {
         spdlog::critical("Invalid filter type specified. Must be 'libplacebo' or 'realesrgan'.");
         return 1;
     }
@@ -472,6 +591,109 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // Validate queue size
+    if (arguments.queue_size < 1) {
+        spdlog::critical("Queue size must be at least 1.");
+        return 1;
+    }
+
+    // Validate the number of filter workers
+    if (arguments.filter_workers < 1) {
+        spdlog::critical("Number of workers must be at least 1.");
+        return 1;
+    }
+
+    // Validate the number of segments
+    if (arguments.segments < 1) {
+        spdlog::critical("Number of segments must be at least 1.");
+        return 1;
+    }
+
+    // Validate the prefetch depth
+    if (arguments.prefetch_packets < 0) {
+        spdlog::critical("Number of prefetched packets must be non-negative.");
+        return 1;
+    }
+
+    // Validate the automatic crop mode
+    enum AutoCropMode autocrop = AUTOCROP_NONE;
+    if (arguments.autocrop == STR("pad")) {
+        autocrop = AUTOCROP_PAD;
+    } else if (arguments.autocrop == STR("keep")) {
+        autocrop = AUTOCROP_KEEP;
+    } else if (arguments.autocrop != STR("none")) {
+        spdlog::critical("Invalid autocrop mode specified. Must be 'none', 'pad', or 'keep'.");
+        return 1;
+    }
+
+    // Validate the downscaling factor
+    bool prescale_auto = false;
+    double prescale_factor = 1.0;
+    if (arguments.prescale == STR("auto")) {
+        prescale_auto = true;
+    } else if (arguments.prescale != STR("none")) {
+        try {
+            prescale_factor = std::stod(wstring_to_utf8(arguments.prescale));
+        } catch (const std::exception &) {
+            prescale_factor = 0;
+        }
+        if (prescale_factor < 1.0) {
+            spdlog::critical("Downscaling factor must be 'none', 'auto', or a number of at least 1.");
+            return 1;
+        }
+    }
+
+    // Validate the regions of interest
+    std::vector<RoiRect> roi_rects;
+    for (const std::string &roi : arguments.roi_rects) {
+        RoiRect rect;
+        char trailing;
+        if (sscanf(
+                roi.c_str(), "%d,%d,%d,%d%c", &rect.x, &rect.y, &rect.width, &rect.height, &trailing
+            ) != 4 ||
+            rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0) {
+            spdlog::critical("Invalid region of interest '{}'. Must be x,y,width,height.", roi);
+            return 1;
+        }
+        roi_rects.push_back(rect);
+    }
+
+    // Validate the routing threshold
+    if (arguments.route_threshold < 0) {
+        spdlog::critical("Routing threshold must be non-negative.");
+        return 1;
+    }
+
+    // Validate the dedup threshold
+    if (arguments.dedup_threshold < 0) {
+        spdlog::critical("Dedup threshold must be non-negative.");
+        return 1;
+    }
+
+    // Validate the memory budget
+    if (arguments.memory_budget < 0) {
+        spdlog::critical("Memory budget must be non-negative.");
+        return 1;
+    }
+
+    // Validate the number of preview frames
+    if (arguments.preview_frames < 0) {
+        spdlog::critical("Number of preview frames must be non-negative.");
+        return 1;
+    }
+
+    // Validate the number of estimate samples
+    if (arguments.estimate_samples < 0) {
+        spdlog::critical("Number of estimate samples must be non-negative.");
+        return 1;
+    }
+
+    // Validate segment duration
+    if (arguments.segment_duration < 0) {
+        spdlog::critical("Segment duration must be non-negative.");
+        return 1;
+    }
+
     // Validate bitrate
     if (arguments.bitrate < 0) {
         spdlog::critical("Invalid bitrate specified.");
@@ -484,6 +706,28 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // Parse the time range to process
+    int64_t start_time = AV_NOPTS_VALUE;
+    int64_t end_time = AV_NOPTS_VALUE;
+    if (!arguments.start_time.empty()) {
+        if (av_parse_time(&start_time, wstring_to_utf8(arguments.start_time).c_str(), 1) < 0 ||
+            start_time < 0) {
+            spdlog::critical("Invalid start time '{}'.", wstring_to_utf8(arguments.start_time));
+            return 1;
+        }
+    }
+    if (!arguments.end_time.empty()) {
+        if (av_parse_time(&end_time, wstring_to_utf8(arguments.end_time).c_str(), 1) < 0 ||
+            end_time <= 0) {
+            spdlog::critical("Invalid end time '{}'.", wstring_to_utf8(arguments.end_time));
+            return 1;
+        }
+    }
+    if (start_time != AV_NOPTS_VALUE && end_time != AV_NOPTS_VALUE && end_time <= start_time) {
+        spdlog::critical("End time must be after the start time.");
+        return 1;
+    }
+
     // Parse codec to AVCodec
     const AVCodec *codec = avcodec_find_encoder_by_name(wstring_to_utf8(arguments.codec).c_str());
     if (!codec) {
@@ -539,6 +783,16 @@ int main(int argc, char **argv) {
 #else
     std::string shader_path_str = arguments.shader_path.string();
 #endif
+#ifdef _WIN32
+    std::wstring roi_sidecar_str = arguments.roi_sidecar.wstring();
+#else
+    std::string roi_sidecar_str = arguments.roi_sidecar.string();
+#endif
+#ifdef _WIN32
+    std::wstring analysis_sidecar_str = arguments.analysis_sidecar.wstring();
+#else
+    std::string analysis_sidecar_str = arguments.analysis_sidecar.string();
+#endif
 
     // Setup filter configurations based on the parsed arguments
     FilterConfig filter_config;
@@ -566,6 +820,42 @@ int main(int argc, char **argv) {
     encoder_config.preset = preset_str.c_str();
     encoder_config.bit_rate = arguments.bitrate;
     encoder_config.crf = arguments.crf;
+    encoder_config.start_time = start_time;
+    encoder_config.end_time = end_time;
+    encoder_config.frame_rate = {0, 0};
+
+    // Setup processing pipeline configuration
+    ProcessingConfig processing_config;
+    processing_config.pipelined = arguments.pipelined;
+    processing_config.queue_size = arguments.queue_size;
+    processing_config.filter_workers = arguments.filter_workers;
+    processing_config.adaptive_workers = arguments.adaptive_workers;
+    processing_config.segments = arguments.segments;
+    processing_config.segment_duration = arguments.segment_duration;
+    processing_config.resume = arguments.resume;
+    processing_config.preview_frames = arguments.preview_frames;
+    processing_config.memory_budget = arguments.memory_budget * 1024 * 1024;
+    processing_config.prefetch_packets = arguments.prefetch_packets;
+    processing_config.decouple_copied_streams = arguments.decouple_streams;
+    processing_config.dedup_frames = arguments.dedup_frames;
+    processing_config.dedup_threshold = arguments.dedup_threshold;
+    processing_config.inverse_telecine = arguments.inverse_telecine;
+    processing_config.autocrop = autocrop;
+    processing_config.crop_x = 0;
+    processing_config.crop_y = 0;
+    processing_config.crop_width = 0;
+    processing_config.crop_height = 0;
+    processing_config.route_by_complexity = arguments.route_by_complexity;
+    processing_config.route_threshold = arguments.route_threshold;
+    processing_config.prescale_auto = prescale_auto;
+    processing_config.prescale_factor = prescale_factor;
+    processing_config.roi_rects = roi_rects.empty() ? nullptr : roi_rects.data();
+    processing_config.roi_rect_count = static_cast<int>(roi_rects.size());
+    processing_config.roi_sidecar = roi_sidecar_str.empty() ? nullptr : roi_sidecar_str.c_str();
+    processing_config.analysis_sidecar =
+        analysis_sidecar_str.empty() ? nullptr : analysis_sidecar_str.c_str();
+    processing_config.disable_sws_cache = arguments.noswscache;
+    processing_config.fused_output_conversion = arguments.fused_conversion;
 
     // Parse hardware acceleration method
     enum AVHWDeviceType hw_device_type = AV_HWDEVICE_TYPE_NONE;
@@ -583,15 +873,21 @@ int main(int argc, char **argv) {
     VideoProcessingContext proc_ctx;
     proc_ctx.processed_frames = 0;
     proc_ctx.total_frames = 0;
-    proc_ctx.pause = false;
-    proc_ctx.abort = false;
     proc_ctx.completed = false;
+    proc_ctx.prefetch_depth = 0;
+    proc_ctx.peak_prefetch_depth = 0;
+    proc_ctx.control = create_processing_control();
+    if (proc_ctx.control == nullptr) {
+        spdlog::critical("Failed to create processing control.");
+        return 1;
+    }
 
     // Register a newline-safe log callback for FFmpeg
     av_log_set_callback(newline_safe_ffmpeg_log_callback);
 
     // Create a thread for video processing
     int proc_ret = 0;
+    ProcessingEstimate estimate = {};
     std::thread processing_thread(
         process_video_thread,
         &arguments,
@@ -599,7 +895,9 @@ int main(int argc, char **argv) {
         hw_device_type,
         &filter_config,
         &encoder_config,
-        &proc_ctx
+        &processing_config,
+        &proc_ctx,
+        &estimate
     );
     spdlog::info("Press [space] to pause/resume, [q] to abort.");
 
@@ -612,6 +910,10 @@ int main(int argc, char **argv) {
     set_nonblocking_input(true);
 #endif
 
+    // Pause and abort requests are sent to the processing thread through the control
+    bool paused = false;
+    bool aborted = false;
+
     // Main thread loop to display progress and handle input
     while (true) {
         bool completed;
@@ -637,46 +939,40 @@ int main(int argc, char **argv) {
 
         if (ch == ' ' || ch == '\n') {
             // Toggle pause state
-            {
-                std::lock_guard<std::mutex> lock(proc_ctx_mutex);
-                proc_ctx.pause = !proc_ctx.pause;
-                if (proc_ctx.pause) {
-                    std::cout
-                        << "\r\033[KProcessing paused; press [space] to resume, [q] to abort.";
-                    std::cout.flush();
-                    timer.pause();
-                } else {
-                    std::cout << "\r\033[KProcessing resumed.";
-                    std::cout.flush();
-                    timer.resume();
-                }
-                newline_required = true;
+            paused = !paused;
+            set_processing_paused(proc_ctx.control, paused);
+            if (paused) {
+                std::cout << "\r\033[KProcessing paused; press [space] to resume, [q] to abort.";
+                std::cout.flush();
+                timer.pause();
+            } else {
+                std::cout << "\r\033[KProcessing resumed.";
+                std::cout.flush();
+                timer.resume();
             }
+            newline_required = true;
         } else if (ch == 'q' || ch == 'Q') {
             // Abort processing
             if (newline_required) {
                 putchar('\n');
             }
             spdlog::warn("Aborting gracefully; press Ctrl+C to terminate forcefully.");
-            {
-                std::lock_guard<std::mutex> lock(proc_ctx_mutex);
-                proc_ctx.abort = true;
-                newline_required = false;
-            }
+            aborted = true;
+            abort_processing(proc_ctx.control);
+            newline_required = false;
             break;
         }
 
         // Display progress
         if (!arguments.noprogress) {
-            int64_t processed_frames, total_frames;
-            bool pause;
+            int64_t processed_frames, total_frames, prefetch_depth;
             {
                 std::lock_guard<std::mutex> lock(proc_ctx_mutex);
                 processed_frames = proc_ctx.processed_frames;
                 total_frames = proc_ctx.total_frames;
-                pause = proc_ctx.pause;
+                prefetch_depth = proc_ctx.prefetch_depth;
             }
-            if (!pause && (total_frames > 0 || processed_frames > 0)) {
+            if (!paused && (total_frames > 0 || processed_frames > 0)) {
                 double percentage = total_frames > 0 ? static_cast<double>(processed_frames) *
                                                            100.0 / static_cast<double>(total_frames)
                                                      : 0.0;
@@ -709,13 +1005,21 @@ int main(int argc, char **argv) {
                           << "; remaining=" << std::setw(2) << std::setfill('0') << hours_remaining
                           << ":" << std::setw(2) << std::setfill('0') << minutes_remaining << ":"
                           << std::setw(2) << std::setfill('0') << seconds_remaining;
+                if (arguments.prefetch_packets > 0) {
+                    std::cout << "; prefetch=" << prefetch_depth;
+                }
                 std::cout.flush();
                 newline_required = true;
             }
         }
 
-        // Sleep for 100ms
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // Refresh the progress every 100ms; wake up immediately once processing completes
+        {
+            std::unique_lock<std::mutex> lock(proc_ctx_mutex);
+            proc_ctx_cv.wait_for(lock, std::chrono::milliseconds(100), [&proc_ctx] {
+                return proc_ctx.completed;
+            });
+        }
     }
 
     // Restore terminal to blocking mode
@@ -725,6 +1029,8 @@ int main(int argc, char **argv) {
 
     // Join the processing thread to ensure it completes before exiting
     processing_thread.join();
+    free_processing_control(proc_ctx.control);
+    proc_ctx.control = nullptr;
 
     // Print a newline if progress bar was displayed
     if (newline_required) {
@@ -732,17 +1038,15 @@ int main(int argc, char **argv) {
     }
 
     // Print final message based on processing result
-    bool aborted;
-    {
-        std::lock_guard<std::mutex> lock(proc_ctx_mutex);
-        aborted = proc_ctx.abort;
-    }
     if (aborted) {
         spdlog::warn("Video processing aborted");
         return 2;
     } else if (proc_ret != 0) {
         spdlog::critical("Video processing failed with error code {}", proc_ret);
         return 1;
+    } else if (arguments.estimate_samples > 0) {
+        print_estimate_json(estimate);
+        return 0;
     } else {
         spdlog::info("Video processed successfully");
     }
@@ -763,6 +1067,9 @@ int main(int argc, char **argv) {
     printf("Total frames processed: %ld\n", proc_ctx.processed_frames);
     printf("Total time taken: %ld s\n", time_elapsed);
     printf("Average processing speed: %.2f FPS\n", average_speed_fps);
+    if (arguments.prefetch_packets > 0) {
+        printf("Peak packet prefetch depth: %ld\n", proc_ctx.peak_prefetch_depth);
+    }
 
     // Print additional information if not in benchmark mode
     if (!arguments.benchmark) {